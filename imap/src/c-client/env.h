@@ -27,6 +27,8 @@ void rfc822_date (char *date);
 void rfc822_timezone (char *s,void *t);
 void internal_date (char *date);
 long server_input_wait (long seconds);
+long server_input_wait_file (long seconds,char *file);
+long server_watch_file (char *file);
 void server_init (char *server,char *service,char *sasl,
 		  void *clkint,void *kodint,void *hupint,void *trmint);
 long server_login (char *user,char *pass,char *authuser,int argc,char *argv[]);
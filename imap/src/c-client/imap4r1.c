@@ -5436,6 +5436,32 @@ IMAPPARSEDREPLY *imap_fetch (MAILSTREAM *stream,char *sequence,long flags)
   return imap_send (stream,cmd,args);
 }
 
+/* IMAP prefetch header and text of several messages
+ * Accepts: MAIL stream
+ *	    sequence
+ *	    option flags (FT_UID)
+ * Returns: T on success, NIL on failure
+ *
+ * The messages are fetched with a single command and left in the cache
+ * so later header and text fetches with FT_PEEK do not hit the server.
+ */
+
+long imap_prefetch_text (MAILSTREAM *stream,char *sequence,long flags)
+{
+  char *cmd = (flags & FT_UID) ? "UID FETCH" : "FETCH";
+  IMAPARG *args[3],aseq,aatt;
+				/* need IMAP4rev1 sections */
+  if ((stream->dtb != &imapdriver) || !LEVELIMAP4rev1 (stream)) return NIL;
+  if (LOCAL->loser) sequence = imap_reform_sequence (stream,sequence,
+						     flags & FT_UID);
+  aseq.type = SEQUENCE; aseq.text = (void *) sequence;
+  aatt.type = ATOM;
+  aatt.text = (void *)
+    "(UID BODY.PEEK[HEADER] BODY.PEEK[TEXT] INTERNALDATE RFC822.SIZE FLAGS)";
+  args[0] = &aseq; args[1] = &aatt; args[2] = NIL;
+  return imap_OK (stream,imap_send (stream,cmd,args));
+}
+
 /* Reform sequence for losing server that doesn't handle ranges right
  * Accepts: MAIL stream
  *	    sequence
@@ -220,6 +220,7 @@ IMAPCAP *imap_cap (MAILSTREAM *stream);
 char *imap_host (MAILSTREAM *stream);
 long imap_cache (MAILSTREAM *stream,unsigned long msgno,char *seg,
 		 STRINGLIST *stl,SIZEDTEXT *text);
+long imap_prefetch_text (MAILSTREAM *stream,char *sequence,long flags);
 
 
 /* Temporary */
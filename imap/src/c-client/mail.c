@@ -95,6 +95,12 @@ static long mailsnarfpreserve = NIL;
 static long mailnewsrccanon = LONGT;
 				/* note network sent command */
 static sendcommand_t mailsendcommand = NIL;
+				/* decoded search text cache size */
+static unsigned long mailsearchcache = 0;
+				/* parse envelopes into arenas */
+static long mailparsearena = NIL;
+				/* arena now being parsed into */
+static MAILARENA *mailarena = NIL;
 
 				/* supported threaders */
 static THREADER mailthreadordsub = {
@@ -465,6 +471,16 @@ void *mail_parameters (MAILSTREAM *stream,long function,void *value)
     ret = (void *) mailsendcommand;
     break;
 
+  case SET_SEARCHCACHE:
+    mailsearchcache = (unsigned long) value;
+  case GET_SEARCHCACHE:
+    ret = (void *) mailsearchcache;
+    break;
+  case SET_PARSEARENA:
+    mailparsearena = (long) value;
+  case GET_PARSEARENA:
+    ret = (void *) mailparsearena;
+    break;
   case SET_SERVICENAME:
     servicename = (char *) value;
   case GET_SERVICENAME:
@@ -1238,6 +1254,7 @@ MAILSTREAM *mail_close_full (MAILSTREAM *stream,long options)
     if (stream->original_mailbox)
       fs_give ((void **) &stream->original_mailbox);
     if (stream->snarf.name) fs_give ((void *) &stream->snarf.name);
+    mail_free_matchers (stream);
     stream->sequence++;		/* invalidate sequence */
 				/* flush user flags */
     for (i = 0; i < NUSERFLAGS; i++)
@@ -2246,6 +2263,7 @@ long mail_search_full (MAILSTREAM *stream,char *charset,SEARCHPGM *pgm,
   if (pgm && stream->dtb)	/* must have a search program and driver */
     ret = (*(stream->dtb->search ? stream->dtb->search : mail_search_default))
       (stream,charset,pgm,flags);
+  mail_free_matchers (stream);	/* flush matchers compiled for this search */
 				/* flush search program if requested */
   if (flags & SE_FREE) mail_free_searchpgm (&pgm);
   return ret;
@@ -2715,9 +2733,123 @@ char *mail_cdate (char *string,MESSAGECACHE *elt)
  *    www, dd mmm yy hh:mm:ss zzz
  * . RFC-2822:
  *    www, dd mmm yyyy hh:mm:ss +zzzz
- */
+ * Results are remembered in a small table indexed by a hash of the date
+ * string, since the same dates are parsed over and over by sorting,
+ * searching, and threading.  Dates which default to the local time zone
+ * depend on the current time and are never remembered.
+ */
+
+#define DATECACHESIZE 64	/* remembered dates, must be power of 2 */
+#define DATECACHELEN 48		/* longest date string remembered */
+
+typedef struct date_cache {
+  char date[DATECACHELEN];	/* date string as given */
+  unsigned int day : 5;		/* parsed values, as in MESSAGECACHE */
+  unsigned int month : 4;
+  unsigned int year : 7;
+  unsigned int hours: 5;
+  unsigned int minutes: 6;
+  unsigned int seconds: 6;
+  unsigned int zoccident : 1;
+  unsigned int zhours : 4;
+  unsigned int zminutes: 6;
+  unsigned int ret : 1;		/* non-zero if parse successful */
+} DATECACHE;
+
+static DATECACHE datecache[DATECACHESIZE];
 
 long mail_parse_date (MESSAGECACHE *elt,unsigned char *s)
+{
+  unsigned long h,i;
+  long ret;
+  long local = NIL;
+  DATECACHE *dc = NIL;
+  if (s) {			/* hash the date string */
+    for (h = i = 0; s[i] && (i < DATECACHELEN); i++) h = h * 31 + s[i];
+    if (i < DATECACHELEN) {	/* short enough to remember? */
+      dc = &datecache[(h ^ (h >> 8)) & (DATECACHESIZE - 1)];
+      if (!strcmp (dc->date,(char *) s)) {
+	elt->day = dc->day; elt->month = dc->month; elt->year = dc->year;
+	elt->hours = dc->hours; elt->minutes = dc->minutes;
+	elt->seconds = dc->seconds; elt->zoccident = dc->zoccident;
+	elt->zhours = dc->zhours; elt->zminutes = dc->zminutes;
+	return dc->ret ? T : NIL;
+      }
+    }
+  }
+				/* try the common form, then the general */
+  ret = mail_parse_date_fast (elt,s) ? T : mail_parse_date_work (elt,s,&local);
+  if (dc && !local) {		/* remember result unless local time zone */
+    strcpy (dc->date,(char *) s);
+    dc->day = elt->day; dc->month = elt->month; dc->year = elt->year;
+    dc->hours = elt->hours; dc->minutes = elt->minutes;
+    dc->seconds = elt->seconds; dc->zoccident = elt->zoccident;
+    dc->zhours = elt->zhours; dc->zminutes = elt->zminutes;
+    dc->ret = ret ? 1 : 0;
+  }
+  return ret;
+}
+
+/* Mail parse date, RFC 2822 form only
+ * Accepts: elt to write into
+ *	    date string to parse
+ * Returns: T if parsed, NIL if mail_parse_date_work() must be used
+ * Only "www, dd mmm yyyy hh:mm:ss +zzzz" with optional day of week and
+ * anything after the time zone is accepted here; the results must be the
+ * same as those of mail_parse_date_work() for the same string.
+ */
+
+long mail_parse_date_fast (MESSAGECACHE *elt,unsigned char *s)
+{
+  static char *months = "JANFEBMARAPRMAYJUNJULAUGSEPOCTNOVDEC";
+  unsigned int d,m,y;
+  if (!s || (strlen ((char *) s) >= (size_t) MAILTMPLEN)) return NIL;
+				/* skip over possible day of week */
+  if (isalpha (*s) && isalpha (s[1]) && isalpha (s[2]) && (s[3] == ',') &&
+      (s[4] == ' ')) s += 5;
+				/* one or two digit day */
+  if (!isdigit (*s)) return NIL;
+  d = *s++ - '0';
+  if (isdigit (*s)) d = d * 10 + (*s++ - '0');
+  if (!d || (d > 31) || (*s++ != ' ') || !isalpha (*s) || !isalpha (s[1]) ||
+      !isalpha (s[2]) || (s[3] != ' ')) return NIL;
+  for (m = 0; (m < 36) && ((months[m] != toupper (*s)) ||
+			   (months[m+1] != toupper (s[1])) ||
+			   (months[m+2] != toupper (s[2]))); m += 3);
+  if (m == 36) return NIL;	/* unknown month */
+  s += 4;			/* four digit year, time, numeric zone */
+  if (!(isdigit (*s) && isdigit (s[1]) && isdigit (s[2]) && isdigit (s[3]) &&
+	(s[4] == ' ') && isdigit (s[5]) && isdigit (s[6]) && (s[7] == ':') &&
+	isdigit (s[8]) && isdigit (s[9]) && (s[10] == ':') &&
+	isdigit (s[11]) && isdigit (s[12]) && (s[13] == ' ') &&
+	((s[14] == '+') || (s[14] == '-')) && isdigit (s[15]) &&
+	isdigit (s[16]) && isdigit (s[17]) && (s[17] < '6') &&
+	isdigit (s[18]))) return NIL;
+  y = (((*s - '0') * 10 + (s[1] - '0')) * 10 + (s[2] - '0')) * 10 +
+    (s[3] - '0');
+				/* prehistoric or needs RFC 2822 fixup */
+  if (y < BASEYEAR) return NIL;
+  elt->day = d; elt->month = m / 3 + 1; elt->year = y - BASEYEAR;
+				/* far future year didn't fit? */
+  if (elt->year + BASEYEAR != y) return NIL;
+  if (((d = (s[5] - '0') * 10 + (s[6] - '0')) > 23) ||
+      ((m = (s[8] - '0') * 10 + (s[9] - '0')) > 59) ||
+      ((y = (s[11] - '0') * 10 + (s[12] - '0')) > 60)) return NIL;
+  elt->hours = d; elt->minutes = m; elt->seconds = y;
+  elt->zoccident = (s[14] == '-');
+  elt->zhours = (s[15] - '0') * 10 + (s[16] - '0');
+  elt->zminutes = (s[17] - '0') * 10 + (s[18] - '0');
+  return T;
+}
+
+/* Mail parse date, general case
+ * Accepts: elt to write into
+ *	    date string to parse
+ *	    pointer to return non-zero if local time zone was assumed
+ * Returns: T if parse successful, else NIL
+ */
+
+long mail_parse_date_work (MESSAGECACHE *elt,unsigned char *s,long *local)
 {
   unsigned long d,m,y;
   int mi,ms;
@@ -2725,6 +2857,8 @@ long mail_parse_date (MESSAGECACHE *elt,unsigned char *s)
   time_t tn;
   char tmp[MAILTMPLEN];
   static unsigned long maxyear = 0;
+  static time_t zonetime = 0;
+  static int zone = 0;
   if (!maxyear) {		/* know the end of time yet? */
     MESSAGECACHE tmpelt;
     memset (&tmpelt,0xff,sizeof (MESSAGECACHE));
@@ -2951,12 +3085,17 @@ long mail_parse_date (MESSAGECACHE *elt,unsigned char *s)
   case 'Y': elt->zoccident = 1; elt->zhours = 12; break;
 
   default:			/* unknown time zones treated as local */
+    *local = T;			/* note result depends upon time now */
     tn = time (0);		/* time now... */
-    t = localtime (&tn);	/* get local minutes since midnight */
-    mi = t->tm_hour * 60 + t->tm_min;
-    ms = t->tm_yday;		/* note Julian day */
-    if (t = gmtime (&tn)) {	/* minus UTC minutes since midnight */
-      mi -= t->tm_hour * 60 + t->tm_min;
+				/* local offset only changes on a minute */
+    if (!zonetime || ((tn / 60) != (zonetime / 60))) {
+      zonetime = tn;		/* note when offset computed */
+      zone = 0;
+      t = localtime (&tn);	/* get local minutes since midnight */
+      mi = t->tm_hour * 60 + t->tm_min;
+      ms = t->tm_yday;		/* note Julian day */
+      if (t = gmtime (&tn)) {	/* minus UTC minutes since midnight */
+	mi -= t->tm_hour * 60 + t->tm_min;
 	/* ms can be one of:
 	 *  36x  local time is December 31, UTC is January 1, offset -24 hours
 	 *    1  local time is 1 day ahead of UTC, offset +24 hours
@@ -2964,19 +3103,43 @@ long mail_parse_date (MESSAGECACHE *elt,unsigned char *s)
 	 *   -1  local time is 1 day behind UTC, offset -24 hours
 	 * -36x  local time is January 1, UTC is December 31, offset +24 hours
 	 */
-      if (ms -= t->tm_yday)	/* correct offset if different Julian day */
-	mi += ((ms < 0) == (abs (ms) == 1)) ? -24*60 : 24*60;
-      if (mi < 0) {		/* occidental? */
-	mi = abs (mi);		/* yup, make positive number */
-	elt->zoccident = 1;	/* and note west of UTC */
+	if (ms -= t->tm_yday)	/* correct offset if different Julian day */
+	  mi += ((ms < 0) == (abs (ms) == 1)) ? -24*60 : 24*60;
+	zone = mi;
       }
-      elt->zhours = mi / 60;	/* now break into hours and minutes */
-      elt->zminutes = mi % 60;
     }
+    if ((mi = zone) < 0) {	/* occidental? */
+      mi = abs (mi);		/* yup, make positive number */
+      elt->zoccident = 1;	/* and note west of UTC */
+    }
+    elt->zhours = mi / 60;	/* now break into hours and minutes */
+    elt->zminutes = mi % 60;
     break;
   }
   return T;
 }
+
+
+/* Mail parse sent date into elt
+ * Accepts: elt of message
+ *	    Date: header text of that message
+ * Returns: T if sent date valid, else NIL
+ * The sent date is parsed only once; after that the values remembered in
+ * the elt are used.
+ */
+
+long mail_parse_sentdate (MESSAGECACHE *elt,char *date)
+{
+  MESSAGECACHE delt;
+  if (!elt->sentparsed) {	/* first time for this message? */
+    elt->sentparsed = T;
+    if (elt->sentvalid = mail_parse_date (&delt,date) ? T : NIL) {
+      elt->sentdate = mail_longdate (&delt);
+      elt->sentday = mail_shortdate (delt.year,delt.month,delt.day);
+    }
+  }
+  return elt->sentvalid ? T : NIL;
+}
 
 /* Mail n messages exist
  * Accepts: mail stream
@@ -3386,12 +3549,15 @@ long mail_search_msg (MAILSTREAM *stream,unsigned long msgno,char *section,
     }
     if (!env) return NIL;	/* no envelope obtained */
 				/* sent date ranges */
-    if ((pgm->sentbefore || pgm->senton || pgm->sentsince) &&
-	(!mail_parse_date (&delt,env->date) ||
-	 !(d = mail_shortdate (delt.year,delt.month,delt.day)) ||
-	 (pgm->sentbefore && (d >= pgm->sentbefore)) ||
-	 (pgm->senton && (d != pgm->senton)) ||
-	 (pgm->sentsince && (d < pgm->sentsince)))) return NIL;
+    if (pgm->sentbefore || pgm->senton || pgm->sentsince) {
+      if (section)		/* body part dates aren't remembered */
+	d = mail_parse_date (&delt,env->date) ?
+	  mail_shortdate (delt.year,delt.month,delt.day) : 0;
+      else d = mail_parse_sentdate (elt,env->date) ? elt->sentday : 0;
+      if (!d || (pgm->sentbefore && (d >= pgm->sentbefore)) ||
+	  (pgm->senton && (d != pgm->senton)) ||
+	  (pgm->sentsince && (d < pgm->sentsince))) return NIL;
+    }
 				/* search headers */
     if ((pgm->bcc && !mail_search_addr (env->bcc,pgm->bcc)) ||
 	(pgm->cc && !mail_search_addr (env->cc,pgm->cc)) ||
@@ -3527,6 +3693,13 @@ long mail_search_text (MAILSTREAM *stream,unsigned long msgno,char *section,
   STRINGLIST *s = mail_newstringlist ();
   mailgets_t omg = mailgets;
   if (stream->dtb->flags & DR_LOWMEM) mailgets = mail_search_gets;
+				/* else search all strings in one pass */
+  else search_reset (stream->private.search.matcher =
+		     mail_search_matcher (stream,st));
+				/* cache decoded texts of top-level message */
+  stream->private.search.uid = (mailsearchcache && !section &&
+				stream->private.search.matcher) ?
+				  mail_uid (stream,msgno) : 0;
 				/* strings to search */
   for (stream->private.search.string = s; st;) {
     s->text.data = st->text.data;
@@ -3534,12 +3707,12 @@ long mail_search_text (MAILSTREAM *stream,unsigned long msgno,char *section,
     if (st = st->next) s = s->next = mail_newstringlist ();
   }
   stream->private.search.text = NIL;
-  if (flags) {			/* want header? */
-    SIZEDTEXT s,t;
+  if (flags && !mail_search_cached (stream,"HEADER",&ret)) {
+    SIZEDTEXT s,t;		/* want header and not cached */
     s.data = (unsigned char *)
       mail_fetch_header (stream,msgno,section,NIL,&s.size,FT_INTERNAL|FT_PEEK);
     utf8_mime2text (&s,&t);
-    ret = mail_search_string (&t,"UTF-8",&stream->private.search.string);
+    ret = mail_search_pending (stream,"HEADER",&t,"UTF-8");
     if (t.data != s.data) fs_give ((void **) &t.data);
   }
   if (!ret) {			/* still looking for match? */
@@ -3556,6 +3729,8 @@ long mail_search_text (MAILSTREAM *stream,unsigned long msgno,char *section,
   for (s = stream->private.search.string; s; s = s->next) s->text.data = NIL;
   mail_free_stringlist (&stream->private.search.string);
   stream->private.search.text = NIL;
+  stream->private.search.matcher = NIL;
+  stream->private.search.uid = 0;
   return ret;
 }
 
@@ -3575,19 +3750,21 @@ long mail_search_body (MAILSTREAM *stream,unsigned long msgno,BODY *body,
 {
   long ret = NIL;
   unsigned long i;
-  char *s,*t,sect[MAILTMPLEN];
+  char *s,*t,sect[MAILTMPLEN],key[MAILTMPLEN];
   SIZEDTEXT st,h;
   PART *part;
   PARAMETER *param;
   if (prefix && (strlen (prefix) > (MAILTMPLEN - 20))) return NIL;
   sprintf (sect,"%s%lu",prefix ? prefix : "",section++);
-  if (flags && prefix) {	/* want to search MIME header too? */
+				/* want to search MIME header too? */
+  if (flags && prefix &&
+      !mail_search_cached (stream,strcat (strcpy (key,sect),".MIME"),&ret)) {
     st.data = (unsigned char *) mail_fetch_mime (stream,msgno,sect,&st.size,
 						 FT_INTERNAL | FT_PEEK);
     if (stream->dtb->flags & DR_LOWMEM) ret = stream->private.search.result;
     else {
       utf8_mime2text (&st,&h);	/* make UTF-8 version of header */
-      ret = mail_search_string (&h,"UTF-8",&stream->private.search.string);
+      ret = mail_search_pending (stream,key,&h,"UTF-8");
       if (h.data != st.data) fs_give ((void **) &h.data);
     }
   }
@@ -3600,14 +3777,16 @@ long mail_search_body (MAILSTREAM *stream,unsigned long msgno,BODY *body,
     break;
   case TYPEMESSAGE:
     if (!strcmp (body->subtype,"RFC822")) {
-      if (flags) {		/* want to search nested message header? */
+				/* want to search nested message header? */
+      if (flags && !mail_search_cached (stream,strcat (strcpy (key,sect),
+						       ".HEADER"),&ret)) {
 	st.data = (unsigned char *)
 	  mail_fetch_header (stream,msgno,sect,NIL,&st.size,
 			     FT_INTERNAL | FT_PEEK);
 	if (stream->dtb->flags & DR_LOWMEM) ret =stream->private.search.result;
 	else {
 	  utf8_mime2text (&st,&h);/* make UTF-8 version of header */
-	  ret = mail_search_string (&h,"UTF-8",&stream->private.search.string);
+	  ret = mail_search_pending (stream,key,&h,"UTF-8");
 	  if (h.data != st.data) fs_give ((void **) &h.data);
 	}
       }
@@ -3621,6 +3800,7 @@ long mail_search_body (MAILSTREAM *stream,unsigned long msgno,BODY *body,
 				/* non-MESSAGE/RFC822 falls into text case */
 
   case TYPETEXT:
+    if (mail_search_cached (stream,sect,&ret)) break;
     s = mail_fetch_body (stream,msgno,sect,&i,FT_INTERNAL | FT_PEEK);
     if (stream->dtb->flags & DR_LOWMEM) ret = stream->private.search.result;
     else {
@@ -3630,20 +3810,20 @@ long mail_search_body (MAILSTREAM *stream,unsigned long msgno,BODY *body,
       case ENCBASE64:
 	if (st.data = (unsigned char *)
 	    rfc822_base64 ((unsigned char *) s,i,&st.size)) {
-	  ret = mail_search_string (&st,t,&stream->private.search.string);
+	  ret = mail_search_pending (stream,sect,&st,t);
 	  fs_give ((void **) &st.data);
 	}
 	break;
       case ENCQUOTEDPRINTABLE:
 	if (st.data = rfc822_qprint ((unsigned char *) s,i,&st.size)) {
-	  ret = mail_search_string (&st,t,&stream->private.search.string);
+	  ret = mail_search_pending (stream,sect,&st,t);
 	  fs_give ((void **) &st.data);
 	}
 	break;
       default:
 	st.data = (unsigned char *) s;
 	st.size = i;
-	ret = mail_search_string (&st,t,&stream->private.search.string);
+	ret = mail_search_pending (stream,sect,&st,t);
 	break;
       }
     }
@@ -3679,6 +3859,166 @@ long mail_search_string (SIZEDTEXT *s,char *charset,STRINGLIST **st)
 }
 
 
+/* Mail search text for pending search keys
+ * Accepts: MAIL stream
+ *	    section specifier to cache decoded text as
+ *	    sized text to search
+ *	    character set of sized text
+ * Returns: T if all search keys have been found
+ */
+
+long mail_search_pending (MAILSTREAM *stream,char *key,SIZEDTEXT *s,
+			  char *charset)
+{
+  long ret;
+  SIZEDTEXT u;
+  SEARCHMATCHER *m = stream->private.search.matcher;
+  if (!m) return mail_search_string (s,charset,&stream->private.search.string);
+				/* convert to UTF-8 as best we can */
+  if (!utf8_text (s,charset,&u,NIL)) utf8_text (s,NIL,&u,NIL);
+  ret = search_multiple (m,u.data,u.size);
+  if (stream->private.search.uid) {
+    if (u.data == s->data) {	/* cache needs its own copy */
+      u.data = NIL;
+      cpytxt (&u,(char *) s->data,s->size);
+    }
+    mail_search_cache_add (stream,key,&u);
+  }
+  else if (u.data != s->data) fs_give ((void **) &u.data);
+  return ret;
+}
+
+
+/* Mail search cached decoded text for pending search keys
+ * Accepts: MAIL stream
+ *	    section specifier of decoded text
+ *	    pointer to return search result
+ * Returns: T if text was cached and searched, else NIL
+ */
+
+long mail_search_cached (MAILSTREAM *stream,char *key,long *ret)
+{
+  SEARCHCACHE *c;
+  SEARCHCACHEENT *e;
+  if (!(stream->private.search.uid &&
+	(e = mail_search_cache_lookup (stream,key)))) return NIL;
+  if (e->newer) {		/* make it the most recently used entry */
+    c = stream->private.search.cache;
+    if (e->newer->older = e->older) e->older->newer = e->newer;
+    else c->oldest = e->newer;
+    (e->older = c->newest)->newer = e;
+    e->newer = NIL;
+    c->newest = e;
+  }
+  *ret = search_multiple (stream->private.search.matcher,e->text.data,
+			  e->text.size);
+  return LONGT;
+}
+
+/* Mail search text cache lookup
+ * Accepts: MAIL stream
+ *	    section specifier of decoded text
+ * Returns: cache entry if found, else NIL
+ */
+
+SEARCHCACHEENT *mail_search_cache_lookup (MAILSTREAM *stream,char *key)
+{
+  SEARCHCACHEENT *e;
+  SEARCHCACHE *c = stream->private.search.cache;
+  unsigned long uid = stream->private.search.uid;
+  if (!c) return NIL;		/* no cache yet */
+				/* stale if UIDs have been reassigned */
+  if (c->uid_validity != stream->uid_validity) {
+    mail_free_searchcache (stream);
+    return NIL;
+  }
+  for (e = c->hash[mail_search_cache_hash (uid,key)];
+       e && ((e->uid != uid) || strcmp (e->section,key)); e = e->next);
+  return e;
+}
+
+
+/* Mail search text cache hash bucket
+ * Accepts: message UID
+ *	    section specifier of decoded text
+ * Returns: hash bucket index
+ */
+
+unsigned long mail_search_cache_hash (unsigned long uid,char *key)
+{
+  for (; *key; key++) uid = uid * HASHMULT + (unsigned char) *key;
+  return uid % SEARCHCACHEHASH;
+}
+
+/* Mail search text cache add entry
+ * Accepts: MAIL stream
+ *	    section specifier of decoded text
+ *	    decoded text, which the cache takes over
+ */
+
+void mail_search_cache_add (MAILSTREAM *stream,char *key,SIZEDTEXT *text)
+{
+  SEARCHCACHE *c;
+  SEARCHCACHEENT *e,**ep;
+  unsigned long size = text->size + sizeof (SEARCHCACHEENT);
+				/* too big to fit or already cached? */
+  if ((size > mailsearchcache) || mail_search_cache_lookup (stream,key)) {
+    fs_give ((void **) &text->data);
+    return;
+  }
+  if (!(c = stream->private.search.cache)) {
+    c = stream->private.search.cache = (SEARCHCACHE *)
+      memset (fs_get (sizeof (SEARCHCACHE)),0,sizeof (SEARCHCACHE));
+    c->uid_validity = stream->uid_validity;
+  }
+				/* evict least recently used entries */
+  while ((e = c->oldest) && ((c->size + size) > mailsearchcache)) {
+    for (ep = &c->hash[mail_search_cache_hash (e->uid,e->section)];
+	 *ep != e; ep = &(*ep)->next);
+    *ep = e->next;		/* remove from hash bucket */
+    if (c->oldest = e->newer) c->oldest->older = NIL;
+    else c->newest = NIL;
+    c->size -= e->text.size + sizeof (SEARCHCACHEENT);
+    fs_give ((void **) &e->section);
+    fs_give ((void **) &e->text.data);
+    fs_give ((void **) &e);
+  }
+  e = (SEARCHCACHEENT *) fs_get (sizeof (SEARCHCACHEENT));
+  e->uid = stream->private.search.uid;
+  e->section = cpystr (key);
+  e->text.data = text->data;	/* take over the text */
+  e->text.size = text->size;
+				/* add to hash bucket */
+  e->next = *(ep = &c->hash[mail_search_cache_hash (e->uid,key)]);
+  *ep = e;
+  e->newer = NIL;		/* make it the most recently used entry */
+  if (e->older = c->newest) e->older->newer = e;
+  else c->oldest = e;
+  c->newest = e;
+  c->size += size;
+}
+
+
+/* Mail search compiled matcher
+ * Accepts: MAIL stream
+ *	    string list of search keys
+ * Returns: matcher for these keys, compiled once per search
+ */
+
+SEARCHMATCHER *mail_search_matcher (MAILSTREAM *stream,STRINGLIST *st)
+{
+  SEARCHMATCHER *m;
+  for (m = stream->private.search.matchers; m && (m->key != (void *) st);
+       m = m->next);
+  if (!m) {			/* not compiled yet, do so now */
+    (m = search_compile (st))->key = (void *) st;
+    m->next = stream->private.search.matchers;
+    stream->private.search.matchers = m;
+  }
+  return m;
+}
+
+
 /* Mail search keyword
  * Accepts: MAIL stream
  *	    elt to get flags from
@@ -4135,8 +4475,10 @@ SORTCACHE **mail_sort_loadcache (MAILSTREAM *stream,SORTPGM *pgm)
 				/* skip leading whitespace */
 	  if (t) while ((*t == ' ') || (*t == '\t')) t++;
 				/* parse date from Date: header */
-	  if (!(t && mail_parse_date (&telt,t) && 
-		(s->date = mail_longdate (&telt)))) {
+	  if (!(t && (env ? (mail_parse_sentdate (elt,t) &&
+			     (s->date = elt->sentdate)) :
+		      (mail_parse_date (&telt,t) &&
+		       (s->date = mail_longdate (&telt)))))) {
 				/* failed, use internal date */
 	    if (!(s->date = s->arrival)) {
 				/* internal date unknown but can get? */
@@ -4595,7 +4937,7 @@ THREADNODE *mail_thread_orderedsubject (MAILSTREAM *stream,char *charset,
 				/* load threadnode cache */
       for (j = 0, cur = thr; cur; cur = cur->branch) tc[j++] = cur;
       if (i != j) fatal ("Threadnode cache confusion");
-      qsort ((void *) tc,i,sizeof (THREADNODE *),mail_thread_compare_date);
+      mail_thread_sort_date (tc,i);
       for (j = 0, --i; j < i; j++) tc[j]->branch = tc[j+1];
       tc[j]->branch = NIL;	/* end of root */
       thr = tc[0];		/* head of data */
@@ -4639,19 +4981,19 @@ THREADNODE *mail_thread_orderedsubject (MAILSTREAM *stream,char *charset,
 THREADNODE *mail_thread_references (MAILSTREAM *stream,char *charset,
 				    SEARCHPGM *spg,long flags,sorter_t sorter)
 {
-  MESSAGECACHE *elt, telt;
+  MESSAGECACHE *elt;
   ENVELOPE *env;
   SORTCACHE *s;
   STRINGLIST *st;
   HASHENT *he;
-  THREADNODE **tc,*cur,*lst,*nxt,*sis,*msg;
+  THREADNODE **tc,*cur,*lst,*nxt,*msg;
   container_t con,nxc,prc,sib;
   void **sub;
   char *t,tmp[MAILTMPLEN];
-  unsigned long j,nmsgs;
+  unsigned long j,n,nmsgs;
   unsigned long i = stream->nmsgs * sizeof (SORTCACHE *);
   SORTCACHE **sc = (SORTCACHE **) memset (fs_get ((size_t) i),0,(size_t) i);
-  HASHTAB *ht = hash_create (REFHASHSIZE);
+  HASHTAB *ht;
   THREADNODE *root = NIL;
   if (spg) {			/* only if a search needs to be done */
     int silent = stream->silent;
@@ -4665,6 +5007,8 @@ THREADNODE *mail_thread_references (MAILSTREAM *stream,char *charset,
   for (i = 1, nmsgs = 0; i <= stream->nmsgs; ++i)
     if (mail_elt (stream,i)->searched)
       (sc[nmsgs++] = (SORTCACHE *)(*mailcache)(stream,i,CH_SORTCACHE))->num =i;
+				/* size id table for the messages */
+  ht = hash_create (max (REFHASHSIZE,nmsgs | 1));
 	/* separate pass so can do overview fetch lookahead */
   for (i = 0; i < nmsgs; ++i) {	/* for each requested message */
 				/* is anything missing in its SORTCACHE? */
@@ -4683,8 +5027,9 @@ THREADNODE *mail_thread_references (MAILSTREAM *stream,char *charset,
       if (!s->date || !s->subject || !s->message_id || !s->references) {
 				/* try to load data from envelope */
 	if (env = mail_fetch_structure (stream,s->num,NIL,NIL)) {
-	  if (!s->date && env->date && mail_parse_date (&telt,env->date))
-	    s->date = mail_longdate (&telt);
+	  if (!s->date && env->date &&
+	      mail_parse_sentdate (mail_elt (stream,s->num),env->date))
+	    s->date = mail_elt (stream,s->num)->sentdate;
 	  if (!s->subject && env->subject)
 	    s->refwd =
 	      mail_strip_subject (s->original_subject = cpystr (env->subject),
@@ -4790,87 +5135,72 @@ THREADNODE *mail_thread_references (MAILSTREAM *stream,char *charset,
 				/* make buffer for sorting */
   tc = (THREADNODE **) fs_get (nmsgs * sizeof (THREADNODE *));
 				/* load threadcache and count nodes to sort */
-  for (i = 0, cur = root; cur ; cur = cur->branch) tc[i++] = cur;
-  if (i > 1) {			/* only if need to sort */
-    qsort ((void *) tc,i,sizeof (THREADNODE *),mail_thread_compare_date);
-				/* relink siblings */
-    for (j = 0, --i; j < i; j++) tc[j]->branch = tc[j+1];
-    tc[j]->branch = NIL;	/* end of root */
-    root = tc[0];		/* establish new root */
-  }
+  for (n = 0, cur = root; cur ; cur = cur->branch) tc[n++] = cur;
+				/* only if need to sort */
+  if (n > 1) mail_thread_sort_date (tc,n);
+  /*  The root set stays in tc while subjects are gathered, so that a node
+   * can be taken out or replaced by clearing or setting its slot rather
+   * than by hunting for its older sister.  The subject table also records
+   * each entry's slot and the youngest daughter added to it.
+   */
 			/* Step 5A */
   hash_reset (ht);		/* discard containers, reset ht */
 			/* Step 5B */
-  for (cur = root; cur; cur = cur->branch)
-    if ((t = (nxt = (cur->sc ? cur : cur->next))->sc->subject) && *t) {
-				/* add new subject to hash table */
-      if (!(sub = hash_lookup (ht,t))) hash_add (ht,t,cur,0);
+  for (i = 0; i < n; i++)
+    if ((t = (nxt = ((cur = tc[i])->sc ? cur : cur->next))->sc->subject) &&
+	*t) {			/* add new subject to hash table */
+      if (!(sub = hash_lookup (ht,t))) {
+	sub = hash_add (ht,t,cur,2)->data;
+	sub[1] = (void *) i;	/* note its slot */
+      }
 				/* if one in table not dummy and */
       else if ((s = (lst = (THREADNODE *) sub[0])->sc) &&
 				/* current dummy, or not re/fwd and table is */
-	       (!cur->sc || (!nxt->sc->refwd && s->refwd)))
+	       (!cur->sc || (!nxt->sc->refwd && s->refwd))) {
 	sub[0] = (void *) cur;	/* replace with this message */
+	sub[1] = (void *) i;
+      }
     }
-
+
 			/* Step 5C */
-  for (cur = root, sis = NIL; cur; cur = msg) {
+  for (i = 0; i < n; i++) {
 				/* do nothing if current message or no sub */
-    if (!(t = (cur->sc ? cur : cur->next)->sc->subject) || !*t ||
-	((lst = (THREADNODE *) (sub = hash_lookup (ht,t))[0]) == cur))
-      msg = (sis = cur)->branch;
-    else if (!lst->sc) {	/* is message in the table a dummy? */
-				/* find youngest daughter of msg in table */
-      for (msg = lst->next; msg->branch; msg = msg->branch);
+    if (!(cur = tc[i]) || !(t = (cur->sc ? cur : cur->next)->sc->subject) ||
+	!*t || ((lst = (THREADNODE *) (sub = hash_lookup (ht,t))[0]) == cur))
+      continue;
+    tc[i] = NIL;		/* current leaves the root set */
+    cur->branch = NIL;		/* lose our younger sisters */
+    if (!lst->sc) {		/* is message in the table a dummy? */
       if (!cur->sc) {		/* current message a dummy? */
-	msg->branch = cur->next;/* current's daughter now dummy's youngest */
-	msg = cur->branch;	/* continue scan at younger sister */
+				/* current's daughters now dummy's youngest */
+	mail_thread_adopt (lst,sub,cur->next);
 				/* now delete this node */
 	cur->branch = cur->next = NIL;
 	mail_free_threadnode (&cur);
       }
-      else {			/* current message not a dummy */
-	msg->branch = cur;	/* append as youngest daughter */
-	msg = cur->branch;	/* continue scan at younger sister */
-	cur->branch = NIL;	/* lose our younger sisters */
-      }
+				/* append as youngest daughter */
+      else mail_thread_adopt (lst,sub,cur);
     }
-    else {			/* no dummies, is current re/fwd, table not? */
-      if (cur->sc->refwd && !lst->sc->refwd) {
-	if (lst->next) {	/* find youngest daughter of msg in table */
-	  for (msg = lst->next; msg->branch; msg = msg->branch);
-	  msg->branch = cur;	/* append as youngest daughter */
-	}
-	else lst->next = cur;	/* no children, so make the eldest daughter */
-      }
-
-      else {			/* no re/fwd, create a new dummy */
-	msg = mail_newthreadnode (NIL);
-	if (lst == root) {	/* msg in table is root? */
-	  root = lst->branch;	/* younger sister becomes new root */
-				/* no longer older sister either */
-	  if (lst == sis) sis = NIL;
-	}
-	else {			/* find older sister of msg in table */
-	  for (nxt = root; lst != nxt->branch; nxt = nxt->branch);
-				/* remove from older sister */
-	  nxt->branch = lst->branch;
-	}
-	msg->next = lst;	/* msg in table becomes child */
-	lst->branch = cur;	/* current now little sister of msg in table */
-	if (sis) {		/* have an elder sister? */
-	  if (sis == lst)	/* rescan if lost her */
-	    for (sis = root; cur != sis->branch; sis = sis->branch);
-	  sis->branch = msg;	/* make dummy younger sister of big sister */
-	}
-	else root = msg;	/* otherwise this is the new root */
-	sub[0] = sis = msg;	/* set new msg in table and new big sister */
-      }
-      msg = cur->branch;	/* continue scan at younger sister */
-      cur->branch = NIL;	/* lose our younger sisters */
+				/* current is re/fwd, table not? */
+    else if (cur->sc->refwd && !lst->sc->refwd)
+      mail_thread_adopt (lst,sub,cur);
+    else {			/* no re/fwd, create a new dummy */
+      msg = mail_newthreadnode (NIL);
+				/* msg in table leaves its slot */
+      tc[(unsigned long) sub[1]] = NIL;
+      msg->next = lst;		/* msg in table becomes child */
+      lst->branch = cur;	/* current now little sister of msg in table */
+      sub[0] = (void *) (tc[i] = msg);
+      sub[1] = (void *) i;	/* dummy takes current's slot */
+      sub[2] = (void *) cur;	/* and current is its youngest */
     }
-    if (sis) sis->branch = msg;	/* older sister gets this as younger sister */
-    else root = msg;		/* otherwise this is the new root */
   }
+				/* relink what is left of the root set */
+  for (i = 0, root = cur = NIL; i < n; i++) if (tc[i]) {
+    if (cur) cur = cur->branch = tc[i];
+    else root = cur = tc[i];
+  }
+  if (cur) cur->branch = NIL;	/* end of root */
   hash_destroy (&ht);		/* finished with hash table */
 			/* Step 6 */
 				/* sort threads */
@@ -4965,57 +5295,78 @@ STRINGLIST *mail_thread_parse_references (char *s,long flag)
  *	    older sibling of container, if any
  * Returns: container in this position, possibly pruned
  * All children and younger siblings are also pruned
+ *
+ * Below the root set a dummy is simply replaced by its children, so each
+ * container's children are flattened in place, and containers still to be
+ * done are kept on a stack rather than recursed into, since reply chains
+ * in a large archive can be very deep.
  */
 
 container_t mail_thread_prune_dummy (container_t msg,container_t ane)
 {
-				/* prune container and children */
-  container_t ret = msg ? mail_thread_prune_dummy_work (msg,ane) : NIL;
-				/* prune all younger sisters */
-  if (ret) for (ane = ret; ane && (msg = SIBLING (ane)); ane = msg)
-    msg = mail_thread_prune_dummy_work (msg,ane);
+  container_t cur,nxt,ret = NIL;
+  unsigned long i = 0;
+  unsigned long size = 64;
+  container_t *stack = (container_t *) fs_get (size * sizeof (container_t));
+  for (; msg; msg = nxt) {	/* for each container in the root set */
+    mail_thread_flatten (msg);	/* children now all have messages */
+    nxt = SIBLING (msg);	/* get younger sister */
+    if (!CACHE (msg)) {		/* dummy? */
+      if (!(cur = CHILD (msg))) continue;
+				/* promote only child to the root set */
+      if (!SIBLING (cur)) {
+	msg = cur;
+	SETPARENT (msg,NIL);
+	mail_thread_flatten (msg);
+      }
+    }
+    if (ane) SETSIBLING (ane,msg);
+    else ret = msg;		/* first container in this position */
+    ane = msg;			/* this is now the older sister */
+    SETSIBLING (ane,nxt);
+				/* stack it for its descendants */
+    if (i == size) fs_resize ((void **) &stack,
+			      (size *= 2) * sizeof (container_t));
+    stack[i++] = msg;
+  }
+  if (ane) SETSIBLING (ane,NIL);/* end of the root set */
+  while (i) {			/* flatten all the descendants */
+    for (cur = CHILD (stack[--i]); cur; cur = SIBLING (cur)) {
+      mail_thread_flatten (cur);
+      if (i == size) fs_resize ((void **) &stack,
+				(size *= 2) * sizeof (container_t));
+      stack[i++] = cur;
+    }
+  }
+  fs_give ((void **) &stack);
   return ret;
 }
 
 
-/* Prune dummy messages worker routine
- * Accepts: candidate container to prune
- *	    older sibling of container, if any
- * Returns: container in this position, possibly pruned
- * All children are also pruned
+/* Replace dummy children by their own children
+ * Accepts: container whose children are to be flattened
  */
 
-container_t mail_thread_prune_dummy_work (container_t msg,container_t ane)
+void mail_thread_flatten (container_t msg)
 {
-  container_t cur;
-				/* get children, if any */
-  container_t nxt = mail_thread_prune_dummy (CHILD (msg),NIL);
-				/* just update children if container has msg */
-  if (CACHE (msg)) SETCHILD (msg,nxt);
-  else if (!nxt) {		/* delete dummy with no children */
-    nxt = SIBLING (msg);	/* get younger sister */
-    if (ane) SETSIBLING (ane,nxt);
-				/* prune younger sister if exists */
-    msg = nxt ? mail_thread_prune_dummy_work (nxt,ane) : NIL;
-  }
-				/* not if parent root & multiple children */
-  else if ((cur = PARENT (msg)) || !SIBLING (nxt)) {
-				/* OK to promote, try younger sister of aunt */
-    if (ane) SETSIBLING (ane,nxt);
-				/* otherwise promote to child of grandmother */
-    else if (cur) SETCHILD (cur,nxt);
-    SETPARENT (nxt,cur);	/* set parent as well */
-				/* look for end of siblings in new container */
-    for (cur = nxt; SIBLING (cur); cur = SIBLING (cur));
+  container_t cur,nxt,dmy;
+  container_t prv = NIL;
+  for (cur = CHILD (msg); cur; cur = nxt)
+    if (CACHE (cur)) nxt = SIBLING (prv = cur);
+    else if (nxt = CHILD (dmy = cur)) {
+				/* splice dummy's children in its place */
+      if (prv) SETSIBLING (prv,nxt);
+      else SETCHILD (msg,nxt);
+				/* reparent them, find youngest */
+      for (cur = nxt; SETPARENT (cur,msg), SIBLING (cur); cur = SIBLING (cur));
 				/* reattach deleted container's siblings */
-    SETSIBLING (cur,SIBLING (msg));
-				/* prune and return new container */
-    msg = mail_thread_prune_dummy_work (nxt,ane);
-  }
-  else SETCHILD (msg,nxt);	/* in case child pruned */
-  return msg;			/* return this message */
+      SETSIBLING (cur,SIBLING (dmy));
+    }
+				/* delete dummy with no children */
+    else if (prv) SETSIBLING (prv,nxt = SIBLING (cur));
+    else SETCHILD (msg,nxt = SIBLING (cur));
 }
-
+
 /* Test that purported mother is not a child of purported daughter
  * Accepts: mother
  *	    purported daugher
@@ -5024,11 +5375,8 @@ container_t mail_thread_prune_dummy_work (container_t msg,container_t ane)
 
 long mail_thread_check_child (container_t mother,container_t daughter)
 {
-  if (mother) {			/* only if mother non-NIL */
-    if (mother == daughter) return T;
-    for (daughter = CHILD (daughter); daughter; daughter = SIBLING (daughter))
-      if (mail_thread_check_child (mother,daughter)) return T;
-  }
+				/* look for daughter among mother's ancestors */
+  for (; mother; mother = PARENT (mother)) if (mother == daughter) return T;
   return NIL;
 }
 
@@ -5059,6 +5407,27 @@ THREADNODE *mail_thread_c2node (MAILSTREAM *stream,container_t con,long flags)
   return ret;
 }
 
+/* Append daughters to thread node
+ * Accepts: mother
+ *	    mother's subject table entry
+ *	    eldest daughter to append, with her younger sisters
+ */
+
+void mail_thread_adopt (THREADNODE *mother,void **sub,THREADNODE *daughter)
+{
+  THREADNODE *cur;
+				/* after youngest daughter if known */
+  if (cur = (THREADNODE *) sub[2]) cur->branch = daughter;
+  else if (cur = mother->next) {/* else must find youngest daughter */
+    while (cur->branch) cur = cur->branch;
+    cur->branch = daughter;
+  }
+  else mother->next = daughter;	/* no daughters yet */
+				/* remember new youngest daughter */
+  for (cur = daughter; cur->branch; cur = cur->branch);
+  sub[2] = (void *) cur;
+}
+
 /* Sort thread tree by date
  * Accepts: thread tree to sort
  *	    qsort vector to sort
@@ -5076,7 +5445,7 @@ THREADNODE *mail_thread_sort (THREADNODE *thr,THREADNODE **tc)
 				/* load threadcache and count nodes to sort */
   for (i = 0, cur = thr; cur; cur = cur->branch) tc[i++] = cur;
   if (i > 1) {			/* only if need to sort */
-    qsort ((void *) tc,i,sizeof (THREADNODE *),mail_thread_compare_date);
+    mail_thread_sort_date (tc,i);
 				/* relink root siblings */
     for (j = 0, --i; j < i; j++) tc[j]->branch = tc[j+1];
     tc[j]->branch = NIL;	/* end of root */
@@ -5085,6 +5454,60 @@ THREADNODE *mail_thread_sort (THREADNODE *thr,THREADNODE **tc)
 }
 
 
+/* Sort thread nodes by date
+ * Accepts: vector of thread nodes
+ *	    number of nodes in vector
+ *
+ * Short vectors are handed to qsort().  Long ones, such as the root set of
+ * a large archive, get a stable radix sort on the date, a byte at a time,
+ * skipping any byte which is the same in every date.
+ */
+
+#define THREADRADIXMIN 256
+
+void mail_thread_sort_date (THREADNODE **tc,unsigned long n)
+{
+  unsigned long i,j,k,var,all;
+  unsigned long cnt[256];
+  unsigned long *key,*kd,*kt;
+  THREADNODE **src,**dst,**tmp;
+  int shift;
+  if (n < THREADRADIXMIN)
+    qsort ((void *) tc,n,sizeof (THREADNODE *),mail_thread_compare_date);
+  else {
+    key = (unsigned long *) fs_get (2 * n * sizeof (unsigned long));
+    tmp = (THREADNODE **) fs_get (n * sizeof (THREADNODE *));
+				/* load keys, note which bits vary */
+    for (i = var = 0, all = ~0; i < n; i++) {
+      var |= key[i] = (tc[i]->sc ? tc[i]->sc : tc[i]->next->sc)->date;
+      all &= key[i];
+    }
+    var ^= all;
+    for (src = tc, dst = tmp, kd = key + n, kt = key, shift = 0;
+	 shift < (int) (sizeof (unsigned long) * 8); shift += 8)
+      if ((var >> shift) & 0xff) {
+	memset (cnt,0,sizeof (cnt));
+	for (i = 0; i < n; i++) cnt[(kt[i] >> shift) & 0xff]++;
+	for (i = j = 0; i < 256; i++) {
+	  k = cnt[i];		/* convert counts to offsets */
+	  cnt[i] = j;
+	  j += k;
+	}
+	for (i = 0; i < n; i++) {
+	  kd[k = cnt[(kt[i] >> shift) & 0xff]++] = kt[i];
+	  dst[k] = src[i];
+	}
+				/* swap buffers */
+	if (src == tc) src = tmp, dst = tc, kd = key, kt = key + n;
+	else src = tc, dst = tmp, kd = key + n, kt = key;
+      }
+    if (src != tc) memcpy (tc,src,n * sizeof (THREADNODE *));
+    fs_give ((void **) &tmp);
+    fs_give ((void **) &key);
+  }
+}
+
+
 /* Thread compare date
  * Accept: first message sort cache element
  *	   second message sort cache element
@@ -5324,7 +5747,8 @@ MESSAGECACHE *mail_new_cache_elt (unsigned long msgno)
 
 ENVELOPE *mail_newenvelope (void)
 {
-  return (ENVELOPE *) memset (fs_get (sizeof (ENVELOPE)),0,sizeof (ENVELOPE));
+  return (ENVELOPE *) memset (mail_arena_get (sizeof (ENVELOPE)),0,
+			      sizeof (ENVELOPE));
 }
 
 
@@ -5334,7 +5758,8 @@ ENVELOPE *mail_newenvelope (void)
 
 ADDRESS *mail_newaddr (void)
 {
-  return (ADDRESS *) memset (fs_get (sizeof (ADDRESS)),0,sizeof (ADDRESS));
+  return (ADDRESS *) memset (mail_arena_get (sizeof (ADDRESS)),0,
+			     sizeof (ADDRESS));
 }
 
 /* Mail instantiate body
@@ -5343,7 +5768,7 @@ ADDRESS *mail_newaddr (void)
 
 BODY *mail_newbody (void)
 {
-  return mail_initbody ((BODY *) fs_get (sizeof (BODY)));
+  return mail_initbody ((BODY *) mail_arena_get (sizeof (BODY)));
 }
 
 
@@ -5367,7 +5792,8 @@ BODY *mail_initbody (BODY *body)
 
 PARAMETER *mail_newbody_parameter (void)
 {
-  return (PARAMETER *) memset (fs_get (sizeof(PARAMETER)),0,sizeof(PARAMETER));
+  return (PARAMETER *) memset (mail_arena_get (sizeof (PARAMETER)),0,
+			       sizeof (PARAMETER));
 }
 
 
@@ -5377,7 +5803,8 @@ PARAMETER *mail_newbody_parameter (void)
 
 PART *mail_newbody_part (void)
 {
-  PART *part = (PART *) memset (fs_get (sizeof (PART)),0,sizeof (PART));
+  PART *part = (PART *) memset (mail_arena_get (sizeof (PART)),0,
+				sizeof (PART));
   mail_initbody (&part->body);	/* initialize the body */
   return part;
 }
@@ -5389,7 +5816,8 @@ PART *mail_newbody_part (void)
 
 MESSAGE *mail_newmsg (void)
 {
-  return (MESSAGE *) memset (fs_get (sizeof (MESSAGE)),0,sizeof (MESSAGE));
+  return (MESSAGE *) memset (mail_arena_get (sizeof (MESSAGE)),0,
+			     sizeof (MESSAGE));
 }
 
 /* Mail instantiate string list
@@ -5398,10 +5826,105 @@ MESSAGE *mail_newmsg (void)
 
 STRINGLIST *mail_newstringlist (void)
 {
-  return (STRINGLIST *) memset (fs_get (sizeof (STRINGLIST)),0,
+  return (STRINGLIST *) memset (mail_arena_get (sizeof (STRINGLIST)),0,
 				sizeof (STRINGLIST));
 }
 
+/* Mail parse arena routines
+ *
+ * An envelope and body structure parsed between mail_arena_open() and
+ * mail_arena_close() are carved from one arena by the instantiation
+ * routines above, along with all their strings, so that freeing them
+ * is a single operation rather than a walk over every small block.
+ */
+
+#define ARENAALIGN(n) (((n) + sizeof (double) - 1) & ~(sizeof (double) - 1))
+#define ARENADATA(a) ((char *) (a) + ARENAALIGN (sizeof (MAILARENA)))
+
+
+/* Mail open parse arena
+ * Accepts: expected size of parsed data
+ * Returns: new arena if arena parsing is in effect, else NIL
+ *
+ * No arena is used if one is already open, as for an encapsulated
+ * message, or if the main program may hang its own data from the parsed
+ * structures.
+ */
+
+MAILARENA *mail_arena_open (unsigned long size)
+{
+  if (!mailparsearena || mailarena || mailparseline ||
+      mailfreeenvelopesparep || mailfreebodysparep) return NIL;
+  size = ARENAALIGN (max (size,MAILARENASIZE));
+  mailarena = (MAILARENA *)
+    fs_get (ARENAALIGN (sizeof (MAILARENA)) + size);
+  mailarena->next = NIL;
+  mailarena->refs = 0;
+  mailarena->size = size;
+  mailarena->used = 0;
+  return mailarena;
+}
+
+
+/* Mail close parse arena
+ */
+
+void mail_arena_close (void)
+{
+  mailarena = NIL;		/* back to free storage */
+}
+
+/* Mail get storage for parsed data
+ * Accepts: size of desired block
+ * Returns: block from open arena, else free storage block
+ */
+
+void *mail_arena_get (unsigned long size)
+{
+  MAILARENA *a;
+  void *ret;
+  if (!mailarena) return fs_get (size);
+  size = ARENAALIGN (size ? size : 1);
+				/* newest block is after the first */
+  if (!(a = mailarena->next)) a = mailarena;
+  if ((a->size - a->used) < size) {
+    a = (MAILARENA *) fs_get (ARENAALIGN (sizeof (MAILARENA)) +
+			      max (size,MAILARENASIZE));
+    a->size = max (size,MAILARENASIZE);
+    a->refs = a->used = 0;
+    a->next = mailarena->next;	/* link in as the newest block */
+    mailarena->next = a;
+  }
+  ret = (void *) (ARENADATA (a) + a->used);
+  a->used += size;
+  return ret;
+}
+
+
+/* Mail copy string to storage for parsed data
+ * Accepts: string
+ * Returns: copy of string
+ */
+
+char *mail_arena_cpystr (const char *string)
+{
+  return string ?
+    strcpy ((char *) mail_arena_get (1 + strlen (string)),string) : NIL;
+}
+
+
+/* Mail return storage for parsed data
+ * Accepts: ** pointer to block from mail_arena_get()
+ *
+ * Arena storage is only reclaimed with the whole arena.
+ */
+
+void mail_arena_give (void **block)
+{
+  if (mailarena) *block = NIL;
+  else fs_give (block);
+}
+
 
 /* Mail instantiate new search program
  * Returns: new search program
@@ -5519,7 +6042,13 @@ QUOTALIST *mail_newquotalist (void)
 
 void mail_free_body (BODY **body)
 {
-  if (*body) {			/* only free if exists */
+  MAILARENA *arena;
+  if (*body && (arena = (*body)->arena)) {
+    mail_gc_body (*body);	/* free any texts cached since parse */
+    *body = NIL;		/* body goes with its arena */
+    mail_free_arena (&arena);
+  }
+  else if (*body) {		/* only free if exists */
     mail_free_body_data (*body);/* free its data */
     fs_give ((void **) body);	/* return body to free storage */
   }
@@ -5605,6 +6134,8 @@ void mail_free_cache (MAILSTREAM *stream)
   mail_gc (stream,GC_ELT | GC_ENV | GC_TEXTS);
 				/* flush the cache */
   (*mailcache) (stream,(long) 0,CH_INIT);
+  stream->sortloaded = NIL;	/* sort keys must be loaded again */
+  mail_free_searchcache (stream);
 }
 
 
@@ -5630,7 +6161,12 @@ void mail_free_elt (MESSAGECACHE **elt)
 
 void mail_free_envelope (ENVELOPE **env)
 {
-  if (*env) {			/* only free if exists */
+  MAILARENA *arena;
+  if (*env && (arena = (*env)->arena)) {
+    *env = NIL;			/* envelope goes with its arena */
+    mail_free_arena (&arena);
+  }
+  else if (*env) {		/* only free if exists */
     if ((*env)->remail) fs_give ((void **) &(*env)->remail);
     mail_free_address (&(*env)->return_path);
     if ((*env)->date) fs_give ((void **) &(*env)->date);
@@ -5689,6 +6225,58 @@ void mail_free_stringlist (STRINGLIST **string)
     fs_give ((void **) string);	/* return string to free storage */
   }
 }
+
+
+/* Mail garbage collect parse arena
+ * Accepts: pointer to arena pointer
+ *
+ * The arena is freed when its last reference goes away.
+ */
+
+void mail_free_arena (MAILARENA **arena)
+{
+  MAILARENA *a;
+  if (*arena && !--(*arena)->refs) while (a = *arena) {
+    *arena = a->next;		/* free each block */
+    fs_give ((void **) &a);
+  }
+  *arena = NIL;
+}
+
+
+/* Mail garbage collect compiled search matchers
+ * Accepts: MAIL stream
+ */
+
+void mail_free_matchers (MAILSTREAM *stream)
+{
+  SEARCHMATCHER *m;
+  while (m = stream->private.search.matchers) {
+    stream->private.search.matchers = m->next;
+    search_free (&m);
+  }
+  stream->private.search.matcher = NIL;
+}
+
+
+/* Mail garbage collect search text cache
+ * Accepts: MAIL stream
+ */
+
+void mail_free_searchcache (MAILSTREAM *stream)
+{
+  SEARCHCACHEENT *e;
+  SEARCHCACHE *c = stream->private.search.cache;
+  if (c) {			/* only free if exists */
+    while (e = c->oldest) {
+      c->oldest = e->newer;
+      fs_give ((void **) &e->section);
+      fs_give ((void **) &e->text.data);
+      fs_give ((void **) &e);
+    }
+    fs_give ((void **) &stream->private.search.cache);
+  }
+}
 
 /* Mail garbage collect searchpgm
  * Accepts: pointer to searchpgm pointer
@@ -121,6 +121,10 @@
 #define SET_FREESTREAMSPAREP (long) 152
 #define GET_FREEBODYSPAREP (long) 153
 #define SET_FREEBODYSPAREP (long) 154
+#define GET_SEARCHCACHE (long) 155
+#define SET_SEARCHCACHE (long) 156
+#define GET_PARSEARENA (long) 157
+#define SET_PARSEARENA (long) 158
 
 	/* 2xx: environment */
 #define GET_USERNAME (long) 201
@@ -241,6 +245,10 @@
 #define SET_SENDCOMMAND (long) 451
 #define GET_IDLETIMEOUT (long) 452
 #define SET_IDLETIMEOUT (long) 452
+#define GET_NNTPOVERCACHE (long) 454
+#define SET_NNTPOVERCACHE (long) 455
+#define GET_POP3STATEDIR (long) 456
+#define SET_POP3STATEDIR (long) 457
 
 	/* 5xx: local file drivers */
 #define GET_MBXPROTECTION (long) 500
@@ -313,6 +321,14 @@
 #define SET_SNARFPRESERVE (long) 567
 #define GET_INBOXPATH (long) 568
 #define SET_INBOXPATH (long) 569
+#define GET_CHANGENOTIFY (long) 570
+#define SET_CHANGENOTIFY (long) 571
+#define GET_NOTIFYFD (long) 572
+#define GET_NOTIFYCHECK (long) 574
+#define GET_PREFETCHWINDOW (long) 576
+#define SET_PREFETCHWINDOW (long) 577
+#define GET_SORTCACHEDIR (long) 580
+#define SET_SORTCACHEDIR (long) 581
 
 /* Driver flags */
 
@@ -621,6 +637,24 @@ ADDRESS {
 };
 
 
+/* Parse arena
+ *
+ * When arena parsing is enabled, the envelope and body structure parsed
+ * from a message are carved from one of these, and are freed together
+ * when the last of them is freed.  The first block holds the reference
+ * count; further blocks are chained from it.
+ */
+
+#define MAILARENASIZE 2048	/* minimum arena block size */
+
+typedef struct mail_arena {
+  struct mail_arena *next;	/* next block in this arena */
+  unsigned long refs;		/* references to the arena */
+  unsigned long size;		/* size of this block's data */
+  unsigned long used;		/* amount of data used */
+} MAILARENA;
+
+
 /* Message envelope */
 
 typedef struct mail_envelope {
@@ -646,6 +680,7 @@ typedef struct mail_envelope {
     char *subtype;		/* subtype string */
     struct mail_body_parameter *parameter;	/* parameter list */
   } optional;
+  MAILARENA *arena;		/* arena holding this envelope, if any */
   void *sparep;			/* spare pointer reserved for main program */
 } ENVELOPE;
 
@@ -719,6 +754,7 @@ BODY {
     unsigned long bytes;	/* size of text in octets */
   } size;
   char *md5;			/* MD5 checksum */
+  MAILARENA *arena;		/* arena holding this body, if any */
   void *sparep;			/* spare pointer reserved for main program */
 };
 
@@ -776,6 +812,11 @@ typedef struct message_cache {
   unsigned int zoccident : 1;	/* non-zero if west of UTC */
   unsigned int zhours : 4;	/* hours from UTC (0-12) */
   unsigned int zminutes: 6;	/* minutes (0-59) */
+			/* sent date, see mail_parse_sentdate() */
+  unsigned long sentdate;	/* seconds since epoch of Date: header */
+  unsigned int sentday : 16;	/* days since BASEYEAR of Date: header */
+  unsigned int sentparsed : 1;	/* Date: header has been parsed */
+  unsigned int sentvalid : 1;	/* Date: header is a valid date */
 			/* system flags */
   unsigned int seen : 1;	/* system Seen flag */
   unsigned int deleted : 1;	/* system Deleted flag */
@@ -872,6 +913,33 @@ SEARCHPGMLIST {
   SEARCHPGM *pgm;		/* search program */
   SEARCHPGMLIST *next;		/* next in list */
 };
+
+
+/* Search text cache */
+
+#define SEARCHCACHE struct search_cache
+#define SEARCHCACHEENT struct search_cache_entry
+
+#define SEARCHCACHEHASH 4093	/* number of search cache hash buckets */
+
+
+SEARCHCACHEENT {		/* decoded searchable text */
+  SEARCHCACHEENT *next;		/* next in hash bucket */
+  SEARCHCACHEENT *older;	/* next older entry */
+  SEARCHCACHEENT *newer;	/* next newer entry */
+  unsigned long uid;		/* message UID */
+  char *section;		/* section specifier */
+  SIZEDTEXT text;		/* UTF-8 text */
+};
+
+
+SEARCHCACHE {
+  unsigned long uid_validity;	/* UID validity of cached texts */
+  unsigned long size;		/* total size of cached texts */
+  SEARCHCACHEENT *newest;	/* most recently used entry */
+  SEARCHCACHEENT *oldest;	/* least recently used entry */
+  SEARCHCACHEENT *hash[SEARCHCACHEHASH];
+};
 
 SEARCHPGM {			/* search program */
   SEARCHSET *msgno;		/* message numbers */
@@ -1032,6 +1100,7 @@ typedef struct mail_stream {
   unsigned int kwd_create : 1;	/* can create new keywords */
   unsigned int uid_nosticky : 1;/* UIDs are not preserved */
   unsigned int unhealthy : 1;	/* unhealthy protocol negotiations */
+  unsigned int sortloaded : 1;	/* persistent sort keys loaded */
   unsigned long perm_user_flags;/* mask of permanent user flags */
   unsigned long gensym;		/* generated tag */
   unsigned long nmsgs;		/* # of associated msgs */
@@ -1056,6 +1125,12 @@ typedef struct mail_stream {
       STRINGLIST *string;	/* string(s) to search */
       long result;		/* search result */
       char *text;		/* cache of fetched text */
+				/* compiled matcher for string(s) */
+      struct search_matcher *matcher;
+				/* matchers compiled for this search */
+      struct search_matcher *matchers;
+      unsigned long uid;	/* UID of message to cache texts of */
+      struct search_cache *cache;/* cache of decoded texts */
     } search;
   } private;
 			/* reserved for use by main program */
@@ -1600,6 +1675,9 @@ BODY *mail_body (MAILSTREAM *stream,unsigned long msgno,
 char *mail_date (char *string,MESSAGECACHE *elt);
 char *mail_cdate (char *string,MESSAGECACHE *elt);
 long mail_parse_date (MESSAGECACHE *elt,unsigned char *string);
+long mail_parse_date_fast (MESSAGECACHE *elt,unsigned char *s);
+long mail_parse_date_work (MESSAGECACHE *elt,unsigned char *s,long *local);
+long mail_parse_sentdate (MESSAGECACHE *elt,char *date);
 void mail_exists (MAILSTREAM *stream,unsigned long nmsgs);
 void mail_recent (MAILSTREAM *stream,unsigned long recent);
 void mail_expunged (MAILSTREAM *stream,unsigned long msgno);
@@ -1620,6 +1698,14 @@ long mail_search_text (MAILSTREAM *stream,unsigned long msgno,char *section,
 long mail_search_body (MAILSTREAM *stream,unsigned long msgno,BODY *body,
 		       char *prefix,unsigned long section,long flags);
 long mail_search_string (SIZEDTEXT *s,char *charset,STRINGLIST **st);
+long mail_search_pending (MAILSTREAM *stream,char *key,SIZEDTEXT *s,
+			  char *charset);
+long mail_search_cached (MAILSTREAM *stream,char *key,long *ret);
+SEARCHCACHEENT *mail_search_cache_lookup (MAILSTREAM *stream,char *key);
+unsigned long mail_search_cache_hash (unsigned long uid,char *key);
+void mail_search_cache_add (MAILSTREAM *stream,char *key,SIZEDTEXT *text);
+struct search_matcher *mail_search_matcher (MAILSTREAM *stream,
+					    STRINGLIST *st);
 long mail_search_keyword (MAILSTREAM *stream,MESSAGECACHE *elt,STRINGLIST *st,
 			  long flag);
 long mail_search_addr (ADDRESS *adr,STRINGLIST *st);
@@ -1658,9 +1744,11 @@ char *mail_thread_parse_msgid (char *s,char **ss);
 STRINGLIST *mail_thread_parse_references (char *s,long flag);
 long mail_thread_check_child (container_t mother,container_t daughter);
 container_t mail_thread_prune_dummy (container_t msg,container_t ane);
-container_t mail_thread_prune_dummy_work (container_t msg,container_t ane);
+void mail_thread_flatten (container_t msg);
 THREADNODE *mail_thread_c2node (MAILSTREAM *stream,container_t con,long flags);
+void mail_thread_adopt (THREADNODE *mother,void **sub,THREADNODE *daughter);
 THREADNODE *mail_thread_sort (THREADNODE *thr,THREADNODE **tc);
+void mail_thread_sort_date (THREADNODE **tc,unsigned long n);
 int mail_thread_compare_date (const void *a1,const void *a2);
 long mail_sequence (MAILSTREAM *stream,unsigned char *sequence);
 long mail_uid_sequence (MAILSTREAM *stream,unsigned char *sequence);
@@ -1676,6 +1764,11 @@ PARAMETER *mail_newbody_parameter (void);
 PART *mail_newbody_part (void);
 MESSAGE *mail_newmsg (void);
 STRINGLIST *mail_newstringlist (void);
+MAILARENA *mail_arena_open (unsigned long size);
+void mail_arena_close (void);
+void *mail_arena_get (unsigned long size);
+char *mail_arena_cpystr (const char *string);
+void mail_arena_give (void **block);
 SEARCHPGM *mail_newsearchpgm (void);
 SEARCHHEADER *mail_newsearchheader (char *line,char *text);
 SEARCHSET *mail_newsearchset (void);
@@ -1694,7 +1787,10 @@ void mail_free_elt (MESSAGECACHE **elt);
 void mail_free_envelope (ENVELOPE **env);
 void mail_free_address (ADDRESS **address);
 void mail_free_stringlist (STRINGLIST **string);
+void mail_free_arena (MAILARENA **arena);
 void mail_free_searchpgm (SEARCHPGM **pgm);
+void mail_free_matchers (MAILSTREAM *stream);
+void mail_free_searchcache (MAILSTREAM *stream);
 void mail_free_searchheader (SEARCHHEADER **hdr);
 void mail_free_searchset (SEARCHSET **set);
 void mail_free_searchor (SEARCHOR **orl);
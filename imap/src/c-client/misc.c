@@ -243,6 +243,129 @@ long search (unsigned char *base,long basec,unsigned char *pat,long patc)
   return NIL;			/* pattern not found */
 }
 
+/* Compile multiple pattern search matcher
+ * Accepts: string list of patterns
+ * Returns: matcher, with all patterns pending
+ *
+ * The matcher uses a Wu-Manber style shift table, indexed by the last two
+ * bytes of a window as long as the shortest pattern, so that any number of
+ * patterns are searched for in a single pass which skips most of the text.
+ * Short patterns skip too little for that to pay, so they, and a lone
+ * pending pattern, are searched for with search() instead.  Like search(),
+ * matching is case-insensitive for ASCII characters.
+ */
+
+SEARCHMATCHER *search_compile (STRINGLIST *st)
+{
+  unsigned long i,j,n;
+  STRINGLIST *s;
+  SEARCHMATCHER *m = (SEARCHMATCHER *) memset (fs_get (sizeof (SEARCHMATCHER)),
+					       0,sizeof (SEARCHMATCHER));
+  for (i = 0; i < 256; i++)	/* ASCII letters match either case */
+    m->fold[i] = ((i >= 'A') && (i <= 'Z')) ? i + 'a' - 'A' : i;
+  for (s = st; s; s = s->next) m->npat++;
+  m->pat = (SIZEDTEXT *) fs_get (m->npat * sizeof (SIZEDTEXT));
+  m->bigram = (unsigned int *) fs_get (m->npat * sizeof (int));
+  m->found = (char *) fs_get (m->npat);
+				/* copy folded patterns */
+  for (s = st, n = 0; s; s = s->next, n++) {
+    m->pat[n].data = (unsigned char *) fs_get (s->text.size + 1);
+    for (i = 0; i < s->text.size; i++)
+      m->pat[n].data[i] = m->fold[s->text.data[i]];
+    m->pat[n].data[m->pat[n].size = i] = '\0';
+				/* note shortest non-empty pattern */
+    if (i && (!m->minlen || (i < m->minlen))) m->minlen = i;
+  }
+  if (m->minlen >= SEARCHMINSHIFT) {/* build shift table */
+    m->shift = (unsigned char *) fs_get (65536);
+    memset (m->shift,(int) min (m->minlen - 1,255),65536);
+    for (n = 0; n < m->npat; n++) if (m->pat[n].size) {
+      for (j = 0; j < m->minlen - 1; j++) {
+	i = (m->pat[n].data[j] << 8) + m->pat[n].data[j + 1];
+	if ((m->minlen - 2 - j) < m->shift[i]) m->shift[i] = m->minlen - 2 - j;
+      }
+      m->bigram[n] = i;		/* bigram ending the window */
+    }
+  }
+  search_reset (m);		/* all patterns pending */
+  return m;
+}
+
+/* Reset multiple pattern search matcher
+ * Accepts: matcher
+ */
+
+void search_reset (SEARCHMATCHER *m)
+{
+  memset (m->found,0,m->npat);
+  m->pending = m->npat;
+}
+
+
+/* Search for pending patterns of a multiple pattern search matcher
+ * Accepts: matcher
+ *	    base string
+ *	    length of base string
+ * Returns: T if no patterns remain pending, else NIL
+ *
+ * Found patterns stay found until the matcher is reset, so a text which is
+ * split into several pieces may be searched one piece at a time.
+ */
+
+long search_multiple (SEARCHMATCHER *m,unsigned char *base,
+		      unsigned long basec)
+{
+  unsigned long i,j,k,n;
+  unsigned char *s,*p;
+  unsigned char *fold = m->fold;
+  unsigned char *shift = m->shift;
+  if (!m->pending) return T;	/* nothing left to find */
+  if (!basec) return NIL;	/* nothing in an empty base */
+  if (m->pending < 2) shift = NIL;
+  for (n = 0; n < m->npat; n++) if (!m->found[n] &&
+				     (!m->pat[n].size || !shift) &&
+				     search (base,basec,m->pat[n].data,
+					     m->pat[n].size)) {
+    m->found[n] = T;		/* found without shift table */
+    if (!--m->pending) return T;
+  }
+  if (shift) for (i = m->minlen - 1; i < basec;) {
+    k = (fold[base[i - 1]] << 8) + fold[base[i]];
+    if (j = shift[k]) i += j;	/* skip ahead if no pattern can end here */
+    else {			/* verify candidates at this window */
+      s = base + i + 1 - m->minlen;
+      for (n = 0; n < m->npat; n++)
+	if (!m->found[n] && (m->bigram[n] == k) &&
+	    (m->pat[n].size <= (base + basec - s))) {
+	  for (j = 0, p = m->pat[n].data;
+	       (j < m->pat[n].size) && (fold[s[j]] == p[j]); j++);
+	  if (j == m->pat[n].size) {
+	    m->found[n] = T;	/* found a match! */
+	    if (!--m->pending) return T;
+	  }
+	}
+      i++;
+    }
+  }
+  return NIL;
+}
+
+
+/* Free multiple pattern search matcher
+ * Accepts: pointer to matcher
+ */
+
+void search_free (SEARCHMATCHER **m)
+{
+  unsigned long n;
+  for (n = 0; n < (*m)->npat; n++) fs_give ((void **) &(*m)->pat[n].data);
+  fs_give ((void **) &(*m)->pat);
+  fs_give ((void **) &(*m)->bigram);
+  fs_give ((void **) &(*m)->found);
+  if ((*m)->shift) fs_give ((void **) &(*m)->shift);
+  fs_give ((void **) m);
+}
+
 /* Create a hash table
  * Accepts: size of new table (note: should be a prime)
  * Returns: hash table
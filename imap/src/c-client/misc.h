@@ -46,6 +46,26 @@ HASHTAB {
 };
 
 
+/* Multiple pattern search matcher */
+
+#define SEARCHMATCHER struct search_matcher
+
+#define SEARCHMINSHIFT 4	/* shortest pattern worth a shift table */
+
+SEARCHMATCHER {
+  SEARCHMATCHER *next;		/* next matcher in cache */
+  void *key;			/* cache key */
+  unsigned long npat;		/* number of patterns */
+  unsigned long pending;	/* number of patterns not yet found */
+  unsigned long minlen;		/* length of shortest non-empty pattern */
+  SIZEDTEXT *pat;		/* case-folded patterns */
+  unsigned int *bigram;		/* bigram ending each pattern's window */
+  char *found;			/* pattern found flags */
+  unsigned char *shift;		/* bigram shift table, NIL if too short */
+  unsigned char fold[256];	/* case folding table */
+};
+
+
 /* KLUDGE ALERT!!!
  *
  * Yes, write() is overridden here instead of in osdep.  This
@@ -87,6 +107,11 @@ unsigned long find_rightmost_bit (unsigned long *valptr);
 long min (long i,long j);
 long max (long i,long j);
 long search (unsigned char *base,long basec,unsigned char *pat,long patc);
+SEARCHMATCHER *search_compile (STRINGLIST *st);
+void search_reset (SEARCHMATCHER *m);
+long search_multiple (SEARCHMATCHER *m,unsigned char *base,
+		      unsigned long basec);
+void search_free (SEARCHMATCHER **m);
 HASHTAB *hash_create (size_t size);
 void hash_destroy (HASHTAB **hashtab);
 void hash_reset (HASHTAB *hashtab);
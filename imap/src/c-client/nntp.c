@@ -57,6 +57,7 @@
 #define NNTPWANTAUTH (long) 480	/* NNTP authentication needed */
 #define NNTPBADCMD (long) 500	/* NNTP unrecognized command */
 #define IDLETIMEOUT (long) 3	/* defined in NNTPEXT WG base draft */
+#define NNTPOVERMAGIC "*nntpover1"/* first word of overview cache file */
 
 
 /* NNTP I/O stream local data */
@@ -70,10 +71,13 @@ typedef struct nntp_local {
   unsigned int novalidate : 1;	/* certificate not validated */
   unsigned int xover : 1;	/* supports XOVER */
   unsigned int xhdr : 1;	/* supports XHDR */
+  unsigned int overloaded : 1;	/* overview cache file has been read */
+  unsigned int overstale : 1;	/* overview cache file needs rewriting */
   char *name;			/* remote newsgroup name */
   char *user;			/* mailbox user */
   char *newsrc;			/* newsrc file */
   char *over_fmt;		/* overview format */
+  unsigned long overhigh;	/* last article in overview cache file */
   unsigned long msgno;		/* current text message number */
   FILE *txt;			/* current text */
   unsigned long txtsize;	/* current text size */
@@ -117,6 +121,10 @@ void nntp_mclose (MAILSTREAM *stream,long options);
 void nntp_fetchfast (MAILSTREAM *stream,char *sequence,long flags);
 void nntp_flags (MAILSTREAM *stream,char *sequence,long flags);
 long nntp_overview (MAILSTREAM *stream,overview_t ofn);
+long nntp_overview_load (MAILSTREAM *stream);
+char *nntp_overcache_file (MAILSTREAM *stream,char *file,char *hdr);
+void nntp_overcache_read (MAILSTREAM *stream);
+void nntp_overcache_write (MAILSTREAM *stream,unsigned long low);
 long nntp_parse_overview (OVERVIEW *ov,char *text,MESSAGECACHE *elt);
 long nntp_over (MAILSTREAM *stream,char *sequence);
 char *nntp_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *size,
@@ -208,6 +216,7 @@ static long nntp_port = 0;
 static long nntp_sslport = 0;
 static unsigned long nntp_range = 0;
 static long nntp_hidepath = 0;
+static char *nntp_overcache = NIL;
 
 /* NNTP validate mailbox
  * Accepts: mailbox name
@@ -280,6 +289,12 @@ void *nntp_parameters (long function,void *value)
   case GET_NNTPHIDEPATH:
     value = (void *) nntp_hidepath;
     break;
+  case SET_NNTPOVERCACHE:
+    if (nntp_overcache) fs_give ((void **) &nntp_overcache);
+    if (value && *(char *) value) nntp_overcache = cpystr ((char *) value);
+  case GET_NNTPOVERCACHE:
+    value = (void *) nntp_overcache;
+    break;
   case GET_NEWSRC:
     if (value)
       value = (void *) ((NNTPLOCAL *) ((MAILSTREAM *) value)->local)->newsrc;
@@ -840,15 +855,24 @@ void nntp_fetchfast (MAILSTREAM *stream,char *sequence,long flags)
 {
   unsigned long i;
   MESSAGECACHE *elt;
+  OVERVIEW ov;
 				/* get sequence */
   if (stream && LOCAL && ((flags & FT_UID) ?
 			  mail_uid_sequence (stream,sequence) :
-			  mail_sequence (stream,sequence)))
+			  mail_sequence (stream,sequence))) {
+				/* overviews have date and size */
+    if (LOCAL->nntpstream->netstream) nntp_overview_load (stream);
     for (i = 1; i <= stream->nmsgs; i++) {
       if ((elt = mail_elt (stream,i))->sequence && (elt->valid = T) &&
 	  !(elt->day && elt->rfc822_size)) {
 	ENVELOPE **env = NIL;
 	ENVELOPE *e = NIL;
+				/* try overview first */
+	nntp_parse_overview (&ov,(char *) elt->private.data,elt);
+	if (!elt->rfc822_size) elt->rfc822_size = ov.optional.octets;
+	if (ov.from) mail_free_address (&ov.from);
+	if (ov.subject) fs_give ((void **) &ov.subject);
+	if (elt->day && elt->rfc822_size) continue;
 	if (!stream->scache) env = &elt->private.msg.env;
 	else if (stream->msgno == i) env = &stream->env;
 	else env = &e;
@@ -873,6 +897,7 @@ void nntp_fetchfast (MAILSTREAM *stream,char *sequence,long flags)
 	mail_free_envelope (&e);
       }
     }
+  }
 }
 
 /* NNTP fetch flags
@@ -897,11 +922,57 @@ void nntp_flags (MAILSTREAM *stream,char *sequence,long flags)
 
 long nntp_overview (MAILSTREAM *stream,overview_t ofn)
 {
-  unsigned long i,j,k,uid;
-  char c,*s,*t,*v,tmp[MAILTMPLEN];
+  unsigned long i,uid;
+  char *s,tmp[MAILTMPLEN];
   MESSAGECACHE *elt;
   OVERVIEW ov;
   if (!LOCAL->nntpstream->netstream) return NIL;
+  nntp_overview_load (stream);	/* load the overview cache */
+				/* now scan sequence to return overviews */
+  if (ofn) for (i = 1; i <= stream->nmsgs; i++)
+    if ((elt = mail_elt (stream,i))->sequence) {
+      uid = mail_uid (stream,i);/* UID for this message */
+				/* parse cached overview */
+      if (nntp_parse_overview (&ov,s = (char *) elt->private.data,elt))
+	(*ofn) (stream,uid,&ov,i);
+      else {			/* parse failed */
+	(*ofn) (stream,uid,NIL,i);
+	if (s && *s) {		/* unusable cached entry? */
+	  sprintf (tmp,"Unable to parse overview for UID %lu: %.500s",uid,s);
+	  mm_notify (stream,tmp,WARN);
+	  stream->unhealthy = T;
+				/* erase it from the cache */
+	  fs_give ((void **) &s);
+	}
+	stream->unhealthy = NIL;/* set healthy */
+				/* insert empty cached text as necessary */
+	if (!s) elt->private.data = (unsigned long) cpystr ("");
+      }
+				/* clean up overview data */
+      if (ov.from) mail_free_address (&ov.from);
+      if (ov.subject) fs_give ((void **) &ov.subject);
+    }
+  return T;
+}
+
+/* NNTP load overview cache
+ * Accepts: MAIL stream, sequence bits set
+ * Returns: T if successful, NIL if server can't return overviews
+ *
+ * Overviews in the overview cache file are taken from there, and only the
+ * rest are asked of the server.  Those are then added to the file.
+ */
+
+long nntp_overview_load (MAILSTREAM *stream)
+{
+  unsigned long i,j,k,uid,low = 0;
+  char c,*s,*t,*v,tmp[MAILTMPLEN];
+  MESSAGECACHE *elt;
+  long ret = LONGT;
+  if (!LOCAL->overloaded) {	/* first time, read overview cache file */
+    nntp_overcache_read (stream);
+    LOCAL->overloaded = T;
+  }
 				/* scan sequence to load cache */
   for (i = 1; i <= stream->nmsgs; i++)
 				/* have cached overview yet? */
@@ -927,6 +998,7 @@ long nntp_overview (MAILSTREAM *stream,overview_t ofn)
 	    if ((elt = mail_elt (stream,k))->private.data)
 	      fs_give ((void **) &elt->private.data);
 	    elt->private.data = (unsigned long) cpystr (t + 1);
+	    if (!low || (uid < low)) low = uid;
 	  }
 	  else {		/* shouldn't happen, snarl if it does */
 	    sprintf (tmp,"Server returned data for unknown UID %lu",uid);
@@ -940,34 +1012,146 @@ long nntp_overview (MAILSTREAM *stream,overview_t ofn)
 				/* flush the terminating dot */
 	if (s) fs_give ((void **) &s);
       }
-      else i = stream->nmsgs;	/* OVER failed, punt cache load */
+      else {			/* OVER failed, punt cache load */
+	i = stream->nmsgs;
+	ret = NIL;
+      }
     }
+				/* add new overviews to cache file */
+  if (low) nntp_overcache_write (stream,low);
+  return ret;
+}
 
-				/* now scan sequence to return overviews */
-  if (ofn) for (i = 1; i <= stream->nmsgs; i++)
-    if ((elt = mail_elt (stream,i))->sequence) {
-      uid = mail_uid (stream,i);/* UID for this message */
-				/* parse cached overview */
-      if (nntp_parse_overview (&ov,s = (char *) elt->private.data,elt))
-	(*ofn) (stream,uid,&ov,i);
-      else {			/* parse failed */
-	(*ofn) (stream,uid,NIL,i);
-	if (s && *s) {		/* unusable cached entry? */
-	  sprintf (tmp,"Unable to parse overview for UID %lu: %.500s",uid,s);
-	  mm_notify (stream,tmp,WARN);
-	  stream->unhealthy = T;
-				/* erase it from the cache */
-	  fs_give ((void **) &s);
+/* NNTP return overview cache file name
+ * Accepts: MAIL stream
+ *	    destination buffer for file name
+ *	    destination buffer for first line of file
+ * Returns: file name or NIL if no overview cache
+ */
+
+char *nntp_overcache_file (MAILSTREAM *stream,char *file,char *hdr)
+{
+  char *s,*host;
+  if (!(nntp_overcache && LOCAL->name && LOCAL->nntpstream->netstream))
+    return NIL;
+  host = net_host (LOCAL->nntpstream->netstream);
+  if ((strlen (nntp_overcache) + strlen (myhomedir ()) + strlen (host) +
+       strlen (LOCAL->name)) > (MAILTMPLEN - 32)) return NIL;
+  if (*nntp_overcache == '/') sprintf (file,"%s/",nntp_overcache);
+  else sprintf (file,"%s/%s/",myhomedir (),nntp_overcache);
+				/* one file per server and newsgroup */
+  lcase (strcpy (s = file + strlen (file),host));
+  sprintf (s + strlen (s),"-%s",LOCAL->name);
+  for (; *s; s++) if ((*s == '/') || (*s == '\\')) *s = '_';
+  sprintf (hdr,"%s %s %s\n",NNTPOVERMAGIC,host,LOCAL->name);
+  return file;
+}
+
+/* NNTP read overview cache file
+ * Accepts: MAIL stream
+ *
+ * Each line of the file after the first is an article number, a tab, and
+ * the rest of that article's overview, in increasing article order.  The
+ * file is ignored if it is for another server or newsgroup, or if it has
+ * articles past the high water mark, which means that the server has
+ * renumbered the newsgroup.
+ */
+
+void nntp_overcache_read (MAILSTREAM *stream)
+{
+  int pass;
+  unsigned long i,uid,last;
+  size_t size;
+  char *buf,*s,*t,*v,file[MAILTMPLEN],hdr[MAILTMPLEN];
+  MESSAGECACHE *elt;
+  FILE *f;
+  LOCAL->overhigh = 0;		/* nothing in file yet */
+  LOCAL->overstale = T;		/* rewrite unless it proves good */
+  if (!(nntp_overcache_file (stream,file,hdr) && (f = fopen (file,"rb"))))
+    return;
+  if (!fseek (f,0,SEEK_END) && ((size = (size_t) ftell (f)) > strlen (hdr)) &&
+      !fseek (f,0,SEEK_SET)) {
+    buf = (char *) fs_get (size + 1);
+    if ((fread (buf,(size_t) 1,size,f) == size) &&
+	!strncmp (buf,hdr,strlen (hdr))) {
+      buf[size] = '\0';		/* tie off file data */
+      LOCAL->overstale = NIL;
+				/* pass 0 validates, pass 1 loads */
+      for (pass = 0; pass < 2; pass++) {
+	for (s = buf + strlen (hdr), i = 1, last = 0;
+	     (t = strchr (s,'\n')); s = t + 1) {
+	  uid = strtoul (s,&v,10);
+	  if (!uid || (*v != '\t') || (uid <= last)) {
+	    LOCAL->overstale = T;
+	    continue;		/* bogus line, ignore it */
+	  }
+				/* renumbered newsgroup? */
+	  if ((last = uid) > stream->uid_last) break;
+	  if (pass) {		/* find this article's message */
+	    while ((i <= stream->nmsgs) && (mail_uid (stream,i) < uid)) i++;
+	    if ((i <= stream->nmsgs) && (mail_uid (stream,i) == uid)) {
+	      *t = '\0';		/* tie off overview, cache if needed */
+	      if (!(elt = mail_elt (stream,i))->private.data)
+		elt->private.data = (unsigned long) cpystr (v + 1);
+	    }
+				/* expired article */
+	    else LOCAL->overstale = T;
+	  }
 	}
-	stream->unhealthy = NIL;/* set healthy */
-				/* insert empty cached text as necessary */
-	if (!s) elt->private.data = (unsigned long) cpystr ("");
+	if (last > stream->uid_last) {
+	  LOCAL->overstale = T;	/* renumbered, ignore whole file */
+	  break;
+	}
+	LOCAL->overhigh = last;	/* last article in file */
       }
-				/* clean up overview data */
-      if (ov.from) mail_free_address (&ov.from);
-      if (ov.subject) fs_give ((void **) &ov.subject);
     }
-  return T;
+    fs_give ((void **) &buf);
+  }
+  fclose (f);
+}
+
+/* NNTP write overview cache file
+ * Accepts: MAIL stream
+ *	    lowest article whose overview was just fetched
+ *
+ * Overviews of articles past the end of the file are appended to it.
+ * Anything else rewrites the file under a temporary name, which is then
+ * renamed, so another session never reads a partial file.
+ */
+
+void nntp_overcache_write (MAILSTREAM *stream,unsigned long low)
+{
+  unsigned long i,uid,last;
+  long ok = LONGT;
+  char *s,file[MAILTMPLEN],hdr[MAILTMPLEN],tmp[MAILTMPLEN];
+  FILE *f;
+  if (!nntp_overcache_file (stream,file,hdr)) return;
+  tmp[0] = '\0';		/* append if can, else rewrite */
+  if (LOCAL->overhigh && !LOCAL->overstale && (low > LOCAL->overhigh)) {
+    if (!(f = fopen (file,"ab"))) return;
+  }
+  else {			/* leave room for the suffix */
+    if (strlen (file) > (MAILTMPLEN - 20)) return;
+    sprintf (tmp,"%s.%lx",file,(unsigned long) getpid ());
+    if (!(f = fopen (tmp,"wb"))) return;
+    ok = (fputs (hdr,f) != EOF);
+    LOCAL->overhigh = 0;	/* all overviews go in the new file */
+  }
+  for (i = 1, last = LOCAL->overhigh; ok && (i <= stream->nmsgs); i++)
+    if (((uid = mail_uid (stream,i)) > LOCAL->overhigh) &&
+	(s = (char *) mail_elt (stream,i)->private.data) && *s) {
+      ok = (fprintf (f,"%lu\t%s\n",uid,s) >= 0);
+      last = uid;
+    }
+  if ((fclose (f) == EOF) || !ok) {
+    if (*tmp) unlink (tmp);	/* failed, flush new file */
+    LOCAL->overstale = T;	/* file may be bad, rewrite next time */
+  }
+  else if (*tmp && rename (tmp,file)) unlink (tmp);
+  else {			/* file now up to date */
+    LOCAL->overhigh = last;
+    LOCAL->overstale = NIL;
+  }
 }
 
 /* Send OVER to NNTP server
@@ -1460,8 +1644,8 @@ unsigned long *nntp_sort (MAILSTREAM *stream,char *charset,SEARCHPGM *spg,
 /* Mail load sortcache
  * Accepts: mail stream, already searched
  *	    sort program
- *	    first UID to OVER
- *	    last UID to OVER
+ *	    first UID needing sortcache data, 0 if none
+ *	    last UID needing sortcache data
  *	    option flags
  * Returns: vector of sortcache pointers matching search
  */
@@ -1471,11 +1655,10 @@ SORTCACHE **nntp_sort_loadcache (MAILSTREAM *stream,SORTPGM *pgm,
 				 long flags)
 {
   unsigned long i;
-  char c,*s,*t,*v,tmp[MAILTMPLEN];
   SORTPGM *pg;
   SORTCACHE **sc,*r;
-  MESSAGECACHE telt;
-  ADDRESS *adr = NIL;
+  MESSAGECACHE *elt,telt;
+  OVERVIEW ov;
   mailcache_t mailcache = (mailcache_t) mail_parameters (NIL,GET_CACHE,NIL);
 				/* verify that the sortpgm is OK */
   for (pg = pgm; pg; pg = pg->next) switch (pg->function) {
@@ -1496,42 +1679,29 @@ SORTCACHE **nntp_sort_loadcache (MAILSTREAM *stream,SORTPGM *pgm,
   }
 
   if (start) {			/* messages need to be loaded in sortcache? */
-				/* yes, build range */
-    if (start != last) sprintf (tmp,"%lu-%lu",start,last);
-    else sprintf (tmp,"%lu",start);
-				/* get it from the NNTP server */
-    if (!nntp_over (stream,tmp)) return mail_sort_loadcache (stream,pgm);
-    while ((s = net_getline (LOCAL->nntpstream->netstream)) && strcmp (s,".")){
-				/* death to embedded newlines */
-      for (t = v = s; c = *v++;) if ((c != '\012') && (c != '\015')) *t++ = c;
-      *t++ = '\0';		/* tie off resulting string */
-				/* parse OVER response */
-      if ((i = mail_msgno (stream,atol (s))) &&
-	  (t = strchr (s,'\t')) && (v = strchr (++t,'\t'))) {
-	*v++ = '\0';		/* tie off subject */
-				/* put stripped subject in sortcache */
+				/* yes, get their overviews */
+    for (i = 1; i <= stream->nmsgs; i++) {
+      elt = mail_elt (stream,i);
+      elt->sequence = elt->searched &&
+	!((SORTCACHE *) (*mailcache) (stream,i,CH_SORTCACHE))->date;
+    }
+    if (!nntp_overview_load (stream)) return mail_sort_loadcache (stream,pgm);
+    for (i = 1; i <= stream->nmsgs; i++)
+      if ((elt = mail_elt (stream,i))->sequence) {
+	nntp_parse_overview (&ov,(char *) elt->private.data,elt);
 	r = (SORTCACHE *) (*mailcache) (stream,i,CH_SORTCACHE);
-	  r->refwd = mail_strip_subject (t,&r->subject);
-	if (t = strchr (v,'\t')) {
-	  *t++ = '\0';		/* tie off from */
-	  if (adr = rfc822_parse_address (&adr,adr,&v,BADHOST,0)) {
-	    r->from = adr->mailbox;
-	    adr->mailbox = NIL;
-	    mail_free_address (&adr);
-	  }
-	  if (v = strchr (t,'\t')) {
-	    *v++ = '\0';	/* tie off date */
-	    if (mail_parse_date (&telt,t)) r->date = mail_longdate (&telt);
-	    if ((v = strchr (v,'\t')) && (v = strchr (++v,'\t')))
-	      r->size = atol (++v);
-	  }
-	}
+	if (ov.subject && !r->subject)
+	  r->refwd = mail_strip_subject (ov.subject,&r->subject);
+	if (ov.from && !r->from && ov.from->mailbox)
+	  r->from = cpystr (ov.from->mailbox);
+	if (ov.date && mail_parse_date (&telt,ov.date))
+	  r->date = mail_longdate (&telt);
+	if (ov.optional.octets && !r->size) r->size = ov.optional.octets;
+	if (ov.from) mail_free_address (&ov.from);
+	if (ov.subject) fs_give ((void **) &ov.subject);
       }
-      fs_give ((void **) &s);
-    }
-    if (s) fs_give ((void **) &s);
   }
-
+
 				/* calculate size of sortcache index */
   i = pgm->nmsgs * sizeof (SORTCACHE *);
 				/* instantiate the index */
@@ -24,6 +24,7 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <time.h>
+#include <sys/stat.h>
 #include "rfc822.h"
 #include "misc.h"
 #include "netmsg.h"
@@ -34,6 +35,8 @@
 #define POP3TCPPORT (long) 110	/* assigned TCP contact port */
 #define POP3SSLPORT (long) 995	/* assigned SSL TCP contact port */
 #define IDLETIMEOUT (long) 10	/* defined in RFC 1939 */
+#define POP3LOOKAHEAD 32	/* commands pipelined at one time */
+#define POP3STATEMAGIC "*pop3state1"/* first word of UIDL state file */
 
 
 /* POP3 I/O stream local data */
@@ -64,6 +67,8 @@ typedef struct pop3_local {
   unsigned int sensitive : 1;	/* sensitive data in progress */
   unsigned int loser : 1;	/* server is a loser */
   unsigned int saslcancel : 1;	/* SASL cancelled by protocol */
+  unsigned int uidls : 1;	/* have message UIDLs */
+  unsigned int statestale : 1;	/* state file must be rewritten */
 } POP3LOCAL;
 
 
@@ -103,6 +108,14 @@ long pop3_append (MAILSTREAM *stream,char *mailbox,append_t af,void *data);
 
 long pop3_send_num (MAILSTREAM *stream,char *command,unsigned long n);
 long pop3_send (MAILSTREAM *stream,char *command,char *args);
+long pop3_send_pipeline (MAILSTREAM *stream,char *command,char *args,
+			 unsigned long *msgno,unsigned long n);
+void pop3_top (MAILSTREAM *stream,unsigned long msgno);
+void pop3_header_load (MESSAGECACHE *elt,FILE *f,unsigned long size);
+long pop3_uidl (MAILSTREAM *stream);
+char *pop3_state_file (MAILSTREAM *stream,char *file,char *hdr);
+void pop3_state_read (MAILSTREAM *stream);
+void pop3_state_write (MAILSTREAM *stream);
 long pop3_reply (MAILSTREAM *stream);
 long pop3_fake (MAILSTREAM *stream,char *text);
 
@@ -161,6 +174,7 @@ MAILSTREAM pop3proto = {&pop3driver};
 static unsigned long pop3_maxlogintrials = MAXLOGINTRIALS;
 static long pop3_port = 0;
 static long pop3_sslport = 0;
+static char *pop3_statedir = NIL;
 
 /* POP3 mail validate mailbox
  * Accepts: mailbox name
@@ -208,6 +222,12 @@ void *pop3_parameters (long function,void *value)
   case GET_IDLETIMEOUT:
     value = (void *) IDLETIMEOUT;
     break;
+  case SET_POP3STATEDIR:
+    if (pop3_statedir) fs_give ((void **) &pop3_statedir);
+    if (value && *(char *) value) pop3_statedir = cpystr ((char *) value);
+  case GET_POP3STATEDIR:
+    value = (void *) pop3_statedir;
+    break;
   default:
     value = NIL;		/* error case */
     break;
@@ -452,6 +472,13 @@ MAILSTREAM *pop3_open (MAILSTREAM *stream)
 	  pop3_close (stream,NIL);
 	  return NIL;
 	}
+      }
+				/* recall messages of past sessions */
+      if (pop3_statedir && pop3_uidl (stream)) pop3_state_read (stream);
+      else if (!LOCAL->netstream) {
+	mm_log ("POP3 connection broken while listing unique IDs",ERROR);
+	pop3_close (stream,NIL);
+	return NIL;
       }
       stream->silent = silent;	/* notify main program */
       mail_exists (stream,stream->nmsgs);
@@ -740,17 +767,23 @@ long pop3_response (void *s,char *response,unsigned long size)
 
 void pop3_close (MAILSTREAM *stream,long options)
 {
+  unsigned long i;
+  MESSAGECACHE *elt;
   int silent = stream->silent;
   if (LOCAL) {			/* only if a file is open */
     if (LOCAL->netstream) {	/* close POP3 connection */
       stream->silent = T;
       if (options & CL_EXPUNGE) pop3_expunge (stream);
       stream->silent = silent;
+      if (LOCAL->uidls) pop3_state_write (stream);
       pop3_send (stream,"QUIT",NIL);
       mm_notify (stream,LOCAL->reply,BYE);
     }
 				/* close POP3 connection */
     if (LOCAL->netstream) net_close (LOCAL->netstream);
+    if (LOCAL->uidls) for (i = 1; i <= stream->nmsgs; i++)
+      if ((elt = mail_elt (stream,i))->private.data)
+	fs_give ((void **) &elt->private.data);
 				/* clean up */
     if (LOCAL->cap.implementation)
       fs_give ((void **) &LOCAL->cap.implementation);
@@ -820,35 +853,15 @@ char *pop3_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *size,
 		   long flags)
 {
   unsigned long i;
-  char tmp[MAILTMPLEN];
   MESSAGECACHE *elt;
-  FILE *f = NIL;
   *size = 0;			/* initially no header size */
   if ((flags & FT_UID) && !(msgno = mail_msgno (stream,msgno))) return "";
 				/* have header text already? */
   if (!(elt = mail_elt (stream,msgno))->private.msg.header.text.data) {
 				/* if have CAPA and TOP, assume good TOP */
-    if (!LOCAL->loser && LOCAL->cap.top) {
-      sprintf (tmp,"TOP %lu 0",mail_uid (stream,msgno));
-      if (pop3_send (stream,tmp,NIL))
-	f = netmsg_slurp (LOCAL->netstream,&i,
-			  &elt->private.msg.header.text.size);
-    }
+    if (!LOCAL->loser && LOCAL->cap.top) pop3_top (stream,msgno);
 				/* otherwise load the cache with the message */
-    else if (elt->private.msg.header.text.size = pop3_cache (stream,elt))
-      f = LOCAL->txt;
-    if (f) {			/* got it, make sure at start of file */
-      fseek (f,(unsigned long) 0,L_SET);
-				/* read header from the cache */
-      fread (elt->private.msg.header.text.data = (unsigned char *)
-	     fs_get ((size_t) elt->private.msg.header.text.size + 1),
-	     (size_t) 1,(size_t) elt->private.msg.header.text.size,f);
-				/* tie off header text */
-      elt->private.msg.header.text.data[elt->private.msg.header.text.size] =
-	'\0';
-				/* close if not the cache */
-      if (f != LOCAL->txt) fclose (f);
-    }
+    else if (i = pop3_cache (stream,elt)) pop3_header_load (elt,LOCAL->txt,i);
   }
 				/* return size of text */
   if (size) *size = elt->private.msg.header.text.size;
@@ -856,6 +869,54 @@ char *pop3_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *size,
     (char *) elt->private.msg.header.text.data : "";
 }
 
+/* POP3 fetch headers with TOP
+ * Accepts: mail stream
+ *	    message number
+ *
+ * If the server has PIPELINING, the headers of the following messages which
+ * are not yet loaded are asked for in the same round trip.
+ */
+
+void pop3_top (MAILSTREAM *stream,unsigned long msgno)
+{
+  unsigned long i,j,n,size,msgs[POP3LOOKAHEAD];
+  FILE *f;
+  msgs[0] = msgno;		/* make list of messages to fetch */
+  for (n = 1, i = msgno + 1; LOCAL->cap.pipelining && (n < POP3LOOKAHEAD) &&
+	 (i <= stream->nmsgs); i++)
+    if (!mail_elt (stream,i)->private.msg.header.text.data) msgs[n++] = i;
+  if (pop3_send_pipeline (stream,"TOP","0",msgs,n))
+    for (i = 0; (i < n) && LOCAL->netstream; i++)
+      if (pop3_reply (stream)) {/* read each header in turn */
+				/* can't skip the text, so give up */
+	if (!(f = netmsg_slurp (LOCAL->netstream,&j,&size)))
+	  pop3_fake (stream,"POP3 unable to read message header");
+	else {
+	  pop3_header_load (mail_elt (stream,msgs[i]),f,size);
+	  fclose (f);
+	}
+      }
+}
+
+
+/* POP3 load header text from file
+ * Accepts: message cache entry
+ *	    file with header at start
+ *	    header size
+ */
+
+void pop3_header_load (MESSAGECACHE *elt,FILE *f,unsigned long size)
+{
+  fseek (f,(unsigned long) 0,L_SET);
+				/* read header from the file */
+  fread (elt->private.msg.header.text.data = (unsigned char *)
+	 fs_get ((size_t) size + 1),(size_t) 1,(size_t) size,f);
+				/* tie off header text */
+  elt->private.msg.header.text.data[elt->private.msg.header.text.size = size] =
+    '\0';
+  elt->private.dirty = T;	/* not in state file yet */
+}
+
 /* POP3 fetch body
  * Accepts: mail stream
  *	    message number
@@ -922,6 +983,7 @@ long pop3_ping (MAILSTREAM *stream)
 
 void pop3_check (MAILSTREAM *stream)
 {
+  if (LOCAL->uidls) pop3_state_write (stream);
   if (pop3_ping (stream)) mm_log ("Check completed",NIL);
 }
 
@@ -932,21 +994,32 @@ void pop3_check (MAILSTREAM *stream)
 
 void pop3_expunge (MAILSTREAM *stream)
 {
-  char tmp[MAILTMPLEN];
-  unsigned long i = 1,n = 0;
-  while (i <= stream->nmsgs) {
-    if (mail_elt (stream,i)->deleted && pop3_send_num (stream,"DELE",i)) {
+  char tmp[MAILTMPLEN],ok[POP3LOOKAHEAD];
+  unsigned long i = 1,j,k,n = 0,msgs[POP3LOOKAHEAD];
+  MESSAGECACHE *elt;
+  while (i <= stream->nmsgs) {	/* make list of messages to delete */
+    for (k = 0; (i <= stream->nmsgs) &&
+	   (k < (LOCAL->cap.pipelining ? POP3LOOKAHEAD : 1)); i++)
+      if (mail_elt (stream,i)->deleted) msgs[k++] = i;
+    if (!k) break;		/* none left */
+				/* note which DELEs succeeded */
+    if (pop3_send_pipeline (stream,"DELE",NIL,msgs,k))
+      for (j = 0; j < k; j++) ok[j] = LOCAL->netstream && pop3_reply (stream);
+    else memset (ok,0,k);
+    for (j = k; j--; ) if (ok[j]) {
 				/* expunging currently cached message? */
-      if (LOCAL->cached == mail_uid (stream,i)) {
+      if (LOCAL->cached == mail_uid (stream,msgs[j])) {
 				/* yes, close current file */
 	if (LOCAL->txt) fclose (LOCAL->txt);
 	LOCAL->txt = NIL;
 	LOCAL->cached = LOCAL->hdrsize = 0;
       }
-      mail_expunged (stream,i);
+      if ((elt = mail_elt (stream,msgs[j]))->private.data)
+	fs_give ((void **) &elt->private.data);
+      mail_expunged (stream,msgs[j]);
       n++;
+      i--;			/* later messages move down */
     }
-    else i++;			/* try next message */
   }
   if (!stream->silent) {	/* only if not silent */
     if (n) {			/* did we expunge anything? */
@@ -1035,6 +1108,45 @@ long pop3_send (MAILSTREAM *stream,char *command,char *args)
   return ret;
 }
 
+/* Post Office Protocol 3 send pipelined commands
+ * Accepts: MAIL stream
+ *	    command
+ *	    command argument after message number, or NIL
+ *	    list of message numbers
+ *	    number of messages in list
+ * Returns: T if sent, NIL if failure
+ *
+ * The commands are all sent at once, caller reads one reply per message.
+ * Without PIPELINING, caller must only pass one message.
+ */
+
+long pop3_send_pipeline (MAILSTREAM *stream,char *command,char *args,
+			 unsigned long *msgno,unsigned long n)
+{
+  long ret;
+  unsigned long i;
+  size_t len = strlen (command) + (args ? strlen (args) + 1 : 0) + 16;
+  char *s = (char *) fs_get (n * len + 1);
+  char *t = s;
+  mail_lock (stream);		/* lock up the stream */
+  if (!LOCAL->netstream) ret = pop3_fake (stream,"POP3 connection lost");
+  else {			/* build the complete commands */
+    for (i = 0; i < n; i++) {
+      sprintf (t,"%s %lu",command,mail_uid (stream,msgno[i]));
+      if (args) sprintf (t + strlen (t)," %s",args);
+      if (stream->debug) mail_dlog (t,LOCAL->sensitive);
+      strcat (t,"\015\012");
+      t += strlen (t);
+    }
+				/* send the commands */
+    ret = net_soutr (LOCAL->netstream,s) ? LONGT :
+      pop3_fake (stream,"POP3 connection broken in command");
+  }
+  fs_give ((void **) &s);
+  mail_unlock (stream);		/* unlock stream */
+  return ret;
+}
+
 /* Post Office Protocol 3 get reply
  * Accepts: MAIL stream
  * Returns: T if success reply, NIL if error reply
@@ -1071,3 +1183,171 @@ long pop3_fake (MAILSTREAM *stream,char *text)
   LOCAL->reply = text;		/* set up pseudo-reply string */
   return NIL;			/* return error code */
 }
+
+/* POP3 get unique IDs of messages
+ * Accepts: MAIL stream
+ * Returns: T if have unique IDs, NIL otherwise
+ */
+
+long pop3_uidl (MAILSTREAM *stream)
+{
+  unsigned long i;
+  char *s,*t;
+  MESSAGECACHE *elt;
+				/* don't bother if server surely lacks it */
+  if (LOCAL->loser || (LOCAL->cap.capa && !LOCAL->cap.uidl) ||
+      !pop3_send (stream,"UIDL",NIL)) return NIL;
+  while ((s = net_getline (LOCAL->netstream)) && (*s != '.')) {
+				/* unique ID is 1 to 70 printable chars */
+    if ((i = strtoul (s,&t,10)) && (i <= stream->nmsgs) && (*t++ == ' ') &&
+	*t && (strlen (t) <= 70) && !strpbrk (t," \t") &&
+	!(elt = mail_elt (stream,i))->private.data) {
+      elt->private.data = (unsigned long) cpystr (t);
+      LOCAL->uidls = T;
+    }
+    fs_give ((void **) &s);
+  }
+  if (!s) return pop3_fake (stream,"POP3 connection broken in UIDL");
+  fs_give ((void **) &s);	/* flush final dot */
+  return LOCAL->uidls;
+}
+
+/* POP3 return UIDL state file name
+ * Accepts: MAIL stream
+ *	    destination buffer for file name
+ *	    destination buffer for first line of file
+ * Returns: file name or NIL if no state file
+ */
+
+char *pop3_state_file (MAILSTREAM *stream,char *file,char *hdr)
+{
+  char *s;
+  NETMBX mb;
+  if (!(pop3_statedir && mail_valid_net_parse (stream->mailbox,&mb)) ||
+      ((strlen (pop3_statedir) + strlen (myhomedir ()) + strlen (mb.host) +
+	strlen (mb.user)) > (MAILTMPLEN - 32))) return NIL;
+  if (*pop3_statedir == '/') sprintf (file,"%s/",pop3_statedir);
+  else sprintf (file,"%s/%s/",myhomedir (),pop3_statedir);
+				/* one file per server and user */
+  lcase (strcpy (s = file + strlen (file),mb.host));
+  sprintf (s + strlen (s),"-%s",mb.user);
+  for (; *s; s++) if ((*s == '/') || (*s == '\\')) *s = '_';
+  sprintf (hdr,"%s %s %s\n",POP3STATEMAGIC,mb.host,mb.user);
+  return file;
+}
+
+/* POP3 read UIDL state file
+ * Accepts: MAIL stream
+ *
+ * Each record after the first line of the file is a line with a message's
+ * UIDL, size, "S" if seen or "-" if not, and header size, followed by the
+ * header text.  Messages found in the file are no longer recent.
+ */
+
+void pop3_state_read (MAILSTREAM *stream)
+{
+  unsigned long i,size,hsize,recent = stream->recent;
+  size_t len;
+  char *buf,*s,*t,*u,seen,file[MAILTMPLEN],hdr[MAILTMPLEN];
+  void **data;
+  HASHTAB *ht;
+  MESSAGECACHE *elt;
+  FILE *f;
+  LOCAL->statestale = T;	/* rewrite unless it proves good */
+  if (!(pop3_state_file (stream,file,hdr) && (f = fopen (file,"rb")))) return;
+  if (!fseek (f,0,SEEK_END) && ((len = (size_t) ftell (f)) >= strlen (hdr)) &&
+      !fseek (f,0,SEEK_SET)) {
+    buf = (char *) fs_get (len + 1);
+    if ((fread (buf,(size_t) 1,len,f) == len) &&
+	!strncmp (buf,hdr,strlen (hdr))) {
+      buf[len] = '\0';		/* tie off file data */
+      LOCAL->statestale = NIL;
+      ht = hash_create (stream->nmsgs);
+      for (i = 1; i <= stream->nmsgs; i++)
+	if (s = (char *) mail_elt (stream,i)->private.data)
+	  hash_add (ht,s,(void *) i,0);
+      for (s = buf + strlen (hdr); (t = strchr (s,'\n')); s = t + 1 + hsize) {
+	*t = '\0';		/* tie off record line */
+	if (!(u = strchr (s,' ')) ||
+	    (sscanf (u + 1,"%lu %c %lu",&size,&seen,&hsize) != 3) ||
+	    (hsize > (unsigned long) (buf + len - (t + 1)))) {
+	  LOCAL->statestale = T;/* bogus record, ignore rest of file */
+	  break;
+	}
+	*u = '\0';		/* tie off UIDL */
+				/* message deleted from server? */
+	if (!(data = hash_lookup (ht,s))) LOCAL->statestale = T;
+	else if (!(elt = mail_elt (stream,(unsigned long) *data))->
+		 private.msg.header.text.data) {
+	  elt->private.msg.header.text.data = (unsigned char *)
+	    memcpy (fs_get ((size_t) hsize + 1),t + 1,(size_t) hsize);
+	  elt->private.msg.header.text.data[hsize] = '\0';
+	  elt->private.msg.header.text.size = hsize;
+	  if (!elt->rfc822_size) elt->rfc822_size = size;
+	  elt->private.filter = elt->seen = (seen == 'S');
+	  if (elt->recent) {	/* seen in a past session */
+	    elt->recent = NIL;
+	    recent--;
+	  }
+	}
+      }
+      hash_destroy (&ht);
+      mail_recent (stream,recent);
+    }
+    fs_give ((void **) &buf);
+  }
+  fclose (f);
+}
+
+/* POP3 write UIDL state file
+ * Accepts: MAIL stream
+ *
+ * The file is only written if something changed since it was read.  It is
+ * written under a temporary name which is then renamed, so another session
+ * never reads a partial file.
+ */
+
+void pop3_state_write (MAILSTREAM *stream)
+{
+  unsigned long i;
+  long ok;
+  int fd;
+  char *s,file[MAILTMPLEN],hdr[MAILTMPLEN],tmp[MAILTMPLEN];
+  MESSAGECACHE *elt;
+  FILE *f;
+				/* new headers or changed seen flags? */
+  for (i = 1; !LOCAL->statestale && (i <= stream->nmsgs); i++)
+    if ((elt = mail_elt (stream,i))->private.data &&
+	elt->private.msg.header.text.data &&
+	(elt->private.dirty || (elt->seen != elt->private.filter)))
+      LOCAL->statestale = T;
+  if (!(LOCAL->statestale && pop3_state_file (stream,file,hdr)) ||
+      (strlen (file) > (MAILTMPLEN - 20))) return;
+  sprintf (tmp,"%s.%lx",file,(unsigned long) getpid ());
+				/* headers are private, only owner may read */
+  if ((fd = open (tmp,O_WRONLY|O_CREAT|O_TRUNC,S_IREAD|S_IWRITE)) < 0) return;
+  if (!(f = fdopen (fd,"wb"))) {
+    close (fd);
+    unlink (tmp);
+    return;
+  }
+  ok = (fputs (hdr,f) != EOF);
+  for (i = 1; ok && (i <= stream->nmsgs); i++)
+    if ((s = (char *) (elt = mail_elt (stream,i))->private.data) &&
+	elt->private.msg.header.text.data)
+      ok = (fprintf (f,"%s %lu %c %lu\n",s,elt->rfc822_size,
+		     elt->seen ? 'S' : '-',
+		     elt->private.msg.header.text.size) >= 0) &&
+	(fwrite (elt->private.msg.header.text.data,(size_t) 1,
+		 (size_t) elt->private.msg.header.text.size,f) ==
+	 elt->private.msg.header.text.size);
+  if ((fclose (f) == EOF) || !ok || rename (tmp,file)) unlink (tmp);
+  else {			/* file now up to date */
+    for (i = 1; i <= stream->nmsgs; i++) {
+      elt = mail_elt (stream,i);
+      elt->private.dirty = NIL;
+      elt->private.filter = elt->seen;
+    }
+    LOCAL->statestale = NIL;
+  }
+}
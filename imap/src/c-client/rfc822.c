@@ -367,6 +367,8 @@ void rfc822_parse_msg_full (ENVELOPE **en,BODY **bdy,char *s,unsigned long i,
 {
   char c,*t,*d;
   char *tmp = (char *) fs_get ((size_t) i + 100);
+				/* parse into an arena if wanted */
+  MAILARENA *arena = mail_arena_open (i + MAILARENASIZE);
   ENVELOPE *env = (*en = mail_newenvelope ());
   BODY *body = bdy ? (*bdy = mail_newbody ()) : NIL;
   long MIMEp = -1;		/* flag that MIME semantics are in effect */
@@ -424,24 +426,25 @@ void rfc822_parse_msg_full (ENVELOPE **en,BODY **bdy,char *s,unsigned long i,
 	  }
 	break;
       case 'D':			/* possible Date: */
-	if (!env->date && !strcmp (tmp+1,"ATE")) env->date = cpystr (d);
+	if (!env->date && !strcmp (tmp+1,"ATE"))
+	  env->date = mail_arena_cpystr (d);
 	break;
       case 'F':			/* possible From: */
 	if (!strcmp (tmp+1,"ROM")) rfc822_parse_adrlist (&env->from,d,host);
 	else if (!strcmp (tmp+1,"OLLOWUP-TO")) {
-	  t = env->followup_to = (char *) fs_get (1 + strlen (d));
+	  t = env->followup_to = (char *) mail_arena_get (1 + strlen (d));
 	  while (c = *d++) if (c != ' ') *t++ = c;
 	  *t++ = '\0';
 	}
 	break;
       case 'I':			/* possible In-Reply-To: */
 	if (!env->in_reply_to && !strcmp (tmp+1,"N-REPLY-TO"))
-	  env->in_reply_to = cpystr (d);
+	  env->in_reply_to = mail_arena_cpystr (d);
 	break;
 
       case 'M':			/* possible Message-ID: or MIME-Version: */
 	if (!env->message_id && !strcmp (tmp+1,"ESSAGE-ID"))
-	  env->message_id = cpystr (d);
+	  env->message_id = mail_arena_cpystr (d);
 	else if (!strcmp (tmp+1,"IME-VERSION")) {
 				/* tie off at end of phrase */
 	  if (t = rfc822_parse_phrase (d)) *t = '\0';
@@ -454,7 +457,7 @@ void rfc822_parse_msg_full (ENVELOPE **en,BODY **bdy,char *s,unsigned long i,
 	break;
       case 'N':			/* possible Newsgroups: */
 	if (!env->newsgroups && !strcmp (tmp+1,"EWSGROUPS")) {
-	  t = env->newsgroups = (char *) fs_get (1 + strlen (d));
+	  t = env->newsgroups = (char *) mail_arena_get (1 + strlen (d));
 	  while (c = *d++) if (c != ' ') *t++ = c;
 	  *t++ = '\0';
 	}
@@ -463,11 +466,11 @@ void rfc822_parse_msg_full (ENVELOPE **en,BODY **bdy,char *s,unsigned long i,
 	if (!strcmp (tmp+1,"EPLY-TO"))
 	  rfc822_parse_adrlist (&env->reply_to,d,host);
 	else if (!env->references && !strcmp (tmp+1,"EFERENCES"))
-	  env->references = cpystr (d);
+	  env->references = mail_arena_cpystr (d);
 	break;
       case 'S':			/* possible Subject: or Sender: */
 	if (!env->subject && !strcmp (tmp+1,"UBJECT"))
-	  env->subject = cpystr (d);
+	  env->subject = mail_arena_cpystr (d);
 	else if (!strcmp (tmp+1,"ENDER"))
 	  rfc822_parse_adrlist (&env->sender,d,host);
 	break;
@@ -486,6 +489,11 @@ void rfc822_parse_msg_full (ENVELOPE **en,BODY **bdy,char *s,unsigned long i,
   /*if (!env->reply_to) env->reply_to = rfc822_cpy_adr (env->from);*/
 				/* now parse the body */
   if (body && bs) rfc822_parse_content (body,bs,host,depth,flags);
+  if (arena) {			/* parsed into an arena? */
+    (env->arena = arena)->refs++;
+    if (body) (body->arena = arena)->refs++;
+    mail_arena_close ();	/* later allocations are independent */
+  }
 }
 
 /* Parse a message body content
@@ -509,7 +517,8 @@ void rfc822_parse_content (BODY *body,STRING *bs,char *h,unsigned long depth,
     MM_LOG ("Ignoring excessively deep MIME recursion",PARSE);
   }
   if (!body->subtype)		/* default subtype if still unknown */
-    body->subtype = cpystr (rfc822_default_subtype (body->type));
+    body->subtype =
+      mail_arena_cpystr (rfc822_default_subtype (body->type));
 				/* note offset and sizes */
   body->contents.offset = GETPOS (bs);
 				/* note internal body size in all cases */
@@ -519,8 +528,8 @@ void rfc822_parse_content (BODY *body,STRING *bs,char *h,unsigned long depth,
   case TYPETEXT:		/* text content */
     if (!body->parameter) {	/* default parameters */
       body->parameter = mail_newbody_parameter ();
-      body->parameter->attribute = cpystr ("CHARSET");
-      body->parameter->value = cpystr ("US-ASCII");
+      body->parameter->attribute = mail_arena_cpystr ("CHARSET");
+      body->parameter->value = mail_arena_cpystr ("US-ASCII");
     }
 				/* count number of lines */
     while (i--) if ((SNX (bs)) == '\n') body->size.lines++;
@@ -709,15 +718,16 @@ void rfc822_parse_content (BODY *body,STRING *bs,char *h,unsigned long depth,
 	bs->size = j;		/* restore current level size */
       }
       else {			/* empty MIME headers, use default subtype */
-	part->body.subtype = cpystr (rfc822_default_subtype (part->body.type));
+	part->body.subtype =
+	  mail_arena_cpystr (rfc822_default_subtype (part->body.type));
 				/* see if anything else special to do */
 	switch (part->body.type) {
 	case TYPETEXT:		/* text content */
 				/* default parameters */
 	  if (!part->body.parameter) {
 	    part->body.parameter = mail_newbody_parameter ();
-	    part->body.parameter->attribute = cpystr ("CHARSET");
-	    part->body.parameter->value = cpystr ("US-ASCII");
+	    part->body.parameter->attribute = mail_arena_cpystr ("CHARSET");
+	    part->body.parameter->value = mail_arena_cpystr ("US-ASCII");
 	  }
 	  break;
 	case TYPEMESSAGE:	/* encapsulated message in digest */
@@ -751,17 +761,18 @@ void rfc822_parse_content_header (BODY *body,char *name,char *s)
   if (t = strchr (name,' ')) *t = '\0';
   switch (*name) {		/* see what kind of content */
   case 'I':			/* possible Content-ID */
-    if (!(strcmp (name+1,"D") || body->id)) body->id = cpystr (s);
+    if (!(strcmp (name+1,"D") || body->id))
+      body->id = mail_arena_cpystr (s);
     break;
   case 'D':			/* possible Content-Description */
     if (!(strcmp (name+1,"ESCRIPTION") || body->description))
-      body->description = cpystr (s);
+      body->description = mail_arena_cpystr (s);
     if (!(strcmp (name+1,"ISPOSITION") || body->disposition.type)) {
 				/* get type word */
       if (!(name = rfc822_parse_word (s,tspecials))) break;
       c = *name;		/* remember delimiter */
       *name = '\0';		/* tie off type */
-      body->disposition.type = ucase (cpystr (s));
+      body->disposition.type = ucase (mail_arena_cpystr (s));
       *name = c;		/* restore delimiter */
       rfc822_skipws (&name);	/* skip whitespace */
       rfc822_parse_parameter (&body->disposition.parameter,name);
@@ -775,7 +786,7 @@ void rfc822_parse_content_header (BODY *body,char *name,char *s)
 	*name = '\0';		/* tie off subtype */
 	if (stl) stl = stl->next = mail_newstringlist ();
 	else stl = body->language = mail_newstringlist ();
-	stl->text.data = (unsigned char *) ucase (cpystr (s));
+	stl->text.data = (unsigned char *) ucase (mail_arena_cpystr (s));
 	stl->text.size = strlen ((char *) stl->text.data);
 	*name = c;		/* restore delimiter */
 	rfc822_skipws (&name);	/* skip whitespace */
@@ -787,10 +798,11 @@ void rfc822_parse_content_header (BODY *body,char *name,char *s)
       }
     }
     else if (!(strcmp (name+1,"OCATION") || body->location))
-      body->location = cpystr (s);
+      body->location = mail_arena_cpystr (s);
     break;
   case 'M':			/* possible Content-MD5 */
-    if (!(strcmp (name+1,"D5") || body->md5)) body->md5 = cpystr (s);
+    if (!(strcmp (name+1,"D5") || body->md5))
+      body->md5 = mail_arena_cpystr (s);
     break;
 
   case 'T':			/* possible Content-Type/Transfer-Encoding */
@@ -799,7 +811,8 @@ void rfc822_parse_content_header (BODY *body,char *name,char *s)
       if (!(name = rfc822_parse_word (s,tspecials))) break;
       c = *name;		/* remember delimiter */
       *name = '\0';		/* tie off type */
-      s = ucase (rfc822_cpy(s));/* search for body type */
+      s = ucase (rfc822_quote (cpystr (s)));
+				/* search for body type */
       for (i = 0; (i <= TYPEMAX) && body_types[i] &&
 	     strcmp (s,body_types[i]); i++);
 				/* record body type index */
@@ -827,14 +840,15 @@ void rfc822_parse_content_header (BODY *body,char *name,char *s)
     else if (!strcmp (name+1,"RANSFER-ENCODING")) {
       if (!(name = rfc822_parse_word (s,tspecials))) break;
       *name = '\0';		/* tie off encoding */
-      s = ucase (rfc822_cpy(s));/* search for body encoding */
+      s = ucase (rfc822_quote (cpystr (s)));
+				/* search for body encoding */
       for (i = 0; (i <= ENCMAX) && body_encodings[i] &&
 	   strcmp (s,body_encodings[i]); i++);
 				/* record body encoding index */
       body->encoding = (i <= ENCMAX) ? (unsigned short) i : ENCOTHER;
 				/* and name if new encoding */
       if (body_encodings[body->encoding]) fs_give ((void **) &s);
-      else body_encodings[body->encoding] = ucase (cpystr (s));
+      else body_encodings[body->encoding] = s;
     }
     break;
   default:			/* otherwise unknown */
@@ -861,12 +875,12 @@ void rfc822_parse_parameter (PARAMETER **par,char *text)
     else {			/* instantiate a new parameter */
       if (*par) param = param->next = mail_newbody_parameter ();
       else param = *par = mail_newbody_parameter ();
-      param->attribute = ucase (cpystr (s));
+      param->attribute = ucase (mail_arena_cpystr (s));
       *text = c;		/* restore delimiter */
       rfc822_skipws (&text);	/* skip whitespace before equal sign */
       if ((*text != '=') ||	/* missing value is a no-no too */
 	  !(text = rfc822_parse_word ((s = ++text),tspecials)))
-	param->value = cpystr ("UNKNOWN_PARAMETER_VALUE");
+	param->value = mail_arena_cpystr ("UNKNOWN_PARAMETER_VALUE");
       else {			/* good, have equals sign */
 	c = *text;		/* remember delimiter */
 	*text = '\0';		/* tie off value */
@@ -927,8 +941,9 @@ void rfc822_parse_adrlist (ADDRESS **lst,char *string,char *host)
 	  sprintf (tmp,s,string);
 	  MM_LOG (tmp,PARSE);
 	  last = last->next = mail_newaddr ();
-	  last->mailbox = cpystr ("UNEXPECTED_DATA_AFTER_ADDRESS");
-	  last->host = cpystr (errhst);
+	  last->mailbox =
+	    mail_arena_cpystr ("UNEXPECTED_DATA_AFTER_ADDRESS");
+	  last->host = mail_arena_cpystr (errhst);
 				/* falls through */
 	case '\0':		/* null-specified address? */
 	  string = NIL;		/* punt remainder of parse */
@@ -942,8 +957,9 @@ void rfc822_parse_adrlist (ADDRESS **lst,char *string,char *host)
       else sprintf (tmp,"Invalid mailbox list: %.80s",string);
       MM_LOG (tmp,PARSE);
       string = NIL;
-      (adr = mail_newaddr ())->mailbox = cpystr ("INVALID_ADDRESS");
-      adr->host = cpystr (errhst);
+      (adr = mail_newaddr ())->mailbox =
+	mail_arena_cpystr ("INVALID_ADDRESS");
+      adr->host = mail_arena_cpystr (errhst);
       if (last) last = last->next = adr;
       else *lst = last = adr;
       break;
@@ -1031,8 +1047,9 @@ ADDRESS *rfc822_parse_group (ADDRESS **lst,ADDRESS *last,char **string,
 	  MM_LOG (tmp,PARSE);
 	  *string = NIL;	/* cancel remainder of parse */
 	  last = last->next = mail_newaddr ();
-	  last->mailbox = cpystr ("UNEXPECTED_DATA_AFTER_ADDRESS_IN_GROUP");
-	  last->host = cpystr (errhst);
+	  last->mailbox =
+	    mail_arena_cpystr ("UNEXPECTED_DATA_AFTER_ADDRESS_IN_GROUP");
+	  last->host = mail_arena_cpystr (errhst);
 	}
       }
     }
@@ -1040,8 +1057,9 @@ ADDRESS *rfc822_parse_group (ADDRESS **lst,ADDRESS *last,char **string,
       sprintf (tmp,"Invalid group mailbox list: %.80s",*string);
       MM_LOG (tmp,PARSE);
       *string = NIL;		/* cancel remainder of parse */
-      (adr = mail_newaddr ())->mailbox = cpystr ("INVALID_ADDRESS_IN_GROUP");
-      adr->host = cpystr (errhst);
+      (adr = mail_newaddr ())->mailbox =
+	mail_arena_cpystr ("INVALID_ADDRESS_IN_GROUP");
+      adr->host = mail_arena_cpystr (errhst);
       last = last->next = adr;
     }
   }
@@ -1077,7 +1095,7 @@ ADDRESS *rfc822_parse_mailbox (char **string,char *defaulthost)
   else if (end = rfc822_parse_phrase (s)) {
     if ((adr = rfc822_parse_routeaddr (end,string,defaulthost))) {
 				/* phrase is a personal name */
-      if (adr->personal) fs_give ((void **) &adr->personal);
+      if (adr->personal) mail_arena_give ((void **) &adr->personal);
       *end = '\0';		/* tie off phrase */
       adr->personal = rfc822_cpy (s);
     }
@@ -1120,7 +1138,7 @@ ADDRESS *rfc822_parse_routeaddr (char *string,char **ret,char *defaulthost)
 {
   char tmp[MAILTMPLEN];
   ADDRESS *adr;
-  char *s,*t,*adl;
+  char *s,*t,*v,*adl;
   size_t adllen,i;
   if (!string) return NIL;
   rfc822_skipws (&string);	/* flush leading whitespace */
@@ -1132,13 +1150,15 @@ ADDRESS *rfc822_parse_routeaddr (char *string,char **ret,char *defaulthost)
        (*t == '@') && (s = rfc822_parse_domain (t+1,&t));) {
     i = strlen (s) + 2;		/* @ plus domain plus delimiter or NUL */
     if (adl) {			/* have existing A-D-L? */
-      fs_resize ((void **) &adl,adllen + i);
-      sprintf (adl + adllen - 1,",@%s",s);
+      sprintf (v = (char *) mail_arena_get (adllen + i),"%s,@%s",adl,s);
+      mail_arena_give ((void **) &adl);
+      adl = v;			/* new A-D-L */
     }
 				/* write initial A-D-L */
-    else sprintf (adl = (char *) fs_get (i),"@%s",s);
+    else sprintf (adl = (char *) mail_arena_get (i),"@%s",s);
     adllen += i;		/* new A-D-L length */
-    fs_give ((void **) &s);	/* don't need domain any more */
+				/* don't need domain any more */
+    mail_arena_give ((void **) &s);
     rfc822_skipws (&t);		/* skip WS */
     if (*t != ',') break;	/* put if not comma */
     t++;			/* skip the comma */
@@ -1154,7 +1174,7 @@ ADDRESS *rfc822_parse_routeaddr (char *string,char **ret,char *defaulthost)
 
 				/* parse address spec */
   if (!(adr = rfc822_parse_addrspec (string,ret,defaulthost))) {
-    if (adl) fs_give ((void **) &adl);
+    if (adl) mail_arena_give ((void **) &adl);
     return NIL;
   }
   if (adl) adr->adl = adl;	/* have an A-D-L? */
@@ -1168,8 +1188,8 @@ ADDRESS *rfc822_parse_routeaddr (char *string,char **ret,char *defaulthost)
 	   *adr->host == '@' ? "<null>" : adr->host);
   MM_LOG (tmp,PARSE);
   adr->next = mail_newaddr ();
-  adr->next->mailbox = cpystr ("MISSING_MAILBOX_TERMINATOR");
-  adr->next->host = cpystr (errhst);
+  adr->next->mailbox = mail_arena_cpystr ("MISSING_MAILBOX_TERMINATOR");
+  adr->next->host = mail_arena_cpystr (errhst);
   return adr;			/* return the address */
 }
 
@@ -1210,9 +1230,10 @@ ADDRESS *rfc822_parse_addrspec (char *string,char **ret,char *defaulthost)
       s = rfc822_cpy (string);	/* copy successor part */
       *t = c;			/* restore delimiter */
 				/* build new mailbox */
-      sprintf (v = (char *) fs_get (strlen (adr->mailbox) + strlen (s) + 2),
+      sprintf (v = (char *) mail_arena_get (strlen (adr->mailbox) +
+					    strlen (s) + 2),
 	       "%s.%s",adr->mailbox,s);
-      fs_give ((void **) &adr->mailbox);
+      mail_arena_give ((void **) &adr->mailbox);
       adr->mailbox = v;		/* new host name */
       rfc822_skipws (&t);	/* skip WS after mailbox */
     }
@@ -1234,9 +1255,9 @@ ADDRESS *rfc822_parse_addrspec (char *string,char **ret,char *defaulthost)
   if (*end != '@') end = t;	/* host name missing */
 				/* otherwise parse host name */
   else if (!(adr->host = rfc822_parse_domain (++end,&end)))
-    adr->host = cpystr (errhst);
+    adr->host = mail_arena_cpystr (errhst);
 				/* default host if missing */
-  if (!adr->host) adr->host = cpystr (defaulthost);
+  if (!adr->host) adr->host = mail_arena_cpystr (defaulthost);
 				/* try person name in comments if missing */
   if (end && !(adr->personal && *adr->personal)) {
     while (*end == ' ') ++end;	/* see if we can find a person name here */
@@ -1266,7 +1287,7 @@ char *rfc822_parse_domain (char *string,char **end)
     else if (**end != ']') MM_LOG ("Unterminated domain literal",PARSE);
     else {
       size_t len = ++*end - string;
-      strncpy (ret = (char *) fs_get (len + 1),string,len);
+      strncpy (ret = (char *) mail_arena_get (len + 1),string,len);
       ret[len] = '\0';		/* tie off literal */
     }
   }
@@ -1288,9 +1309,9 @@ char *rfc822_parse_domain (char *string,char **end)
 	s = rfc822_cpy (string);/* copy successor part */
 	*t = c;			/* restore delimiter */
 				/* build new domain */
-	sprintf (v = (char *) fs_get (strlen (ret) + strlen (s) + 2),
+	sprintf (v = (char *) mail_arena_get (strlen (ret) + strlen (s) + 2),
 		 "%s.%s",ret,s);
-	fs_give ((void **) &ret);
+	mail_arena_give ((void **) &ret);
 	ret = v;		/* new host name */
 	rfc822_skipws (&t);	/* skip WS after domain */
       }
@@ -1406,7 +1427,7 @@ char *rfc822_parse_word (char *s,const char *delimiters)
 char *rfc822_cpy (char *src)
 {
 				/* copy and unquote */
-  return rfc822_quote (cpystr (src));
+  return rfc822_quote (mail_arena_cpystr (src));
 }
 
 
@@ -233,6 +233,14 @@ static const CHARSET text_8bit = {"UNTAGGED-8BIT",CT_UTF8,NIL,0xffffffff,NIL};
 				/* untagged ISO 2022 */
 static const CHARSET iso2022 = {"ISO-2022",CT_2022,NIL,0xffffffff,NIL};
 
+/* Charset name hash table, loaded on first lookup */
+
+static const CHARSET *utf8_cshash[UTF8CSHASH];
+static long utf8_cshashed = NIL;
+
+				/* single-byte charset maps made so far */
+static UTF8BYTEMAP *utf8_bytemaps = NIL;
+
 /* Non-Unicode Script table */
 
 static const SCRIPT utf8_scvalid[] = {
@@ -284,16 +292,39 @@ SCRIPT *utf8_script (char *script)
 
 CHARSET *utf8_charset (char *charset)
 {
-  unsigned long i;
+  unsigned long i,j;
   if (!charset) return (CHARSET *) &utf8_csvalid[0];
-  else if (*charset && (strlen (charset) < 128))
-    for (i = 0; utf8_csvalid[i].name; i++)
-      if (!compare_cstring (charset,utf8_csvalid[i].name))
-	return (CHARSET *) &utf8_csvalid[i];
+  if (!utf8_cshashed) {		/* load hash table first time through */
+    for (j = 0; utf8_csvalid[j].name; j++) {
+      for (i = utf8_charset_hash (utf8_csvalid[j].name); utf8_cshash[i];
+	   i = (i + 1) % UTF8CSHASH);
+      utf8_cshash[i] = &utf8_csvalid[j];
+    }
+    utf8_cshashed = T;
+  }
+  if (*charset && (strlen (charset) < 128))
+    for (i = utf8_charset_hash (charset); utf8_cshash[i];
+	 i = (i + 1) % UTF8CSHASH)
+      if (!compare_cstring (charset,utf8_cshash[i]->name))
+	return (CHARSET *) utf8_cshash[i];
   return NIL;			/* failed */
 }
 
 
+/* Hash charset name
+ * Accepts: charset name
+ * Returns: hash table index, the same for any case of the name
+ */
+
+unsigned long utf8_charset_hash (char *charset)
+{
+  unsigned long ret = 0;
+  unsigned char c;
+  while (c = *charset++) ret = (ret * 31) + (islower (c) ? toupper (c) : c);
+  return ret % UTF8CSHASH;
+}
+
+
 /* Convert charset labelled sized text to UTF-8
  * Accepts: source sized text
  *	    charset
@@ -703,19 +734,7 @@ long utf8_cstocstext (SIZEDTEXT *src,char *sc,SIZEDTEXT *dst,char *dc,
 
 void utf8_text_1byte0 (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab)
 {
-  unsigned long i;
-  unsigned char *s;
-  unsigned int c;
-  for (ret->size = i = 0; i < text->size;
-       ret->size += (text->data[i++] & BIT8) ? 2 : 1);
-  (s = ret->data = (unsigned char *) fs_get (ret->size + 1))[ret->size] =NIL;
-  for (i = 0; i < text->size;) {
-    if ((c = text->data[i++]) & BIT8) {
-      *s++ = 0xc0 | ((c >> 6) & 0x3f);
-      *s++ = BIT8 | (c & 0x3f);
-    }
-    else *s++ = c;		/* ASCII character */
-  }
+  utf8_text_bytemap (text,ret,utf8_bytemap (CT_1BYTE0,tab));
 }
 
 
@@ -727,19 +746,10 @@ void utf8_text_1byte0 (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab)
 
 void utf8_text_1byte (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab)
 {
-  unsigned long i;
-  unsigned char *s;
-  unsigned int c;
-  unsigned short *tbl = (unsigned short *) tab;
-  for (ret->size = i = 0; i < text->size; ret->size += UTF8_SIZE (c))
-    if ((c = text->data[i++]) & BIT8) c = tbl[c & BITS7];
-  (s = ret->data = (unsigned char *) fs_get (ret->size + 1))[ret->size] =NIL;
-  for (i = 0; i < text->size;) {
-    if ((c = text->data[i++]) & BIT8) c = tbl[c & BITS7];
-    UTF8_PUT (s,c)		/* convert Unicode to UTF-8 */
-  }
+  utf8_text_bytemap (text,ret,utf8_bytemap (CT_1BYTE,tab));
 }
-
+
+
 /* Convert single byte 8bit character set sized text to UTF-8
  * Accepts: source sized text
  *	    pointer to return sized text
@@ -748,19 +758,113 @@ void utf8_text_1byte (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab)
 
 void utf8_text_1byte8 (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab)
 {
-  unsigned long i;
+  utf8_text_bytemap (text,ret,utf8_bytemap (CT_1BYTE8,tab));
+}
+
+/* Get map from single byte character set to UTF-8
+ * Accepts: charset type
+ *	    conversion table
+ * Returns: map, made from the conversion table the first time it is used
+ */
+
+UTF8BYTEMAP *utf8_bytemap (unsigned long type,void *tab)
+{
+  unsigned int c,u;
   unsigned char *s;
-  unsigned int c;
+  UTF8BYTEMAP *map;
   unsigned short *tbl = (unsigned short *) tab;
-  for (ret->size = i = 0; i < text->size; ret->size += UTF8_SIZE (c))
-    c = tbl[text->data[i++]];
-  (s = ret->data = (unsigned char *) fs_get (ret->size + 1))[ret->size] =NIL;
-  for (i = 0; i < text->size;) {
-    c = tbl[text->data[i++]];
-    UTF8_PUT (s,c)		/* convert Unicode to UTF-8 */
+  for (map = utf8_bytemaps; map; map = map->next)
+    if ((map->type == type) && (map->tab == tab)) return map;
+  map = (UTF8BYTEMAP *) memset (fs_get (sizeof (UTF8BYTEMAP)),0,
+				sizeof (UTF8BYTEMAP));
+  map->type = type;
+  map->tab = tab;
+  map->ascii = T;		/* assume ASCII maps to itself */
+  for (c = 0; c < 256; c++) {
+    switch (type) {		/* get Unicode for this byte */
+    case CT_1BYTE0:		/* 1 byte no table */
+      u = c;
+      break;
+    case CT_1BYTE:		/* 1 byte ASCII + table 0x80-0xff */
+      u = (c & BIT8) ? tbl[c & BITS7] : c;
+      break;
+    default:			/* 1 byte table 0x00 - 0xff */
+      u = tbl[c];
+      break;
+    }
+    s = map->utf8[c];		/* convert Unicode to UTF-8 */
+    UTF8_PUT (s,u)
+    map->size[c] = s - map->utf8[c];
+    if (!(c & BIT8) && (u != c)) map->ascii = NIL;
   }
+  map->next = utf8_bytemaps;	/* remember for next time */
+  return utf8_bytemaps = map;
 }
-
+
+/* Convert single byte character set sized text to UTF-8
+ * Accepts: source sized text
+ *	    pointer to return sized text
+ *	    UTF-8 map
+ *
+ * Runs of ASCII are copied as they are when the charset maps ASCII to
+ * itself, and text which is entirely ASCII is returned without a copy.
+ */
+
+void utf8_text_bytemap (SIZEDTEXT *text,SIZEDTEXT *ret,UTF8BYTEMAP *map)
+{
+  unsigned long i,j,w;
+  unsigned char *t;
+  unsigned char *d = text->data;
+				/* high bit of every byte in a word */
+  unsigned long m = ((unsigned long) ~0 / 0xff) * BIT8;
+  if (!map->ascii) i = 0;	/* must map every byte */
+  else if ((i = utf8_ascii_span (d,text->size)) == text->size) {
+    ret->data = text->data;	/* all ASCII, return the source */
+    ret->size = text->size;
+    return;
+  }
+				/* size the UTF-8 */
+  for (ret->size = j = i; j < text->size; ret->size += map->size[d[j++]]);
+				/* slop so every byte can copy 3 octets */
+  (t = ret->data = (unsigned char *) fs_get (ret->size + 3))[ret->size] =NIL;
+  memcpy (t,d,i);		/* copy the leading ASCII */
+  for (t += i; i < text->size;) {
+				/* copy a word of ASCII at a time */
+    if (map->ascii && ((i + sizeof (w)) <= text->size) &&
+	!(memcpy (&w,d + i,sizeof (w)),(w & m))) {
+      memcpy (t,&w,sizeof (w));
+      t += sizeof (w);
+      i += sizeof (w);
+    }
+    else {			/* else map a byte */
+      memcpy (t,map->utf8[d[i]],3);
+      t += map->size[d[i++]];
+    }
+  }
+  *t = NIL;			/* slop may have overwritten the tie off */
+}
+
+
+/* Find length of initial ASCII in text
+ * Accepts: text
+ *	    size of text
+ * Returns: number of bytes before the first 8-bit byte
+ */
+
+unsigned long utf8_ascii_span (unsigned char *s,unsigned long size)
+{
+  unsigned long i,w;
+				/* high bit of every byte in a word */
+  unsigned long m = ((unsigned long) ~0 / 0xff) * BIT8;
+				/* test a word at a time */
+  for (i = 0; (i + sizeof (w)) <= size; i += sizeof (w)) {
+    memcpy (&w,s + i,sizeof (w));
+    if (w & m) break;		/* an 8-bit byte in this word */
+  }
+  while ((i < size) && !(s[i] & BIT8)) i++;
+  return i;
+}
+
 /* Convert EUC sized text to UTF-8
  * Accepts: source sized text
  *	    pointer to return sized text
@@ -1314,12 +1418,14 @@ void utf8_searchpgm (SEARCHPGM *pgm,char *charset)
     utf8_stringlist (pgm->to,charset);
     utf8_stringlist (pgm->subject,charset);
     for (hl = pgm->header; hl; hl = hl->next) {
-      if (utf8_text (&hl->line,charset,&txt,NIL)) {
+      if (utf8_text (&hl->line,charset,&txt,NIL) &&
+	  (txt.data != hl->line.data)) {
 	fs_give ((void **) &hl->line.data);
 	hl->line.data = txt.data;
 	hl->line.size = txt.size;
       }
-      if (utf8_text (&hl->text,charset,&txt,NIL)) {
+      if (utf8_text (&hl->text,charset,&txt,NIL) &&
+	  (txt.data != hl->text.data)) {
 	fs_give ((void **) &hl->text.data);
 	hl->text.data = txt.data;
 	hl->text.size = txt.size;
@@ -1345,7 +1451,8 @@ void utf8_stringlist (STRINGLIST *st,char *charset)
 {
   SIZEDTEXT txt;
 				/* convert entire stringstruct */
-  if (st) do if (utf8_text (&st->text,charset,&txt,NIL)) {
+  if (st) do if (utf8_text (&st->text,charset,&txt,NIL) &&
+		 (txt.data != st->text.data)) {
     fs_give ((void **) &st->text.data);
     st->text.data = txt.data; /* transfer this text */
     st->text.size = txt.size;
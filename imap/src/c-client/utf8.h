@@ -402,6 +402,21 @@ typedef struct utf8_csent {
 } CHARSET;
 
 
+/* Single-byte charset to UTF-8 map */
+
+typedef struct utf8_bytemap {
+  struct utf8_bytemap *next;	/* next map */
+  unsigned long type;		/* type of charset */
+  void *tab;			/* conversion table mapped */
+  unsigned int ascii : 1;	/* ASCII maps to itself */
+  unsigned char size[256];	/* size of each byte's UTF-8 */
+  unsigned char utf8[256][3];	/* each byte's UTF-8 */
+} UTF8BYTEMAP;
+
+
+#define UTF8CSHASH 251		/* charset name hash table size */
+
+
 struct utf8_eucparam {
   unsigned int base_ku : 8;	/* base row */
   unsigned int base_ten : 8;	/* base column */
@@ -440,6 +455,7 @@ struct utf8_eucparam {
 
 SCRIPT *utf8_script (char *script);
 CHARSET *utf8_charset (char *charset);
+unsigned long utf8_charset_hash (char *charset);
 long utf8_text (SIZEDTEXT *text,char *charset,SIZEDTEXT *ret,long flags);
 unsigned short *utf8_rmap (char *charset);
 long utf8_cstext (SIZEDTEXT *text,char *charset,SIZEDTEXT *ret,
@@ -450,6 +466,9 @@ long utf8_cstocstext (SIZEDTEXT *text,char *sc,SIZEDTEXT *ret,char *dc,
 void utf8_text_1byte0 (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab);
 void utf8_text_1byte (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab);
 void utf8_text_1byte8 (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab);
+UTF8BYTEMAP *utf8_bytemap (unsigned long type,void *tab);
+void utf8_text_bytemap (SIZEDTEXT *text,SIZEDTEXT *ret,UTF8BYTEMAP *map);
+unsigned long utf8_ascii_span (unsigned char *s,unsigned long size);
 void utf8_text_euc (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab);
 void utf8_text_dbyte (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab);
 void utf8_text_dbyte2 (SIZEDTEXT *text,SIZEDTEXT *ret,void *tab);
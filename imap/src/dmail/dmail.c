@@ -25,6 +25,7 @@ extern int errno;		/* just in case */
 #include <sysexits.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "mail.h"
 #include "osdep.h"
 #include "misc.h"
@@ -39,6 +40,7 @@ int flagseen = NIL;		/* flag message as seen */
 int trycreate = NIL;		/* flag saying gotta create before appending */
 int critical = NIL;		/* flag saying in critical code */
 char *sender = NIL;		/* message origin */
+char *msgtext = NIL;		/* mapped message text */
 
 
 /* Function prototypes */
@@ -183,10 +185,15 @@ int main (int argc,char *argv[])
   }
   msglen = ftell (f);		/* size of message */
   fflush (f);			/* make sure all changes written out */
+				/* deliver from memory if possible */
+  if (msglen && ((msgtext = (char *) mmap (NIL,msglen,PROT_READ,MAP_PRIVATE,
+					   fileno (f),0)) == (char *) MAP_FAILED))
+    msgtext = NIL;
   if (ferror (f)) ret = fail ("error writing temp file",EX_TEMPFAIL);
   else if (!msglen) ret = fail ("empty message",EX_TEMPFAIL);
 				/* single delivery */
   else ret = deliver (f,msglen,argc ? *argv : myusername ());
+  if (msgtext) munmap (msgtext,msglen);
   fclose (f);			/* all done with temporary file */
   _exit (ret);			/* normal exit */
   return 0;			/* stupid gcc */
@@ -217,7 +224,8 @@ int deliver (FILE *f,unsigned long msglen,char *user)
   sprintf (tmp,"delivering to %.80s+%.80s",user,mailbox ? mailbox : "INBOX");
   mm_dlog (tmp);
 				/* prepare stringstruct */
-  INIT (&st,file_string,(void *) f,msglen);
+  if (msgtext) INIT (&st,mail_string,(void *) msgtext,msglen);
+  else INIT (&st,file_string,(void *) f,msglen);
   if (mailbox) {		/* non-INBOX name */
     switch (mailbox[0]) {	/* make sure a valid name */
     default:			/* other names, try to deliver if not INBOX */
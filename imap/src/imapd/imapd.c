@@ -49,6 +49,8 @@ extern int errno;		/* just in case */
 #define LITSTKLEN 20		/* length of literal stack */
 #define MAXCLIENTLIT 10000	/* maximum non-APPEND client literal size */
 #define CMDLEN 65536		/* size of command buffer */
+#define SEARCHCACHELEN 16777216	/* size of decoded search text cache */
+#define SORTCACHEDIR ".imapsort"	/* per-user directory of sort keys */
 
 
 /* Server states */
@@ -98,6 +100,8 @@ typedef struct msg_data {
 
 int main (int argc,char *argv[]);
 void ping_mailbox (unsigned long uid);
+long idle_wait (long seconds,unsigned long uid,long *watched);
+char *idle_file (char *tmp);
 time_t palert (char *file,time_t oldtime);
 void msg_string_init (STRING *s,void *data,unsigned long size);
 char msg_string_next (STRING *s);
@@ -275,6 +279,12 @@ int main (int argc,char *argv[])
   mail_parameters (NIL,SET_MAILPROXYCOPY,(void *) proxycopy);
 				/* arm referral callback */
   mail_parameters (NIL,SET_IMAPREFERRAL,(void *) referral);
+				/* keep decoded text for repeated searches */
+  mail_parameters (NIL,SET_SEARCHCACHE,(void *) SEARCHCACHELEN);
+				/* keep sort keys across sessions */
+  mail_parameters (NIL,SET_SORTCACHEDIR,(void *) SORTCACHEDIR);
+				/* parse each message into one arena */
+  mail_parameters (NIL,SET_PARSEARENA,(void *) T);
 
   if (stat (SHUTDOWNFILE,&sbuf)) {
     char proxy[MAILTMPLEN];
@@ -1111,6 +1121,7 @@ int main (int argc,char *argv[])
 	  if (arg) response = badarg;
 	  else {		/* tell client ready for argument */
 	    unsigned long donefake = 0;
+	    long watched = NIL;
 	    PSOUT ("+ Waiting for DONE\015\012");
 	    PFLUSH ();		/* dump output buffer */
 				/* maybe do a checkpoint if not anonymous */
@@ -1124,7 +1135,11 @@ int main (int argc,char *argv[])
 				/* inactivity countdown */
 	    i = ((TIMEOUT) / (IDLETIMER)) + 1;
 	    do {		/* main idle loop */
-	      if (!donefake) {	/* don't ping mailbox if faking */
+				/* don't ping mailbox if faking or if
+				 * changes to it wake us up anyway */
+	      if (!(donefake || watched)) {
+				/* watch it first so no change is missed */
+		watched = server_watch_file (idle_file (tmp));
 		mail_parameters (stream,SET_ONETIMEEXPUNGEATPING,
 				 (void *) stream);
 		ping_mailbox (uid);
@@ -1147,7 +1162,9 @@ int main (int argc,char *argv[])
 		PSOUT (tmp);	/* prod client to wake up */
 	      }
 	      PFLUSH ();	/* dump output buffer */
-	    } while ((state != LOGOUT) && !INWAIT (IDLETIMER) && --i);
+	    } while ((state != LOGOUT) &&
+		     !(donefake ? INWAIT (IDLETIMER) :
+		       idle_wait (IDLETIMER,uid,&watched)) && --i);
 				/* time to exit idle loop */
 	    if (state != LOGOUT) {
 	      if (i) {		/* still have time left? */
@@ -1351,6 +1368,52 @@ void ping_mailbox (unsigned long uid)
   }
 }
 
+/* Wait for input while idling, reporting mailbox changes as they happen
+ * Accepts: timeout in seconds
+ *	    last command was UID flag
+ *	    pointer to flag that mailbox is watched, cleared if watch lost
+ * Returns: T if have input, else NIL
+ *
+ * For local mailboxes the mailbox file is watched, so that new mail is
+ * announced as soon as it is delivered instead of at the next timer tick.
+ */
+
+long idle_wait (long seconds,unsigned long uid,long *watched)
+{
+  char tmp[MAILTMPLEN];
+  time_t limit = time (0) + seconds;
+  time_t now;
+  long ret;
+  do {				/* may already have buffered input */
+    if (INWAIT (0)) return LONGT;
+    now = time (0);
+    if ((ret = server_input_wait_file ((now < limit) ? limit - now : 1,
+				       *watched ? idle_file (tmp) : NIL)) >= 0)
+      return ret;
+				/* mailbox changed, watch it again */
+    *watched = server_watch_file (idle_file (tmp));
+				/* and report the change now */
+    mail_parameters (stream,SET_ONETIMEEXPUNGEATPING,(void *) stream);
+    ping_mailbox (uid);
+    PFLUSH ();
+  } while ((state == OPEN) && (time (0) < limit));
+  return NIL;
+}
+
+
+/* Get file to watch while idling
+ * Accepts: temporary buffer
+ * Returns: mailbox file name, or NIL if not a local mailbox
+ */
+
+char *idle_file (char *tmp)
+{
+  char *file;
+  if ((state != OPEN) || !(stream->dtb->flags & DR_LOCAL) ||
+      !(file = mailboxfile (tmp,stream->mailbox))) return NIL;
+  return *file ? file : sysinbox ();
+}
+
 /* Print an alert file
  * Accepts: path of alert file
  *	    time of last printed alert file
@@ -3329,10 +3392,20 @@ void ptext (SIZEDTEXT *txt)
    * IMAP by sending NULs, corrupting the data, or going to lots of work to do
    * MIME conversion in the IMAP server.
    */
-  unsigned char c;
+  SIZEDTEXT run;
   unsigned char *s = txt->data;
   unsigned char *t = s + txt->size;
-  while ((s < t) && ((PBOUT ((c = *s++) ? c : 0x80) != EOF)));
+  unsigned char *z;
+  while (s < t) {		/* output NUL-free runs as records */
+    if (!(z = (unsigned char *) memchr (s,'\0',t - s))) z = t;
+    run.data = s;
+    run.size = z - s;
+    if (run.size && (PSOUTR (&run) == EOF)) break;
+    if ((s = z) < t) {		/* substitute for the NUL */
+      if (PBOUT (0x80) == EOF) break;
+      s++;
+    }
+  }
   if (s == t) return;		/* check for completion */
   alarm (0);			/* disable all interrupts */
   server_init (NIL,NIL,NIL,SIG_IGN,SIG_IGN,SIG_IGN,SIG_IGN);
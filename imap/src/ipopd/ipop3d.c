@@ -40,6 +40,7 @@ extern int errno;		/* just in case */
 
 /* Size of temporary buffers */
 #define TMPLEN 1024
+#define BLATLEN 16384
 
 
 /* Server states */
@@ -55,6 +56,16 @@ extern int errno;		/* just in case */
 #define SLEN (sizeof (STATUS)-3)
 
 
+/* Dot checking output state */
+
+typedef struct blat_data {
+  long lines;			/* maximum lines if greater than zero */
+  unsigned long size;		/* octets remaining to output */
+  long ret;			/* number of lines output */
+  int bol;			/* non-zero if at beginning of line */
+} BLATDATA;
+
+
 /* Global storage */
 
 char *version = "2004.89";	/* server version */
@@ -74,6 +85,7 @@ char *initial = NIL;		/* initial response */
 long *msg = NIL;		/* message translation vector */
 logouthook_t lgoh = NIL;	/* logout hook */
 char *sayonara = "+OK Sayonara\015\012";
+BLATDATA blatdata;		/* message text output state */
 
 
 /* Function prototypes */
@@ -88,6 +100,10 @@ char *apop_login (char *chal,char *user,char *md5,int argc,char *argv[]);
 char *responder (void *challenge,unsigned long clen,unsigned long *rlen);
 int mbxopen (char *mailbox);
 long blat (char *text,long lines,unsigned long size);
+void blat_init (BLATDATA *bd,long lines,unsigned long size);
+void blat_run (BLATDATA *bd,char *text,unsigned long len);
+long blattext (unsigned long msgno,long lines,long flags);
+char *blatgets (readfn_t f,void *stream,unsigned long size,GETS_DATA *md);
 void rset ();
 
 /* Main program */
@@ -348,9 +364,7 @@ int main (int argc,char *argv[])
 		       elt->recent ? " " : "O");
 	      PSOUT (tmp);
 	      CRLF;		/* delimit header and text */
-				/* output text */
-	      t = mail_fetch_text (stream,msg[i],NIL,&k,NIL);
-	      blat (t,-1,k);
+	      blattext (msg[i],-1,NIL);
 	      CRLF;		/* end of list */
 	      PBOUT ('.');
 	      CRLF;
@@ -407,10 +421,8 @@ int main (int argc,char *argv[])
 	      PSOUT (tmp);
 	      CRLF;		/* delimit header and text */
 	      if (j) {		/* want any text lines? */
-				/* output text */
-		t = mail_fetch_text (stream,msg[i],NIL,&k,FT_PEEK);
 				/* tie off final line if full text output */
-		if (j -= blat (t,j,k)) CRLF;
+		if (j -= blattext (msg[i],j,FT_PEEK)) CRLF;
 	      }
 	      PBOUT ('.');	/* end of list */
 	      CRLF;
@@ -726,23 +738,101 @@ int mbxopen (char *mailbox)
 
 long blat (char *text,long lines,unsigned long size)
 {
-  char c,d,e;
-  long ret = 0;
-				/* no-op if zero lines or empty string */
-  if (!(lines && (size-- > 2))) return 0;
-  c = *text++; d = *text++;	/* collect first two bytes */
-  if (c == '.') PBOUT ('.');	/* double string-leading dot if necessary */
-  while (lines && --size) {	/* copy loop */
-    e = *text++;		/* get next byte */
-    PBOUT (c);			/* output character */
-    if (c == '\012') {		/* end of line? */
-      ret++; --lines;		/* count another line */
-				/* double leading dot as necessary */
-      if (lines && size && (d == '.')) PBOUT ('.');
+  BLATDATA bd;
+  blat_init (&bd,lines,size);
+  blat_run (&bd,text,size);
+  return bd.ret;
+}
+
+
+/* Initialize dot checking output state
+ * Accepts: output state
+ *	    maximum number of lines if greater than zero
+ *	    size of string
+ */
+
+void blat_init (BLATDATA *bd,long lines,unsigned long size)
+{
+  bd->lines = lines;
+  bd->size = (size > 2) ? size - 2 : 0;
+  bd->ret = 0;
+  bd->bol = T;			/* string starts at beginning of line */
+}
+
+/* Blat a chunk of string with dot checking
+ * Accepts: output state
+ *	    chunk of string
+ *	    size of chunk
+ *
+ * Output is written in runs; a run only ends at a line which starts with a
+ * dot, when the line limit is reached, or at the end of the chunk.
+ */
+
+void blat_run (BLATDATA *bd,char *text,unsigned long len)
+{
+  SIZEDTEXT run;
+  char *s,*t,*e;
+  while (len && bd->size && bd->lines) {
+				/* double line-leading dot */
+    if (bd->bol && (*text == '.')) PBOUT ('.');
+    bd->bol = NIL;
+    e = text + min (len,bd->size);
+    for (s = text; (s < e) && (t = memchr (s,'\012',e - s)); s = t) {
+      bd->ret++;		/* count another line */
+      t++;			/* skip past newline */
+				/* end run if limit, end of chunk, or dot */
+      if (!--bd->lines || (t == e) || (*t == '.')) {
+	bd->bol = T;
+	e = t;
+      }
     }
-    c = d; d = e;		/* move to next character */
+    run.data = (unsigned char *) text;
+    run.size = e - text;
+    PSOUTR (&run);		/* output the run */
+    text = e;
+    len -= run.size;
+    bd->size -= run.size;
+  }
+}
+
+/* Blat message text with dot checking
+ * Accepts: message number
+ *	    maximum number of lines if greater than zero
+ *	    fetch flags
+ * Returns: number of lines output
+ *
+ * The text is streamed from the driver in chunks rather than fetched whole.
+ */
+
+long blattext (unsigned long msgno,long lines,long flags)
+{
+  void *gets = mail_parameters (NIL,GET_GETS,NIL);
+  blat_init (&blatdata,lines,0);/* in case no text */
+  mail_parameters (NIL,SET_GETS,(void *) blatgets);
+  mail_partial_text (stream,msgno,NIL,0,0,flags);
+  mail_parameters (NIL,SET_GETS,gets);
+  return blatdata.ret;
+}
+
+
+/* Mailgets routine to blat message text
+ * Accepts: readin function
+ *	    stream
+ *	    size of text
+ *	    gets data packet
+ * Returns: NIL, always
+ */
+
+char *blatgets (readfn_t f,void *stream,unsigned long size,GETS_DATA *md)
+{
+  char tmp[BLATLEN];
+  unsigned long i;
+  blat_init (&blatdata,blatdata.lines,size);
+  for (; size; size -= i) {	/* read and output each chunk */
+    (*f) (stream,i = min (size,(unsigned long) BLATLEN),tmp);
+    blat_run (&blatdata,tmp,i);
   }
-  return ret;
+  return NIL;
 }
 
 
@@ -22,9 +22,12 @@
 #include <stdio.h>
 #include <errno.h>
 extern int errno;		/* just in case */
+#include <sys/time.h>
+#include <sys/wait.h>
 #include "mail.h"
 #include "osdep.h"
 #include "misc.h"
+#include "mbx.h"
 #include "linkage.h"
 
 /* Globals */
@@ -36,6 +39,7 @@ int critical = NIL;		/* flag saying in critical code */
 int trycreate = NIL;		/* [TRYCREATE] seen */
 char *suffix = NIL;		/* suffer merge mode suffix text */
 int ddelim = -1;		/* destination delimiter */
+int jobs = 1;			/* number of parallel transfer workers */
 FILE *f = NIL;
 
 /* Merge modes */
@@ -53,8 +57,11 @@ void ms_setpos (STRING *s,unsigned long i);
 int main (int argc,char *argv[]);
 int mbxcopy (MAILSTREAM *source,MAILSTREAM *dest,char *dst,int create,int del,
 	     int mode);
+int mbxcreate (MAILSTREAM *dest,char *dst,char **ndst,int mode);
 long mm_append (MAILSTREAM *stream,void *data,char **flags,char **date,
 		STRING **message);
+int workerwait (int *running);
+double clocktime (void);
 
 
 /* Append package */
@@ -66,6 +73,10 @@ typedef struct append_package {
   char *flags;			/* current flags */
   char *date;			/* message internal date */
   STRING *message;		/* stringstruct of message */
+  unsigned long bytes;		/* message bytes appended so far */
+  unsigned long total;		/* total message bytes to append */
+  double start;			/* time append started */
+  double tick;			/* time of last progress report */
 } APPENDPACKAGE;
 
 
@@ -148,7 +159,8 @@ int main (int argc,char *argv[])
   SEARCHPGM *criteria;
   char c,*s,**args,*dp,*t,*t1,tmp[MAILTMPLEN],mbx[MAILTMPLEN];
   unsigned long m,len,curlen,start,last;
-  int nargs,i;
+  int nargs,i,running;
+  pid_t pid;
   int merge = NIL;
   int ret = 1;
   char *cmd = NIL;
@@ -161,6 +173,13 @@ int main (int argc,char *argv[])
       if (!strcmp (s,"-debug") || !strcmp (s,"-d")) debugp = T;
       else if (!strcmp (s,"-verbose") || !strcmp (s,"-v")) verbosep = T;
       else if (!strcmp (s,"-rwcopy") || !strcmp (s,"-rw")) rwcopyp = T;
+      else if ((nargs > 1) && (!strcmp (s,"-jobs") || !strcmp (s,"-j"))) {
+	args++,nargs--;		/* advance to next argument */
+	if ((jobs = atoi (s = *args)) < 1) {
+	  printf ("bad number of jobs: %s\n",s);
+	  exit (ret);
+	}
+      }
       else if ((nargs > 1) && (!strcmp (s,"-merge") || !strcmp (s,"-m"))) {
 	args++,nargs--;		/* advance to next argument */
 	if (!strcmp (s = *args,"prompt")) merge = mPROMPT;
@@ -289,9 +308,45 @@ int main (int argc,char *argv[])
     }
   }
 
+  else if (!strcmp (cmd,"compact")) {
+    if (!src || dst || merge || rwcopyp)
+      printf ("usage: %s compact [-debug] [-verbose] mailbox\n",pgm);
+    else if (!(source = mail_open (NIL,src,(debugp ? OP_DEBUG : NIL))));
+    else if (strcmp (source->dtb->name,"mbx"))
+      printf ("%s is a %s mailbox, only mbx mailboxes can be compacted\n",
+	      src,source->dtb->name);
+    else {
+      unsigned long steps,moved,reclaimed;
+      double secs = clocktime ();
+      long status;
+      m = source->nmsgs;	/* get number of messages before compaction */
+				/* move messages a step at a time */
+      for (steps = moved = reclaimed = 0;
+	   (status = mbx_compact (source,MBXCOMPACTSTEP,&len,&curlen,
+				  CX_EXPUNGE|CX_WHOLE)) >= 0;
+	   ) {
+	steps++;
+	moved += len;
+	reclaimed += curlen;
+	if (verbosep) {
+	  printf ("step %lu: %lu bytes moved\n",steps,len);
+	  fflush (stdout);
+	}
+	if (!status) break;	/* all done */
+      }
+      secs = clocktime () - secs;
+      printf ("%lu message(s) expunged, %lu bytes moved in %lu step(s), "
+	      "%lu bytes reclaimed\n",m - source->nmsgs,moved,steps,reclaimed);
+      printf ("%.2f seconds, %.2f MB/s\n",secs,
+	      (secs > 0) ? moved / (secs * 1048576) : 0);
+      if (status < 0) puts ("mailbox in use by another process, run again later");
+      else ret = 0;
+    }
+  }
+
   else if (!strcmp (cmd,"transfer")) {
     if (!src || !dst)
-      printf ("usage: %s transfer [-debug] [-verbose] source destination\n",
+      printf ("usage: %s transfer [-debug] [-verbose] [-jobs n] source destination\n",
 	      pgm);
     else if ((*src == '{') &&	/* open source mailbox */
 	     !(source = mail_open (NIL,src,OP_HALFOPEN |
@@ -319,6 +374,12 @@ int main (int argc,char *argv[])
       else strcpy (tmp,src);
       mail_list (source,tmp,"*");
       rewind (f);
+				/* workers can't share network sessions */
+      if ((jobs > 1) && (source || dest)) {
+	puts ("warning: -jobs ignored for network mailboxes");
+	jobs = 1;
+      }
+      running = 0;		/* no workers yet */
 				/* read back mailbox names */
       while (ret && (fgets (tmp,MAILTMPLEN-1,f))) {
 	if (t = strchr (tmp+1,'\n')) *t = '\0';
@@ -341,13 +402,41 @@ int main (int argc,char *argv[])
 	  printf ("Copying %s\n  => %s\n",tmp+1,mbx);
 	  fflush (stdout);
 	}
-	if (source = mail_open (source,tmp+1,(debugp ? OP_DEBUG : NIL) | 
-				(rwcopyp ? NIL : OP_READONLY))) {
+	if (jobs > 1) {		/* hand mailbox to a worker process */
+	  if ((running == jobs) && !workerwait (&running)) ret = NIL;
+				/* create here so workers don't race */
+	  else if (!mbxcreate (dest,mbx,&t1,merge)) ret = NIL;
+	  else if ((pid = fork ()) < 0) {
+	    puts ("can't fork transfer worker");
+	    ret = NIL;
+	  }
+	  else if (pid) {	/* parent just counts the worker */
+	    if (t1) fs_give ((void **) &t1);
+	    running++;
+	  }
+	  else {		/* worker copies this one mailbox */
+	    if (!(source = mail_open (NIL,tmp+1,(debugp ? OP_DEBUG : NIL) |
+				      (rwcopyp ? NIL : OP_READONLY)))) {
+	      printf ("can't open source mailbox %s\n",tmp+1);
+	      i = NIL;
+	    }
+	    else {
+	      i = mbxcopy (source,dest,t1 ? t1 : mbx,NIL,NIL,merge);
+	      mail_close (source);
+	    }
+	    fflush (stdout);	/* don't let exit() touch the shared list */
+	    _exit (i ? 0 : 1);
+	  }
+	}
+	else if (source = mail_open (source,tmp+1,(debugp ? OP_DEBUG : NIL) | 
+				     (rwcopyp ? NIL : OP_READONLY))) {
 	  ret = mbxcopy (source,dest,mbx,T,NIL,merge);
 	  if (source->dtb->flags & DR_LOCAL) source = mail_close (source);
 	}
 	else printf ("can't open source mailbox %s\n",tmp+1);
       }
+				/* wait for remaining workers */
+      while (running) if (!workerwait (&running)) ret = NIL;
     }
   }
 
@@ -367,9 +456,12 @@ int main (int argc,char *argv[])
     printf ("       %s prune [-debug] [-verbose] mailbox search_criteria\n",
 	    pgm);
     puts   ("        ;; prune mailbox of messages matching criteria");
-    printf ("       %s transfer [-debug] [-verbose] [-merge mode] source destination\n",pgm);
+    printf ("       %s compact [-debug] [-verbose] mailbox\n",pgm);
+    puts   ("        ;; expunge and reclaim space in mbx mailbox a step at a time");
+    printf ("       %s transfer [-debug] [-verbose] [-merge mode] [-jobs n] source destination\n",pgm);
     puts   ("        ;; make copy of source hierarchy to destination");
     puts   ("        ;;  -merge modes are prompt, append, or suffix=xxxx");
+    puts   ("        ;;  -jobs copies up to n local mailboxes in parallel");
   }
 				/* close streams */
   if (source) mail_close (source);
@@ -391,35 +483,16 @@ int main (int argc,char *argv[])
 int mbxcopy (MAILSTREAM *source,MAILSTREAM *dest,char *dst,int create,int del,
 	     int mode)
 {
-  char *s,tmp[MAILTMPLEN];
+  char tmp[MAILTMPLEN];
+  unsigned long i;
+  double secs;
   APPENDPACKAGE ap;
   STRING st;
   char *ndst = NIL;
   int ret = NIL;
   trycreate = NIL;		/* no TRYCREATE yet */
-  if (create) while (!mail_create (dest,dst) && (mode != mAPPEND)) {
-    switch (mode) {
-    case mPROMPT:		/* prompt user for new name */
-      tmp[0] = '\0';
-      while (!tmp[0]) {		/* read name */
-	fputs ("alternative name: ",stdout);
-	fflush (stdout);
-	fgets (tmp,MAILTMPLEN-1,stdin);
-	if (s = strchr (tmp,'\n')) *s = '\0';
-      }
-      if (ndst) fs_give ((void **) &ndst);
-      ndst = cpystr (tmp);
-      break;
-    case mSUFFIX:		/* try again with new suffix */
-      if (ndst) fs_give ((void **) &ndst);
-      sprintf (ndst = (char *) fs_get (strlen (dst) + strlen (suffix) + 1),
-	       "%s%s",dst,suffix);
-      printf ("retry to create %s\n",ndst);
-      mode = mPROMPT;		/* switch to prompt mode if name fails */
-      break;
-    case NIL:			/* not merging */
-      return NIL;
-    }
+  if (create) {			/* create destination, maybe under new name */
+    if (!mbxcreate (dest,dst,&ndst,mode)) return NIL;
     if (ndst) dst = ndst;	/* if alternative name given, use it */
   }
   if (source->nmsgs) {		/* non-empty source */
@@ -433,9 +506,18 @@ int mbxcopy (MAILSTREAM *source,MAILSTREAM *dest,char *dst,int create,int del,
 				/* make sure we have all messages */
     sprintf (tmp,"1:%lu",ap.msgmax);
     mail_fetchfast (source,tmp);
+				/* total size for progress reports */
+    for (i = 1,ap.bytes = ap.total = 0; i <= ap.msgmax; i++)
+      ap.total += mail_elt (source,i)->rfc822_size;
+    ap.start = ap.tick = clocktime ();
     if (mail_append_multiple (dest,dst,mm_append,(void *) &ap)) {
       --ap.msgno;		/* make sure user knows it won */
-      if (verbosep) printf ("[Ok %lu messages(s)]\n",ap.msgno);
+      if (verbosep) {
+	secs = clocktime () - ap.start;
+	printf ("[Ok %lu messages(s) => %s, %.1f MB in %.1f sec, %.2f MB/s]\n",
+		ap.msgno,dst,ap.bytes / 1048576.0,secs,
+		(secs > 0) ? ap.bytes / (secs * 1048576) : 0);
+      }
       if (del && ap.msgno) {	/* delete source messages */
 	sprintf (tmp,"1:%lu",ap.msgno);
 	mail_flag (source,tmp,"\\Deleted",ST_SET);
@@ -455,6 +537,47 @@ int mbxcopy (MAILSTREAM *source,MAILSTREAM *dest,char *dst,int create,int del,
   if (ndst) fs_give ((void **) &ndst);
   return ret;
 }
+
+
+/* Create destination mailbox
+ * Accepts: halfopen stream for destination or NIL
+ *	    destination mailbox name
+ *	    pointer to return alternative name if one was used
+ *	    merge mode
+ * Returns: T if success, NIL if error
+ */
+
+int mbxcreate (MAILSTREAM *dest,char *dst,char **ndst,int mode)
+{
+  char *s,tmp[MAILTMPLEN];
+  *ndst = NIL;			/* no alternative name yet */
+  while (!mail_create (dest,*ndst ? *ndst : dst) && (mode != mAPPEND)) {
+    switch (mode) {
+    case mPROMPT:		/* prompt user for new name */
+      tmp[0] = '\0';
+      while (!tmp[0]) {		/* read name */
+	fputs ("alternative name: ",stdout);
+	fflush (stdout);
+	fgets (tmp,MAILTMPLEN-1,stdin);
+	if (s = strchr (tmp,'\n')) *s = '\0';
+      }
+      if (*ndst) fs_give ((void **) ndst);
+      *ndst = cpystr (tmp);
+      break;
+    case mSUFFIX:		/* try again with new suffix */
+      if (*ndst) fs_give ((void **) ndst);
+      sprintf (*ndst = (char *) fs_get (strlen (dst) + strlen (suffix) + 1),
+	       "%s%s",dst,suffix);
+      printf ("retry to create %s\n",*ndst);
+      mode = mPROMPT;		/* switch to prompt mode if name fails */
+      break;
+    case NIL:			/* not merging */
+      if (*ndst) fs_give ((void **) ndst);
+      return NIL;
+    }
+  }
+  return T;
+}
 
 /* Append callback
  * Accepts: mail stream
@@ -470,12 +593,26 @@ long mm_append (MAILSTREAM *stream,void *data,char **flags,char **date,
 {
   char *t,*t1,tmp[MAILTMPLEN];
   unsigned long u;
+  double now,rate;
   MESSAGECACHE *elt;
   APPENDPACKAGE *ap = (APPENDPACKAGE *) data;
   *flags = *date = NIL;		/* assume no flags or date */
   if (ap->flags) fs_give ((void **) &ap->flags);
   if (ap->date) fs_give ((void **) &ap->date);
   mail_gc (ap->stream,GC_TEXTS);
+				/* count previous message as done */
+  if (ap->msgno && (ap->msgno <= ap->msgmax))
+    ap->bytes += mail_elt (ap->stream,ap->msgno)->rfc822_size;
+				/* progress report once a second */
+  if (verbosep && (jobs == 1) && ((now = clocktime ()) - ap->tick >= 1) &&
+      (rate = ap->bytes / (now - ap->start))) {
+    u = (unsigned long) ((ap->total - ap->bytes) / rate);
+    printf ("  %lu/%lu message(s), %.1f/%.1f MB, %.2f MB/s, ETA %lu:%02lu\n",
+	    ap->msgno,ap->msgmax,ap->bytes / 1048576.0,ap->total / 1048576.0,
+	    rate / 1048576,u / 60,u % 60);
+    fflush (stdout);
+    ap->tick = now;
+  }
   if (++ap->msgno <= ap->msgmax) {
 				/* initialize flag string */
     memset (t = tmp,0,MAILTMPLEN);
@@ -501,6 +638,34 @@ long mm_append (MAILSTREAM *stream,void *data,char **flags,char **date,
   return LONGT;
 }
 
+/* Wait for a transfer worker to finish
+ * Accepts: pointer to number of running workers
+ * Returns: T if worker succeeded, NIL if it failed
+ */
+
+int workerwait (int *running)
+{
+  int status;
+  if (wait (&status) < 0) {	/* no children left?? */
+    *running = 0;
+    return NIL;
+  }
+  --*running;			/* one less worker */
+  return (WIFEXITED (status) && !WEXITSTATUS (status)) ? T : NIL;
+}
+
+
+/* Current time
+ * Returns: seconds since the epoch, with microseconds
+ */
+
+double clocktime (void)
+{
+  struct timeval tv;
+  gettimeofday (&tv,NIL);
+  return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
 /* Co-routines from MAIL library */
 
 
@@ -427,6 +427,28 @@ long server_input_wait (long seconds)
   tmo.tv_sec = seconds; tmo.tv_usec = 0;
   return select (1,&rfd,0,&efd,&tmo) ? LONGT : NIL;
 }
+
+/* Wait for stdin input or a change to a file
+ * Accepts: timeout in seconds
+ *	    file to watch (ignored, no change notification)
+ * Returns: T if have input on stdin, else NIL
+ */
+
+long server_input_wait_file (long seconds,char *file)
+{
+  return server_input_wait (seconds);
+}
+
+
+/* Watch a file for server_input_wait_file()
+ * Accepts: file to watch
+ * Returns: NIL, no change notification
+ */
+
+long server_watch_file (char *file)
+{
+  return NIL;
+}
 
 /* Return Amiga password entry for user name
  * Accepts: user name string
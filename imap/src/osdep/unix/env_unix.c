@@ -21,6 +21,11 @@
 #include <grp.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <sys/vfs.h>
+#endif
 
 /* c-client environment parameters */
 
@@ -60,6 +65,10 @@ static short netfsstatbug = NIL;/* compensate for broken stat() on network
 				 * filesystems (AFS and old NFS).  Don't do
 				 * this unless you really have to!
 				 */
+				/* skip pings of unchanged local mailboxes */
+static short changenotify = NIL;
+static long prefetchwindow = 0;	/* message files to open ahead */
+static char *sortcachedir = NIL;/* directory of persistent sort keys */
 
 				/* allow user config files */
 static short allowuserconfig = NIL;
@@ -136,6 +145,9 @@ static NAMESPACE nslimited = {"#shared/",'/',NIL,&nspublic};
 #include "crexcl.c"		/* include exclusive create */
 #include "pmatch.c"		/* include wildcard pattern matcher */
 
+static int notify_fd (void);
+static long notify_pending (void);
+
 /* Get all authenticators */
 
 #include "auths.c"
@@ -334,6 +346,28 @@ void *env_parameters (long function,void *value)
   case GET_NETFSSTATBUG:
     ret = (void *) (netfsstatbug ? VOIDT : NIL);
     break;
+  case SET_CHANGENOTIFY:
+    changenotify = value ? T : NIL;
+  case GET_CHANGENOTIFY:
+    ret = (void *) (changenotify ? VOIDT : NIL);
+    break;
+  case GET_NOTIFYFD:
+    if ((*(int *) value = notify_fd ()) >= 0) ret = VOIDT;
+    break;
+  case GET_NOTIFYCHECK:
+    ret = (void *) (notify_pending () ? VOIDT : NIL);
+    break;
+  case SET_PREFETCHWINDOW:
+    prefetchwindow = (long) value;
+  case GET_PREFETCHWINDOW:
+    ret = (void *) prefetchwindow;
+    break;
+  case SET_SORTCACHEDIR:
+    if (sortcachedir) fs_give ((void **) &sortcachedir);
+    if (value) sortcachedir = cpystr ((char *) value);
+  case GET_SORTCACHEDIR:
+    ret = (void *) sortcachedir;
+    break;
   case SET_BLOCKNOTIFY:
     mailblocknotify = (blocknotify_t) value;
   case GET_BLOCKNOTIFY:
@@ -486,7 +520,581 @@ long server_input_wait (long seconds)
   tmo.tv_sec = seconds; tmo.tv_usec = 0;
   return select (1,&rfd,0,&efd,&tmo) ? LONGT : NIL;
 }
-
+
+/* Change notification for local mailboxes
+ *
+ * All streams share one inotify descriptor.  Each watch entry records
+ * whether an event arrived since its stream last asked; streams without
+ * a working watch always report a change, so the drivers fall back to
+ * their stat() checks.  Files on network filesystems are never watched,
+ * since no events are delivered for changes made by other clients.
+ *
+ * The server's own watch for server_input_wait_file() is an entry with
+ * no stream.  It is kept even when change notification is off.
+ */
+
+#ifdef IN_MODIFY
+#define NOTIFYEVENTS (IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+		      IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct notify_entry {
+  MAILSTREAM *stream;		/* stream owning this watch */
+  char *file;			/* watched file or directory */
+  int wd;			/* watch descriptor, -1 if none */
+  int netfs;			/* on a network filesystem, never watched */
+  int changed;			/* event arrived since last check */
+  struct notify_entry *next;	/* next watch */
+} NOTIFYENTRY;
+
+static NOTIFYENTRY *notifylist = NIL;
+static int notifyfd = -1;	/* shared inotify descriptor */
+
+
+/* See if a file is on a network filesystem
+ * Accepts: file or directory name
+ * Returns: T if on a network filesystem, else NIL
+ *
+ * inotify only reports changes made through this host's kernel, so a
+ * watch there would miss new mail delivered by the file server.
+ */
+
+static long notify_netfs (char *file)
+{
+  struct statfs sfbuf;
+  if (statfs (file,&sfbuf)) return NIL;
+  switch ((unsigned long) sfbuf.f_type) {
+  case 0x6969:			/* NFS */
+  case 0x517b:			/* SMB */
+  case 0xfe534d42:		/* SMB2 */
+  case 0xff534d42:		/* CIFS */
+  case 0x564c:			/* NCP */
+  case 0x73757245:		/* Coda */
+  case 0x5346414f:		/* AFS */
+  case 0x6b414653:		/* kAFS */
+  case 0x00c36400:		/* Ceph */
+  case 0x01021997:		/* 9P */
+  case 0x65735546:		/* FUSE, e.g. sshfs */
+    return LONGT;
+  }
+  return NIL;
+}
+
+
+/* Open change notification descriptor
+ * Returns: descriptor, or -1 if inotify is not available
+ */
+
+static int notify_open (void)
+{
+  if ((notifyfd < 0) && ((notifyfd = inotify_init ()) >= 0)) {
+    fcntl (notifyfd,F_SETFD,FD_CLOEXEC);
+    fcntl (notifyfd,F_SETFL,fcntl (notifyfd,F_GETFL,0) | O_NONBLOCK);
+  }
+  return notifyfd;
+}
+
+
+/* Get change notification descriptor
+ * Returns: descriptor, or -1 if change notification is not available
+ */
+
+static int notify_fd (void)
+{
+  return changenotify ? notify_open () : -1;
+}
+
+
+/* Add a watch entry
+ * Accepts: MAIL stream, or NIL for the server's watch
+ *	    file or directory name
+ * Returns: new entry
+ */
+
+static NOTIFYENTRY *notify_add (MAILSTREAM *stream,char *file)
+{
+  NOTIFYENTRY *n = (NOTIFYENTRY *) memset (fs_get (sizeof (NOTIFYENTRY)),0,
+					   sizeof (NOTIFYENTRY));
+  n->stream = stream;
+  n->file = cpystr (file);
+  n->wd = (n->netfs = notify_netfs (file)) ? -1 :
+    inotify_add_watch (notifyfd,file,NOTIFYEVENTS);
+  n->changed = T;		/* first ping always looks */
+  n->next = notifylist;
+  return notifylist = n;
+}
+
+
+/* Watch a file on behalf of a stream
+ * Accepts: MAIL stream
+ *	    file or directory name
+ */
+
+void notify_watch (MAILSTREAM *stream,char *file)
+{
+				/* nothing to do if not enabled */
+  if (notify_fd () >= 0) notify_add (stream,file);
+}
+
+/* Remove all watches of a stream
+ * Accepts: MAIL stream
+ */
+
+void notify_unwatch (MAILSTREAM *stream)
+{
+  NOTIFYENTRY *n,*m,**p;
+  for (p = &notifylist; n = *p; ) if (n->stream == stream) {
+    *p = n->next;		/* unlink, remove watch if nobody else uses it */
+    for (m = notifylist; m && (m->wd != n->wd); m = m->next);
+    if ((n->wd >= 0) && !m) inotify_rm_watch (notifyfd,n->wd);
+    fs_give ((void **) &n->file);
+    fs_give ((void **) &n);
+  }
+  else p = &n->next;
+}
+
+
+/* Read pending change events
+ * Returns: T if any watch has a change pending, else NIL
+ */
+
+static long notify_pending (void)
+{
+  char buf[4096];
+  struct inotify_event *ev;
+  NOTIFYENTRY *n;
+  long i,j;
+  if (notifyfd >= 0) while ((i = read (notifyfd,buf,sizeof (buf))) > 0)
+    for (j = 0; j < i; j += sizeof (struct inotify_event) + ev->len) {
+      ev = (struct inotify_event *) (buf + j);
+      for (n = notifylist; n; n = n->next)
+	if ((ev->mask & IN_Q_OVERFLOW) || (n->wd == ev->wd)) {
+	  n->changed = T;	/* lost events or this watch fired */
+	  if (ev->mask & IN_IGNORED) n->wd = -1;
+	}
+    }
+  for (n = notifylist; n && !n->changed; n = n->next);
+  return n ? LONGT : NIL;
+}
+
+/* See if a stream's mailbox may have changed
+ * Accepts: MAIL stream
+ * Returns: T if changed or unknown, NIL if definitely unchanged
+ */
+
+long notify_changed (MAILSTREAM *stream)
+{
+  NOTIFYENTRY *n;
+  long ret = NIL;
+  long found = NIL;
+  if (!changenotify) return LONGT;
+  notify_pending ();		/* pick up new events */
+  for (n = notifylist; n; n = n->next) if (n->stream == stream) {
+    found = T;
+    if (n->changed || (n->wd < 0)) ret = T;
+				/* try to get lost watch back */
+    if ((n->wd < 0) && !n->netfs && !(n->netfs = notify_netfs (n->file)))
+      n->wd = inotify_add_watch (notifyfd,n->file,NOTIFYEVENTS);
+    n->changed = NIL;
+  }
+  return found ? ret : LONGT;
+}
+
+
+/* Discard events caused by a stream's own writes
+ * Accepts: MAIL stream
+ */
+
+void notify_reset (MAILSTREAM *stream)
+{
+  NOTIFYENTRY *n;
+  notify_pending ();
+  for (n = notifylist; n; n = n->next)
+    if (n->stream == stream) n->changed = NIL;
+}
+
+/* Find the server's watch entry
+ * Accepts: file or directory name
+ * Returns: entry, or NIL if the server isn't watching that file
+ */
+
+static NOTIFYENTRY *notify_server (char *file)
+{
+  NOTIFYENTRY *n;
+  for (n = notifylist; n && (n->stream || strcmp (n->file,file));
+       n = n->next);
+  return n;
+}
+
+
+/* Watch a file for server_input_wait_file()
+ * Accepts: file or directory to watch
+ * Returns: T if changes to the file will be noticed, else NIL
+ *
+ * Events already queued are discarded, so call this before looking at
+ * the file rather than after.
+ */
+
+long server_watch_file (char *file)
+{
+  NOTIFYENTRY *n;
+  if (!file || (notify_open () < 0)) return NIL;
+  if (!((n = notify_server (file)) && (n->wd >= 0))) {
+    notify_unwatch (NIL);	/* new file or watch lost, start over */
+    if (notify_add (NIL,file)->wd < 0) return NIL;
+  }
+  notify_reset (NIL);		/* discard events already queued */
+  return LONGT;
+}
+
+
+/* Wait for stdin input or a change to a file
+ * Accepts: timeout in seconds
+ *	    file or directory to watch, or NIL
+ * Returns: T if have input on stdin, -1 if the file changed, else NIL
+ *
+ * Events queued since server_watch_file() are reported at once, so a
+ * change made while the caller was looking at the file is not lost.
+ * Falls back to server_input_wait() if the file can't be watched.
+ */
+
+long server_input_wait_file (long seconds,char *file)
+{
+  fd_set rfd,efd;
+  struct timeval tmo;
+  time_t limit = time (0) + seconds;
+  time_t now;
+  NOTIFYENTRY *n;
+  int i;
+  if (!(file && (((n = notify_server (file)) && (n->wd >= 0)) ||
+		 (server_watch_file (file) && (n = notify_server (file))))))
+    return server_input_wait (seconds);
+  while (T) {			/* events for other watches don't count */
+    notify_pending ();
+    if (n->changed || (n->wd < 0)) return -1;
+    FD_ZERO (&rfd);
+    FD_ZERO (&efd);
+    FD_SET (0,&rfd);
+    FD_SET (0,&efd);
+    FD_SET (notifyfd,&rfd);
+    now = time (0);
+    tmo.tv_sec = (now < limit) ? limit - now : 0; tmo.tv_usec = 0;
+    if (!(i = select (notifyfd + 1,&rfd,0,&efd,&tmo))) return NIL;
+    if ((i < 0) || FD_ISSET (0,&rfd) || FD_ISSET (0,&efd)) return LONGT;
+  }
+}
+
+#else
+static int notify_fd (void)
+{
+  return -1;
+}
+
+void notify_watch (MAILSTREAM *stream,char *file)
+{
+}
+
+void notify_unwatch (MAILSTREAM *stream)
+{
+}
+
+static long notify_pending (void)
+{
+  return NIL;
+}
+
+long notify_changed (MAILSTREAM *stream)
+{
+  return LONGT;
+}
+
+void notify_reset (MAILSTREAM *stream)
+{
+}
+
+long server_watch_file (char *file)
+{
+  return NIL;
+}
+
+long server_input_wait_file (long seconds,char *file)
+{
+  return server_input_wait (seconds);
+}
+#endif
+
+/* Open a message file ahead of use
+ * Accepts: prefetch state
+ *	    message file number
+ *	    file name
+ *
+ * The kernel is asked to start reading the file at once, so that the
+ * reads of a whole window of files proceed concurrently instead of one
+ * round trip after the other.  The opens themselves are still done here
+ * one at a time; only the data transfers overlap.
+ */
+
+void prefetch_add (PREFETCH *pf,unsigned long uid,char *file)
+{
+  int fd;
+  if ((fd = open (file,O_RDONLY,NIL)) < 0) return;
+#ifdef POSIX_FADV_WILLNEED
+  posix_fadvise (fd,0,0,POSIX_FADV_WILLNEED);
+#endif
+  if (pf->num == pf->size) {	/* need more room? */
+    if (pf->files) fs_resize ((void **) &pf->files,
+			      (pf->size *= 2) * sizeof (PREFETCHFILE));
+    else pf->files = (PREFETCHFILE *)
+	   fs_get ((pf->size = 16) * sizeof (PREFETCHFILE));
+  }
+  pf->files[pf->num].uid = uid;
+  pf->files[pf->num++].fd = fd;
+}
+
+
+/* Get a message file opened ahead
+ * Accepts: prefetch state
+ *	    message file number
+ * Returns: descriptor, now owned by caller, or -1 if not prefetched
+ */
+
+int prefetch_get (PREFETCH *pf,unsigned long uid)
+{
+  unsigned long i;
+  int fd;
+  for (i = 0; i < pf->num; i++) if (pf->files[i].uid == uid) {
+    fd = pf->files[i].fd;	/* move last entry into the hole */
+    pf->files[i] = pf->files[--pf->num];
+    return fd;
+  }
+  return -1;
+}
+
+
+/* Close all message files opened ahead
+ * Accepts: prefetch state
+ */
+
+void prefetch_flush (PREFETCH *pf)
+{
+  while (pf->num) close (pf->files[--pf->num].fd);
+  if (pf->files) fs_give ((void **) &pf->files);
+  pf->size = 0;
+}
+
+
+/* Sort messages with persistent sort keys
+ * Accepts: mail stream
+ *	    character set
+ *	    search program
+ *	    sort program
+ *	    option flags
+ * Returns: vector of sorted message sequences or NIL if error
+ *
+ * The sort keys of a mailbox with sticky UIDs are saved in a file in the
+ * sort cache directory whenever a sort works out new ones, and loaded by
+ * the first sort of a later session, so that only the keys of messages
+ * that arrived in the meantime have to be fetched and parsed again.
+ */
+
+unsigned long *sort_cached (MAILSTREAM *stream,char *charset,SEARCHPGM *spg,
+			    SORTPGM *pgm,long flags)
+{
+  char file[MAILTMPLEN];
+  unsigned long known,*ret;
+  if (!sortcache_file (stream,file))
+    return mail_sort_msgs (stream,charset,spg,pgm,flags);
+  if (!stream->sortloaded) {	/* first sort on this stream? */
+    sortcache_read (stream,file);
+    stream->sortloaded = T;
+  }
+  known = sortcache_known (stream);
+  ret = mail_sort_msgs (stream,charset,spg,pgm,flags);
+				/* save if sort found new keys */
+  if (ret && (sortcache_known (stream) > known)) sortcache_write (stream,file);
+  return ret;
+}
+
+
+/* Return persistent sort keys file name
+ * Accepts: mail stream
+ *	    destination buffer
+ * Returns: file name or NIL if none
+ */
+
+char *sortcache_file (MAILSTREAM *stream,char *file)
+{
+  unsigned long h = 0;
+  unsigned char *s;
+  if (!sortcachedir || stream->uid_nosticky || !stream->uid_validity ||
+      ((strlen (sortcachedir) + strlen (myhomedir ())) > (MAILTMPLEN - 32)))
+    return NIL;
+  for (s = (unsigned char *) stream->mailbox; *s; s++) h = h * 33 + *s;
+  if (*sortcachedir == '/') sprintf (file,"%s/%08lx",sortcachedir,
+				     h & 0xffffffff);
+  else sprintf (file,"%s/%s/%08lx",myhomedir (),sortcachedir,h & 0xffffffff);
+  return file;
+}
+
+
+/* Count known sort keys
+ * Accepts: mail stream
+ * Returns: number of keys known for all messages
+ */
+
+unsigned long sortcache_known (MAILSTREAM *stream)
+{
+  unsigned long i,ret = 0;
+  SORTCACHE *s;
+  mailcache_t mc = (mailcache_t) mail_parameters (NIL,GET_CACHE,NIL);
+  for (i = 1; i <= stream->nmsgs; i++) {
+    s = (SORTCACHE *) (*mc) (stream,i,CH_SORTCACHE);
+    ret += (s->date ? 1 : 0) + (s->arrival ? 1 : 0) + (s->size ? 1 : 0) +
+      (s->from ? 1 : 0) + (s->to ? 1 : 0) + (s->cc ? 1 : 0) +
+	(s->subject ? 1 : 0);
+  }
+  return ret;
+}
+
+/* Load persistent sort keys
+ * Accepts: mail stream
+ *	    file name
+ *
+ * Keys already known for a message are left alone, and the file is
+ * ignored unless it is for this mailbox and its current UID validity.
+ */
+
+void sortcache_read (MAILSTREAM *stream,char *file)
+{
+  int fd;
+  unsigned long i,j,uid;
+  char *strings;
+  struct stat sbuf;
+  SORTCACHEHDR *hdr;
+  SORTCACHEREC *rec;
+  SORTCACHE *s;
+  mailcache_t mc = (mailcache_t) mail_parameters (NIL,GET_CACHE,NIL);
+  if ((fd = open (file,O_RDONLY,NIL)) < 0) return;
+  if (!fstat (fd,&sbuf) && (sbuf.st_size > sizeof (SORTCACHEHDR)) &&
+      ((hdr = (SORTCACHEHDR *) mmap (NIL,sbuf.st_size,PROT_READ,MAP_PRIVATE,
+				     fd,0)) != (SORTCACHEHDR *) MAP_FAILED)) {
+    rec = (SORTCACHEREC *) (hdr + 1);
+    strings = (char *) (rec + hdr->nrecs);
+    if (!strncmp (hdr->magic,SORTCACHEMAGIC,sizeof (hdr->magic)) &&
+	(hdr->uid_validity == stream->uid_validity) &&
+	(hdr->nrecs <= (sbuf.st_size / sizeof (SORTCACHEREC))) &&
+	hdr->strings && (sbuf.st_size == sizeof (SORTCACHEHDR) +
+			 hdr->nrecs * sizeof (SORTCACHEREC) + hdr->strings) &&
+	!strings[hdr->strings - 1] && !strcmp (strings,stream->mailbox))
+				/* both in UID order */
+      for (i = 1, j = 0; (i <= stream->nmsgs) && (j < hdr->nrecs); i++) {
+	for (uid = mail_uid (stream,i); (j < hdr->nrecs) && (rec[j].uid < uid);
+	     j++);
+	if ((j < hdr->nrecs) && (rec[j].uid == uid)) {
+	  s = (SORTCACHE *) (*mc) (stream,i,CH_SORTCACHE);
+	  if (!s->date) s->date = rec[j].date;
+	  if (!s->arrival) s->arrival = rec[j].arrival;
+	  if (!s->size) s->size = rec[j].size;
+	  if (!s->from && (rec[j].from < hdr->strings))
+	    s->from = rec[j].from ? cpystr (strings + rec[j].from) : NIL;
+	  if (!s->to && (rec[j].to < hdr->strings))
+	    s->to = rec[j].to ? cpystr (strings + rec[j].to) : NIL;
+	  if (!s->cc && (rec[j].cc < hdr->strings))
+	    s->cc = rec[j].cc ? cpystr (strings + rec[j].cc) : NIL;
+	  if (!s->subject && rec[j].subject && (rec[j].subject < hdr->strings)){
+	    s->subject = cpystr (strings + rec[j].subject);
+	    s->refwd = rec[j].refwd ? T : NIL;
+	  }
+	}
+      }
+    munmap ((void *) hdr,sbuf.st_size);
+  }
+  close (fd);
+}
+
+/* Save persistent sort keys
+ * Accepts: mail stream
+ *	    file name
+ *
+ * The file is written under a temporary name and then renamed, so a
+ * concurrent session never reads a partial file.
+ */
+
+void sortcache_write (MAILSTREAM *stream,char *file)
+{
+  int fd;
+  long ok;
+  unsigned long i,n,len;
+  char *strings,tmp[MAILTMPLEN];
+  SORTCACHEHDR hdr;
+  SORTCACHEREC *rec;
+  SORTCACHE *s;
+  mailcache_t mc = (mailcache_t) mail_parameters (NIL,GET_CACHE,NIL);
+  len = strlen (stream->mailbox) + 1;
+  for (i = 1; i <= stream->nmsgs; i++) {
+    s = (SORTCACHE *) (*mc) (stream,i,CH_SORTCACHE);
+    if (s->from) len += strlen (s->from) + 1;
+    if (s->to) len += strlen (s->to) + 1;
+    if (s->cc) len += strlen (s->cc) + 1;
+    if (s->subject) len += strlen (s->subject) + 1;
+  }
+  rec = (SORTCACHEREC *) fs_get ((stream->nmsgs + 1) * sizeof (SORTCACHEREC));
+  strcpy (strings = (char *) fs_get (len),stream->mailbox);
+  len = strlen (stream->mailbox) + 1;
+  for (i = 1, n = 0; i <= stream->nmsgs; i++) {
+    s = (SORTCACHE *) (*mc) (stream,i,CH_SORTCACHE);
+    if (s->date || s->arrival || s->size || s->from || s->to || s->cc ||
+	s->subject) {		/* only messages with something known */
+      rec[n].uid = mail_uid (stream,i);
+      rec[n].date = s->date;
+      rec[n].arrival = s->arrival;
+      rec[n].size = s->size;
+      rec[n].from = sortcache_string (strings,&len,s->from);
+      rec[n].to = sortcache_string (strings,&len,s->to);
+      rec[n].cc = sortcache_string (strings,&len,s->cc);
+      rec[n].subject = sortcache_string (strings,&len,s->subject);
+      rec[n++].refwd = s->refwd;
+    }
+  }
+  memset (&hdr,0,sizeof (SORTCACHEHDR));
+  strcpy (hdr.magic,SORTCACHEMAGIC);
+  hdr.uid_validity = stream->uid_validity;
+  hdr.nrecs = n;
+  hdr.strings = len;
+  sprintf (tmp,"%s.%ld",file,(long) getpid ());
+  if ((fd = open (tmp,O_WRONLY|O_CREAT|O_TRUNC,0600)) < 0) {
+    strcpy (tmp,file);		/* no file, maybe no directory yet */
+    *strrchr (tmp,'/') = '\0';
+    mkdir (tmp,0700);
+    sprintf (tmp,"%s.%ld",file,(long) getpid ());
+    fd = open (tmp,O_WRONLY|O_CREAT|O_TRUNC,0600);
+  }
+  if (fd >= 0) {
+    ok = (safe_write (fd,(char *) &hdr,sizeof (SORTCACHEHDR)) >= 0) &&
+      (safe_write (fd,(char *) rec,n * sizeof (SORTCACHEREC)) >= 0) &&
+	(safe_write (fd,strings,len) >= 0);
+    if (close (fd) || !ok || rename (tmp,file)) unlink (tmp);
+  }
+  fs_give ((void **) &strings);
+  fs_give ((void **) &rec);
+}
+
+
+/* Append string to persistent sort keys string area
+ * Accepts: string area
+ *	    pointer to current size of area
+ *	    string, or NIL if not known
+ * Returns: offset of string in area, 0 if not known
+ */
+
+unsigned long sortcache_string (char *strings,unsigned long *len,char *s)
+{
+  unsigned long ret = *len;
+  if (!s) return 0;
+  strcpy (strings + ret,s);
+  *len += strlen (s) + 1;
+  return ret;
+}
+
 /* Return UNIX password entry for user name
  * Accepts: user name string
  * Returns: password entry
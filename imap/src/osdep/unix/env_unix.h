@@ -19,6 +19,45 @@
  */
 
 
+/* Message files opened ahead of use, see prefetch_add() */
+
+typedef struct prefetch_file {
+  unsigned long uid;		/* message file number */
+  int fd;			/* open descriptor */
+} PREFETCHFILE;
+
+typedef struct prefetch {
+  PREFETCHFILE *files;		/* files opened ahead */
+  unsigned long num;		/* number of open files */
+  unsigned long size;		/* allocated size of files */
+  unsigned long last;		/* last message number read */
+} PREFETCH;
+
+
+/* Persistent sort keys file, see sort_cached() */
+
+#define SORTCACHEMAGIC "sortcache1"
+
+typedef struct sort_cache_header {
+  char magic[16];		/* SORTCACHEMAGIC */
+  unsigned long uid_validity;	/* mailbox UID validity */
+  unsigned long nrecs;		/* number of records that follow */
+  unsigned long strings;	/* size of string area after records */
+} SORTCACHEHDR;
+
+typedef struct sort_cache_record {
+  unsigned long uid;		/* message UID */
+  unsigned long date;		/* sent date, 0 if not known */
+  unsigned long arrival;	/* arrival date, 0 if not known */
+  unsigned long size;		/* message size, 0 if not known */
+  unsigned long from;		/* offsets in string area, 0 if not known */
+  unsigned long to;
+  unsigned long cc;
+  unsigned long subject;	/* base subject */
+  unsigned long refwd;		/* subject is a re or fwd */
+} SORTCACHEREC;
+
+
 typedef struct dotlock_base {
   char lock[MAILTMPLEN];
   int pipei;
@@ -95,3 +134,17 @@ long loginpw (struct passwd *pw,int argc,char *argv[]);
 long pw_login (struct passwd *pw,char *auser,char *user,char *home,int argc,
 	       char *argv[]);
 void *mm_blocknotify (int reason,void *data);
+void notify_watch (MAILSTREAM *stream,char *file);
+void notify_unwatch (MAILSTREAM *stream);
+long notify_changed (MAILSTREAM *stream);
+void notify_reset (MAILSTREAM *stream);
+void prefetch_add (PREFETCH *pf,unsigned long uid,char *file);
+int prefetch_get (PREFETCH *pf,unsigned long uid);
+void prefetch_flush (PREFETCH *pf);
+unsigned long *sort_cached (MAILSTREAM *stream,char *charset,SEARCHPGM *spg,
+			    SORTPGM *pgm,long flags);
+char *sortcache_file (MAILSTREAM *stream,char *file);
+unsigned long sortcache_known (MAILSTREAM *stream);
+void sortcache_read (MAILSTREAM *stream,char *file);
+void sortcache_write (MAILSTREAM *stream,char *file);
+unsigned long sortcache_string (char *strings,unsigned long *len,char *s);
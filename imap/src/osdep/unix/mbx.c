@@ -46,6 +46,14 @@ extern int errno;		/* just in case */
 #define O_BINARY 0
 #endif
 
+/* MBX pending status write */
+
+typedef struct mbx_dirty {
+  unsigned long msgno;		/* message whose status string is stale */
+  unsigned long expunged;	/* its on-disk expunged bit */
+} MBXDIRTY;
+
+
 /* MBX I/O stream local data */
 	
 typedef struct mbx_local {
@@ -63,6 +71,12 @@ typedef struct mbx_local {
   unsigned long buflen;		/* current size of temporary buffer */
   unsigned long uid;		/* current text uid */
   SIZEDTEXT text;		/* current text */
+  unsigned long flagmsgno;	/* message whose status was last read */
+  unsigned long flagstatus;	/* its on-disk system flags */
+  unsigned long flaguser;	/* its on-disk user flags */
+  MBXDIRTY *dirty;		/* pending status writes */
+  unsigned long ndirty;		/* number of pending status writes */
+  unsigned long dirtysize;	/* size of pending status write list */
   char lock[MAILTMPLEN];	/* buffer to write lock name */
 } MBXLOCAL;
 
@@ -105,10 +119,14 @@ MESSAGECACHE *mbx_elt (MAILSTREAM *stream,unsigned long msgno,long expok);
 unsigned long mbx_read_flags (MAILSTREAM *stream,MESSAGECACHE *elt);
 void mbx_update_header (MAILSTREAM *stream);
 void mbx_update_status (MAILSTREAM *stream,unsigned long msgno,long flags);
+unsigned long mbx_sysflags (MESSAGECACHE *elt);
+void mbx_flush_status (MAILSTREAM *stream);
 unsigned long mbx_hdrpos (MAILSTREAM *stream,unsigned long msgno,
 			  unsigned long *size,char **hdr);
 unsigned long mbx_rewrite (MAILSTREAM *stream,unsigned long *reclaimed,
 			   long flags);
+long mbx_filler (MAILSTREAM *stream,off_t pos,unsigned long size,
+		 unsigned long uid);
 long mbx_flaglock (MAILSTREAM *stream);
 
 /* MBX mail routines */
@@ -146,7 +164,7 @@ DRIVER mbxdriver = {
   mbx_flag,			/* modify flags */
   mbx_flagmsg,			/* per-message modify flags */
   NIL,				/* search for message based on criteria */
-  NIL,				/* sort messages */
+  sort_cached,			/* sort messages */
   NIL,				/* thread messages */
   mbx_ping,			/* ping mailbox to see if still alive */
   mbx_check,			/* check for new messages */
@@ -516,6 +534,8 @@ MAILSTREAM *mbx_open (MAILSTREAM *stream)
 				/* time not set up yet */
   LOCAL->lastsnarf = LOCAL->filetime = 0;
   LOCAL->expok = LOCAL->flagcheck = NIL;
+  notify_watch (stream,stream->mailbox);
+  if (stream->inbox) notify_watch (stream,sysinbox ());
   stream->sequence++;		/* bump sequence number */
 				/* parse mailbox */
   stream->nmsgs = stream->recent = 0;
@@ -569,6 +589,8 @@ void mbx_abort (MAILSTREAM *stream)
 				/* free local text buffer */
     if (LOCAL->buf) fs_give ((void **) &LOCAL->buf);
     if (LOCAL->text.data) fs_give ((void **) &LOCAL->text.data);
+    if (LOCAL->dirty) fs_give ((void **) &LOCAL->dirty);
+    notify_unwatch (stream);	/* no more change notification */
 				/* nuke the local data */
     fs_give ((void **) &stream->local);
     stream->dtb = NIL;		/* log out the DTB */
@@ -689,6 +711,7 @@ void mbx_flag (MAILSTREAM *stream,char *sequence,char *flag,long flags)
   unsigned long oldpid = LOCAL->lastpid;
 				/* make sure the update takes */
   if (!stream->rdonly && LOCAL && (LOCAL->fd >= 0) && (LOCAL->ld >= 0)) {
+    mbx_flush_status (stream);	/* write out batched status changes */
     fsync (LOCAL->fd);
     fstat (LOCAL->fd,&sbuf);	/* get current write time */
     tp[1] = LOCAL->filetime = sbuf.st_mtime;
@@ -713,7 +736,31 @@ void mbx_flag (MAILSTREAM *stream,char *sequence,char *flag,long flags)
 
 void mbx_flagmsg (MAILSTREAM *stream,MESSAGECACHE *elt)
 {
-  if (mbx_flaglock (stream)) mbx_update_status (stream,elt->msgno,NIL);
+  unsigned long i;
+  if (mbx_flaglock (stream)) {
+    if (stream->rdonly || !elt->valid) {
+				/* pre-alteration call, note on-disk status */
+      LOCAL->flagstatus = mbx_read_flags (stream,elt) + mbx_sysflags (elt);
+      LOCAL->flaguser = elt->user_flags;
+      LOCAL->flagmsgno = elt->msgno;
+    }
+				/* status not read first, write it now */
+    else if (elt->msgno != LOCAL->flagmsgno)
+      mbx_update_status (stream,elt->msgno,NIL);
+    else {			/* defer write to mbx_flag() if changed */
+      i = (LOCAL->flagstatus & fEXPUNGED) + mbx_sysflags (elt);
+      if ((i != LOCAL->flagstatus) || (elt->user_flags != LOCAL->flaguser)) {
+	if (LOCAL->ndirty == LOCAL->dirtysize) {
+	  LOCAL->dirtysize = LOCAL->dirtysize ? LOCAL->dirtysize * 2 : 64;
+	  fs_resize ((void **) &LOCAL->dirty,
+		     LOCAL->dirtysize * sizeof (MBXDIRTY));
+	}
+	LOCAL->dirty[LOCAL->ndirty].msgno = elt->msgno;
+	LOCAL->dirty[LOCAL->ndirty++].expunged = i & fEXPUNGED;
+      }
+      LOCAL->flagmsgno = 0;	/* done with this message */
+    }
+  }
 }
 
 /* MBX mail ping mailbox
@@ -723,7 +770,7 @@ void mbx_flagmsg (MAILSTREAM *stream,MESSAGECACHE *elt)
 
 long mbx_ping (MAILSTREAM *stream)
 {
-  unsigned long i,pos;
+  unsigned long i,j,pos;
   long ret = NIL;
   int ld;
   char lock[MAILTMPLEN];
@@ -732,6 +779,10 @@ long mbx_ping (MAILSTREAM *stream)
   if (stream && LOCAL) {	/* only if stream already open */
     int snarf = stream->inbox && !stream->rdonly;
     ret = LONGT;		/* assume OK */
+				/* nothing to do if nothing changed */
+    if (!(LOCAL->expok || LOCAL->expunged || LOCAL->flagcheck ||
+	  mail_parameters (NIL,GET_EXPUNGEATPING,NIL) ||
+	  notify_changed (stream))) return ret;
     fstat (LOCAL->fd,&sbuf);	/* get current file poop */
 				/* allow expunge if permitted at ping */
     if (mail_parameters (NIL,GET_EXPUNGEATPING,NIL)) LOCAL->expok = T;
@@ -765,11 +816,11 @@ long mbx_ping (MAILSTREAM *stream)
 	     i++, pos += elt->private.special.text.size + elt->rfc822_size)
 	  if ((elt = mail_elt (stream,i))->private.special.offset != pos)
 	    LOCAL->expunged = T;/* found a hole */
-				/* burp any holes */
-      if (LOCAL->expunged && !stream->rdonly) {
-	if (mbx_rewrite (stream,&i,NIL)) fatal ("expunge on check");
+				/* burp any holes, a step at a time */
+      if (LOCAL->expunged && !stream->rdonly &&
+	  !mbx_compact (stream,MBXCOMPACTSTEP,&j,&i,NIL)) {
+	LOCAL->expunged = NIL;	/* no more pending expunge */
 	if (i) {		/* any space reclaimed? */
-	  LOCAL->expunged = NIL;/* no more pending expunge */
 	  sprintf (LOCAL->buf,"Reclaimed %lu bytes of expunged space",i);
 	  MM_LOG (LOCAL->buf,(long) NIL);
 	}
@@ -998,13 +1049,13 @@ long mbx_copy (MAILSTREAM *stream,char *sequence,char *mailbox,long options)
 long mbx_append (MAILSTREAM *stream,char *mailbox,append_t af,void *data)
 {
   struct stat sbuf;
-  int fd,ld,c;
+  int fd,ld;
   char *flags,*date,tmp[MAILTMPLEN],file[MAILTMPLEN],lock[MAILTMPLEN];
   time_t tp[2];
   FILE *df;
   MESSAGECACHE elt;
   long f;
-  unsigned long i,uf;
+  unsigned long i,j,uf;
   STRING *message;
   long ret = NIL;
   MAILSTREAM *dstream = NIL;
@@ -1068,9 +1119,15 @@ long mbx_append (MAILSTREAM *stream,char *mailbox,append_t af,void *data)
 				/* write header */
       if (fprintf (df,"%s,%lu;%08lx%04lx-00000000\015\012",tmp,
 		   i = SIZE (message),uf,(unsigned long) f) < 0) ret = NIL;
-      else {			/* write message */
-	if (i) do c = 0xff & SNX (message);
-	       while ((putc (c,df) != EOF) && --i);
+      else {			/* write message a chunk at a time */
+	while (i) {
+	  if (!message->cursize) SETPOS (message,GETPOS (message));
+	  if (!(j = min (i,message->cursize)) ||
+	      (fwrite (message->curpos,1,j,df) != j)) break;
+	  message->curpos += j;	/* eat that many bytes */
+	  message->cursize -= j;
+	  i -= j;
+	}
 				/* get next message */
 	if (i || !MM_APPEND (af) (dstream,data,&flags,&date,&message))
 	  ret = NIL;
@@ -1487,9 +1544,7 @@ void mbx_update_status (MAILSTREAM *stream,unsigned long msgno,long flags)
     sprintf (LOCAL->buf,"%08lx%04x-%08lx",elt->user_flags,(unsigned)
 	     (((elt->deleted && flags) ?
 	       fEXPUNGED : (strtoul (LOCAL->buf+9,NIL,16)) & fEXPUNGED) +
-	      (fSEEN * elt->seen) + (fDELETED * elt->deleted) +
-	      (fFLAGGED * elt->flagged) + (fANSWERED * elt->answered) +
-	      (fDRAFT * elt->draft)),elt->private.uid);
+	      mbx_sysflags (elt)),elt->private.uid);
     while (T) {			/* get to that place in the file */
       lseek (LOCAL->fd,(off_t) elt->private.special.offset +
 	     elt->private.special.text.size - 23,L_SET);
@@ -1501,6 +1556,55 @@ void mbx_update_status (MAILSTREAM *stream,unsigned long msgno,long flags)
   }
 }
 
+/* MBX system flags of message
+ * Accepts: cache element
+ * Returns: system flag bits as stored in status string, less expunged bit
+ */
+
+unsigned long mbx_sysflags (MESSAGECACHE *elt)
+{
+  return (fSEEN * elt->seen) + (fDELETED * elt->deleted) +
+    (fFLAGGED * elt->flagged) + (fANSWERED * elt->answered) +
+      (fDRAFT * elt->draft);
+}
+
+
+/* MBX write pending status strings
+ * Accepts: MAIL stream
+ *
+ * Status changes made by mbx_flagmsg() are queued under the flag lock and
+ * written here in one pass, so a large flag change costs a single size
+ * check and one positioned write per changed message.
+ */
+
+void mbx_flush_status (MAILSTREAM *stream)
+{
+  unsigned long i;
+  struct stat sbuf;
+  MESSAGECACHE *elt;
+  if (!LOCAL->ndirty) return;	/* nothing pending */
+  fstat (LOCAL->fd,&sbuf);	/* get status */
+				/* make sure file size is good */
+  if (sbuf.st_size < LOCAL->filesize) {
+    sprintf (LOCAL->buf,"Mailbox shrank from %lu to %lu in flag update!",
+	     (unsigned long) LOCAL->filesize,(unsigned long) sbuf.st_size);
+    fatal (LOCAL->buf);
+  }
+  for (i = 0; i < LOCAL->ndirty; ++i) {
+    elt = mail_elt (stream,LOCAL->dirty[i].msgno);
+				/* print new flag string */
+    sprintf (LOCAL->buf,"%08lx%04x-%08lx",elt->user_flags,(unsigned)
+	     (LOCAL->dirty[i].expunged + mbx_sysflags (elt)),elt->private.uid);
+    while (T) {			/* write new flags and UID in place */
+      if (pwrite (LOCAL->fd,LOCAL->buf,21,(off_t) elt->private.special.offset +
+		  elt->private.special.text.size - 23) > 0) break;
+      MM_NOTIFY (stream,strerror (errno),WARN);
+      MM_DISKERROR (stream,errno,T);
+    }
+  }
+  LOCAL->ndirty = 0;		/* all written */
+}
+
 /* MBX locate header for a message
  * Accepts: MAIL stream
  *	    message number
@@ -1704,6 +1808,182 @@ unsigned long mbx_rewrite (MAILSTREAM *stream,unsigned long *reclaimed,
   return n;			/* return number of expunged messages */
 }
 
+/* MBX mail compact mailbox in bounded steps
+ * Accepts: MAIL stream
+ *	    number of message bytes to move before stopping
+ *	    pointer to return moved size
+ *	    pointer to return reclaimed size
+ *	    flags (CX_EXPUNGE to expunge deleted messages, CX_WHOLE to move a
+ *		   run that is too big for one step rather than leave it)
+ * Returns: positive if more to do, zero if done, negative if mailbox busy
+ *
+ * Unlike mbx_rewrite(), this slides live messages down into the holes
+ * left by expunged messages only until the byte or message budget would
+ * be used up.  The rest of the hole is then closed off with an expunged
+ * filler message, so the file parses normally and the locks can be
+ * released between steps.  The filler needs a UID between its neighbours,
+ * so a step can only end before a message whose UID does not follow that
+ * of the message before it.  A run of messages with consecutive UIDs that
+ * alone exceeds the budget is left alone unless CX_WHOLE is set, and zero
+ * is returned as there is nothing more a bounded step can do.
+ */
+
+long mbx_compact (MAILSTREAM *stream,unsigned long budget,
+		  unsigned long *moved,unsigned long *reclaimed,long flags)
+{
+  time_t tp[2];
+  struct stat sbuf;
+  off_t pos,src;
+  int ld;
+  long ret = 0;
+  unsigned long i,j,k,m,n = 0,lastuid,msgs,runsize,runmsgs;
+  unsigned long recent = 0;
+  char lock[MAILTMPLEN];
+  MESSAGECACHE *elt,*nelt;
+  blocknotify_t bn = (blocknotify_t) mail_parameters (NIL,GET_BLOCKNOTIFY,NIL);
+  *moved = *reclaimed = 0;
+  if (stream->rdonly) return -1;/* can't do anything if readonly */
+				/* get parse/append permission */
+  if ((ld = lockfd (LOCAL->fd,lock,LOCK_EX)) < 0) return -1;
+  fstat (LOCAL->fd,&sbuf);	/* get current write time */
+  if (LOCAL->filetime && !LOCAL->flagcheck &&
+      (LOCAL->filetime < sbuf.st_mtime)) LOCAL->flagcheck = T;
+  if (!mbx_parse (stream)) {	/* make sure see any newly-arrived messages */
+    unlockfd (ld,lock);		/* failed?? */
+    return -1;
+  }
+  if (LOCAL->flagcheck) {	/* sweep flags if need flagcheck */
+    LOCAL->filetime = sbuf.st_mtime;
+    for (i = 1; i <= stream->nmsgs; ++i) mbx_elt (stream,i,NIL);
+    LOCAL->flagcheck = NIL;
+  }
+				/* must be the only one with it open */
+  if (flock (LOCAL->fd,LOCK_EX|LOCK_NB)) ret = -1;
+  else {
+    MM_CRITICAL (stream);	/* go critical */
+				/* skip over already compact messages */
+    for (i = 1,lastuid = 0,pos = HDRSIZE; (i <= stream->nmsgs) &&
+	   ((elt = mail_elt (stream,i))->private.special.offset == pos) &&
+	   !((flags & CX_EXPUNGE) && elt->deleted); i++) {
+      pos += elt->private.special.text.size + elt->rfc822_size;
+      lastuid = elt->private.uid;
+    }
+    for (msgs = 0; i <= stream->nmsgs; ) {
+      elt = mail_elt (stream,i);
+      if ((flags & CX_EXPUNGE) && elt->deleted) {
+	mail_expunged (stream,i);/* notify upper levels */
+	n++;			/* count up one more expunged message */
+	continue;		/* its space joins the hole */
+      }
+      src = elt->private.special.offset;
+				/* could plug the hole here? */
+      if ((src != pos) && ((elt->private.uid - lastuid) > 1)) {
+				/* size up run to the next such place */
+	for (j = i,runsize = runmsgs = 0; j <= stream->nmsgs; j++) {
+	  nelt = mail_elt (stream,j);
+	  if ((j > i) && (((flags & CX_EXPUNGE) && nelt->deleted) ||
+			  ((nelt->private.uid -
+			    mail_elt (stream,j - 1)->private.uid) > 1))) break;
+	  runsize += nelt->private.special.text.size + nelt->rfc822_size;
+	  runmsgs++;
+	}
+				/* run would break the budget? */
+	if (((*moved + runsize) > budget) ||
+	    ((msgs + runmsgs) > MBXCOMPACTMSGS)) {
+				/* leave it if too big for any step */
+	  if (!(msgs || n || (flags & CX_WHOLE))) break;
+				/* else stop here if can */
+	  if ((msgs || !(flags & CX_WHOLE)) &&
+	      mbx_filler (stream,pos,src - pos,lastuid + 1)) {
+	    if (msgs) ret = 1;	/* more to do next time */
+	    break;
+	  }
+	}
+      }
+      k = elt->private.special.text.size + elt->rfc822_size;
+      if (src != pos) {
+	for (j = k; j; j -= m) {/* slide message down into the hole */
+	  m = min (j,LOCAL->buflen);
+	  while (T) {
+	    errno = EIO;	/* in case of a short read */
+	    if (pread (LOCAL->fd,LOCAL->buf,m,src) == (ssize_t) m) break;
+	    MM_NOTIFY (stream,strerror (errno),WARN);
+	    MM_DISKERROR (stream,errno,T);
+	  }
+	  while (T) {
+	    errno = ENOSPC;	/* in case of a short write */
+	    if (pwrite (LOCAL->fd,LOCAL->buf,m,pos + (k - j)) == (ssize_t) m)
+	      break;
+	    MM_NOTIFY (stream,strerror (errno),WARN);
+	    MM_DISKERROR (stream,errno,T);
+	  }
+	  src += m;
+	}
+	elt->private.special.offset = pos;
+	*moved += k;		/* note moved message space */
+	msgs++;			/* and moved message */
+      }
+      pos += k;			/* new end of compact data */
+      lastuid = elt->private.uid;
+      i++;
+    }
+    if (i > stream->nmsgs) {	/* reached the end, truncate the tail */
+      *reclaimed = LOCAL->filesize - pos;
+      ftruncate (LOCAL->fd,LOCAL->filesize = pos);
+    }
+    fsync (LOCAL->fd);		/* force disk update */
+    MM_NOCRITICAL (stream);	/* release critical */
+  }
+  (*bn) (BLOCK_FILELOCK,NIL);
+  flock (LOCAL->fd,LOCK_SH);	/* allow sharers again */
+  (*bn) (BLOCK_NONE,NIL);
+  unlockfd (ld,lock);		/* release exclusive parse/append permission */
+  if (ret >= 0) {
+    fstat (LOCAL->fd,&sbuf);	/* get new write time */
+    tp[1] = LOCAL->filetime = sbuf.st_mtime;
+    tp[0] = time (0);		/* reset atime to now */
+    utime (stream->mailbox,tp);
+  }
+  if (n) {			/* notify upper level of new mailbox size */
+    for (i = 1; i <= stream->nmsgs; ++i)
+      if (mail_elt (stream,i)->recent) ++recent;
+    mail_exists (stream,stream->nmsgs);
+    mail_recent (stream,recent);
+  }
+  return ret;
+}
+
+/* MBX mail write expunged filler message
+ * Accepts: MAIL stream
+ *	    position of filler
+ *	    total size of filler including internal header
+ *	    UID to give filler
+ * Returns: T if written, NIL if hole too small for an internal header
+ */
+
+long mbx_filler (MAILSTREAM *stream,off_t pos,unsigned long size,
+		 unsigned long uid)
+{
+  char tmp[MAILTMPLEN];
+  unsigned long i,j,k;
+  internal_date (tmp);		/* any valid date will do */
+				/* size field width settles quickly */
+  for (i = 0, j = size; i < 3; ++i) {
+    sprintf (LOCAL->buf,"%s,%lu;00000000%04x-%08lx\015\012",tmp,j,
+	     (unsigned) fEXPUNGED,uid);
+    if ((k = strlen (LOCAL->buf)) >= size) return NIL;
+    if ((k + j) == size) break;	/* internal header and text fill hole */
+    j = size - k;
+  }
+  if (i == 3) return NIL;	/* size didn't settle */
+  while (T) {			/* write internal header over the hole */
+    if (pwrite (LOCAL->fd,LOCAL->buf,k,pos) > 0) break;
+    MM_NOTIFY (stream,strerror (errno),WARN);
+    MM_DISKERROR (stream,errno,T);
+  }
+  return T;
+}
+
 /* MBX mail lock for flag updating
  * Accepts: stream
  * Returns: T if successful, NIL if failure
@@ -21,6 +21,13 @@
 /* Build parameters */
 
 #define HDRSIZE 2048
+#define MBXCOMPACTSTEP 1048576	/* message bytes moved per compaction step */
+#define MBXCOMPACTMSGS 1000	/* messages moved per compaction step */
+
+/* mbx_compact() flags */
+
+#define CX_EXPUNGE 1		/* expunge deleted messages */
+#define CX_WHOLE 2		/* move a run too big for one step anyway */
 
 
 /* Private driver flags, should be in mail.h? */
@@ -28,3 +35,6 @@
 #define fEXPUNGED 32768
 /* Export this prototype since tkrat uses it directly */
 long mbx_create (MAILSTREAM *stream,char *mailbox);
+/* Likewise for mailutil, which drives compaction a step at a time */
+long mbx_compact (MAILSTREAM *stream,unsigned long budget,
+		  unsigned long *moved,unsigned long *reclaimed,long flags);
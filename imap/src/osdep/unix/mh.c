@@ -40,9 +40,22 @@ typedef struct mh_local {
   unsigned long buflen;		/* current size of temporary buffer */
   unsigned long cachedtexts;	/* total size of all cached texts */
   time_t scantime;		/* last time directory scanned */
+  PREFETCH prefetch;		/* message files opened ahead */
 } MHLOCAL;
 
 
+/* MH message list cache entry */
+
+typedef struct mh_cache_entry {
+  unsigned long uid;		/* message file number */
+  unsigned long size;		/* RFC822 size, 0 if not known */
+  time_t date;			/* internal date, valid if size known */
+  unsigned int seen : 1;	/* message was seen */
+} MHCACHEENTRY;
+
+#define MHCACHEMAGIC "mhcache1 "
+
+
 /* Convenient access to local data */
 
 #define LOCAL ((MHLOCAL *) stream->local)
@@ -77,6 +90,12 @@ long mh_append (MAILSTREAM *stream,char *mailbox,append_t af,void *data);
 
 int mh_select (struct direct *name);
 int mh_numsort (const void *d1,const void *d2);
+int mh_uidsort (const void *d1,const void *d2);
+long mh_scan_new (char *dir,unsigned long above,unsigned long **list);
+long mh_read_cache (MAILSTREAM *stream,time_t mtime,MHCACHEENTRY **cache);
+void mh_write_cache (MAILSTREAM *stream);
+void mh_elt_date (MESSAGECACHE *elt,time_t t);
+void mh_prefetch (MAILSTREAM *stream,unsigned long msgno);
 char *mh_file (char *dst,char *name);
 long mh_canonicalize (char *pattern,char *ref,char *pat);
 void mh_setdate (char *file,MESSAGECACHE *elt);
@@ -440,7 +459,7 @@ long mh_delete (MAILSTREAM *stream,char *mailbox)
     tmp[i++] = '/';		/* now apply trailing delimiter */
     while (d = readdir (dirp))	/* massacre all numeric or comma files */
       if (mh_select (d) || (*d->d_name == ',') ||
-	  !strcmp (d->d_name,MHSEQUENCE)) {
+	  !strcmp (d->d_name,MHSEQUENCE) || !strcmp (d->d_name,MHCACHE)) {
 	strcpy (tmp + i,d->d_name);
 	unlink (tmp);		/* sayonara */
       }
@@ -513,10 +532,14 @@ MAILSTREAM *mh_open (MAILSTREAM *stream)
   stream->inbox = !compare_cstring (stream->mailbox,"#MHINBOX");
   mh_file (tmp,stream->mailbox);/* get directory name */
   LOCAL->dir = cpystr (tmp);	/* copy directory name for later */
+  notify_watch (stream,LOCAL->dir);
+  if (stream->inbox) notify_watch (stream,sysinbox ());
 				/* make temporary buffer */
   LOCAL->buf = (char *) fs_get ((LOCAL->buflen = MAXMESSAGESIZE) + 1);
   LOCAL->scantime = 0;		/* not scanned yet */
   LOCAL->cachedtexts = 0;	/* no cached texts */
+				/* nothing opened ahead yet */
+  memset (&LOCAL->prefetch,0,sizeof (PREFETCH));
   stream->sequence++;		/* bump sequence number */
 				/* parse mailbox */
   stream->nmsgs = stream->recent = 0;
@@ -537,9 +560,12 @@ void mh_close (MAILSTREAM *stream,long options)
     int silent = stream->silent;
     stream->silent = T;		/* note this stream is dying */
     if (options & CL_EXPUNGE) mh_expunge (stream);
+    mh_write_cache (stream);	/* remember message list for next open */
+    prefetch_flush (&LOCAL->prefetch);
     if (LOCAL->dir) fs_give ((void **) &LOCAL->dir);
 				/* free local scratch buffer */
     if (LOCAL->buf) fs_give ((void **) &LOCAL->buf);
+    notify_unwatch (stream);	/* no more change notification */
 				/* nuke the local data */
     fs_give ((void **) &stream->local);
     stream->dtb = NIL;		/* log out the DTB */
@@ -557,12 +583,14 @@ void mh_close (MAILSTREAM *stream,long options)
 void mh_fast (MAILSTREAM *stream,char *sequence,long flags)
 {
   unsigned long i,j;
-				/* ugly and slow */
+  MESSAGECACHE *elt;
+				/* ugly and slow, unless cached */
   if (stream && LOCAL && ((flags & FT_UID) ?
 			  mail_uid_sequence (stream,sequence) :
 			  mail_sequence (stream,sequence)))
     for (i = 1; i <= stream->nmsgs; i++)
-      if (mail_elt (stream,i)->sequence) mh_header (stream,i,&j,NIL);
+      if ((elt = mail_elt (stream,i))->sequence && !elt->rfc822_size)
+	mh_header (stream,i,&j,NIL);
 }
 
 /* MH mail fetch message header
@@ -580,7 +608,6 @@ char *mh_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *length,
   int fd;
   unsigned char *t;
   struct stat sbuf;
-  struct tm *tm;
   MESSAGECACHE *elt;
   *length = 0;			/* default to empty */
   if (flags & FT_UID) return "";/* UID call "impossible" */
@@ -591,17 +618,16 @@ char *mh_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *length,
       mail_gc (stream,GC_TEXTS);/* just can't keep that much */
       LOCAL->cachedtexts = 0;
     }
+				/* sequential reading, open next ones too */
+    if (((fd = prefetch_get (&LOCAL->prefetch,elt->private.uid)) < 0) &&
+	(msgno == LOCAL->prefetch.last + 1)) mh_prefetch (stream,msgno + 1);
+    LOCAL->prefetch.last = msgno;
 				/* build message file name */
     sprintf (LOCAL->buf,"%s/%lu",LOCAL->dir,elt->private.uid);
-    if ((fd = open (LOCAL->buf,O_RDONLY,NIL)) < 0) return "";
+    if ((fd < 0) && ((fd = open (LOCAL->buf,O_RDONLY,NIL)) < 0)) return "";
     fstat (fd,&sbuf);		/* get size of message */
 				/* make plausible IMAPish date string */
-    tm = gmtime (&sbuf.st_mtime);
-    elt->day = tm->tm_mday; elt->month = tm->tm_mon + 1;
-    elt->year = tm->tm_year + 1900 - BASEYEAR;
-    elt->hours = tm->tm_hour; elt->minutes = tm->tm_min;
-    elt->seconds = tm->tm_sec;
-    elt->zhours = 0; elt->zminutes = 0;
+    mh_elt_date (elt,sbuf.st_mtime);
 				/* is buffer big enough? */
     if (sbuf.st_size > LOCAL->buflen) {
       fs_give ((void **) &LOCAL->buf);
@@ -630,6 +656,25 @@ char *mh_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *length,
   return (char *) elt->private.msg.header.text.data;
 }
 
+/* MH open a window of message files ahead of use
+ * Accepts: MAIL stream
+ *	    first message number of window
+ */
+
+void mh_prefetch (MAILSTREAM *stream,unsigned long msgno)
+{
+  MESSAGECACHE *elt;
+  char tmp[MAILTMPLEN];
+  long n = (long) mail_parameters (NIL,GET_PREFETCHWINDOW,NIL);
+  prefetch_flush (&LOCAL->prefetch);
+  for (; (n > 0) && (msgno <= stream->nmsgs); msgno++)
+    if (!(elt = mail_elt (stream,msgno))->private.msg.header.text.data) {
+      sprintf (tmp,"%s/%lu",LOCAL->dir,elt->private.uid);
+      prefetch_add (&LOCAL->prefetch,elt->private.uid,tmp);
+      n--;
+    }
+}
+
 /* MH mail fetch message text (body only)
  * Accepts: MAIL stream
  *	    message # to fetch
@@ -676,6 +721,8 @@ long mh_ping (MAILSTREAM *stream)
   long nmsgs = stream->nmsgs;
   long recent = stream->recent;
   int silent = stream->silent;
+				/* nothing to do if nothing changed */
+  if (!notify_changed (stream)) return T;
   if (stat (LOCAL->dir,&sbuf)) { /* directory exists? */
     if (stream->inbox) return T;
     sprintf (tmp,"Can't open mailbox %.80s: no such mailbox",stream->mailbox);
@@ -684,37 +731,43 @@ long mh_ping (MAILSTREAM *stream)
   }
   stream->silent = T;		/* don't pass up mm_exists() events yet */
   if (sbuf.st_ctime != LOCAL->scantime) {
-    struct direct **names = NIL;
-    long nfiles = scandir (LOCAL->dir,&names,mh_select,mh_numsort);
-    if (nfiles < 0) nfiles = 0;	/* in case error */
+    unsigned long *names;
+    MHCACHEENTRY *cache;
+    long nfiles;
     old = stream->uid_last;
 				/* note scanned now */
     LOCAL->scantime = sbuf.st_ctime;
-				/* scan directory */
-    for (i = 0; i < nfiles; ++i) {
-				/* if newly seen, add to list */
-      if ((j = atoi (names[i]->d_name)) > old) {
+				/* first pass, cache still good? */
+    if (!old && ((nfiles = mh_read_cache (stream,sbuf.st_mtime,&cache)) >= 0)){
+      for (i = 0; i < nfiles; ++i) {
+	mail_exists (stream,++nmsgs);
+	stream->uid_last = (elt = mail_elt (stream,nmsgs))->private.uid =
+	  cache[i].uid;
+	elt->valid = T;		/* note valid flags */
+	elt->seen = cache[i].seen;
+	if (elt->rfc822_size = cache[i].size) mh_elt_date (elt,cache[i].date);
+      }
+      if (cache) fs_give ((void **) &cache);
+    }
+				/* else scan directory for new messages */
+    else if ((nfiles = mh_scan_new (LOCAL->dir,old,&names)) > 0) {
+      for (i = 0; i < nfiles; ++i) {
 	mail_exists (stream,++nmsgs);
-	stream->uid_last = (elt = mail_elt (stream,nmsgs))->private.uid = j;
+	stream->uid_last = (elt = mail_elt (stream,nmsgs))->private.uid =
+	  names[i];
 	elt->valid = T;		/* note valid flags */
 	if (old) {		/* other than the first pass? */
 	  elt->recent = T;	/* yup, mark as recent */
 	  recent++;		/* bump recent count */
 	}
 	else {			/* see if already read */
-	  sprintf (tmp,"%s/%s",LOCAL->dir,names[i]->d_name);
+	  sprintf (tmp,"%s/%lu",LOCAL->dir,names[i]);
 	  stat (tmp,&sbuf);	/* get inode poop */
 	  if (sbuf.st_atime > sbuf.st_mtime) elt->seen = T;
 	}
       }
-      /* TkRat: This memory comes from the system malloc and should not
-	 be handled by the tcl ck* routines */
-      free ((void *) names[i]);
+      fs_give ((void **) &names);
     }
-      /* TkRat: This memory comes from the system malloc and should not
-	 be handled by the tcl ck* routines */
-				/* free directory */
-    if (s = (void *) names) free ((void *) s);
   }
 
 				/* if INBOX, snarf from system INBOX  */
@@ -1026,6 +1079,160 @@ int mh_numsort (const void *d1,const void *d2)
 }
 
 
+/* MH message number comparison
+ * Accepts: first message number
+ *	    second message number
+ * Returns: negative if d1 < d2, 0 if d1 == d2, postive if d1 > d2
+ */
+
+int mh_uidsort (const void *d1,const void *d2)
+{
+  unsigned long u1 = *(unsigned long *) d1;
+  unsigned long u2 = *(unsigned long *) d2;
+  return (u1 < u2) ? -1 : (u1 > u2) ? 1 : 0;
+}
+
+
+/* MH scan directory for new messages
+ * Accepts: directory name
+ *	    highest message number already known
+ *	    pointer to returned list
+ * Returns: number of new messages, list in ascending order
+ *
+ * Unlike scandir(), only the new names are kept and sorted, so a new
+ * arrival in a big folder costs one pass over the directory.
+ */
+
+long mh_scan_new (char *dir,unsigned long above,unsigned long **list)
+{
+  DIR *dirp;
+  struct direct *d;
+  unsigned long i;
+  long n = 0,max = 0;
+  *list = NIL;
+  if (!(dirp = opendir (dir))) return 0;
+  while (d = readdir (dirp))
+    if (mh_select (d) && ((i = strtoul (d->d_name,NIL,10)) > above)) {
+      if (n == max) {		/* need more room? */
+	if (*list) fs_resize ((void **) list,(max *= 2) * sizeof (unsigned long));
+	else *list = (unsigned long *) fs_get ((max = 64) *
+						 sizeof (unsigned long));
+      }
+      (*list)[n++] = i;
+    }
+  closedir (dirp);
+  if (n > 1) qsort (*list,n,sizeof (unsigned long),mh_uidsort);
+  return n;
+}
+
+/* MH read message list cache
+ * Accepts: MAIL stream
+ *	    current modification time of the directory
+ *	    pointer to returned cache entries
+ * Returns: number of entries, or -1 if no valid cache
+ *
+ * The cache is only valid if the directory has not been modified since
+ * it was written, i.e. no message was added, removed or renumbered.
+ */
+
+long mh_read_cache (MAILSTREAM *stream,time_t mtime,MHCACHEENTRY **cache)
+{
+  int fd;
+  struct stat sbuf;
+  char *s,*t,tmp[MAILTMPLEN];
+  unsigned long i;
+  long n = 0;
+  *cache = NIL;
+  sprintf (tmp,"%s/%s",LOCAL->dir,MHCACHE);
+  if (!mtime || ((fd = open (tmp,O_RDONLY,NIL)) < 0)) return -1;
+  fstat (fd,&sbuf);		/* slurp the cache */
+  s = (char *) fs_get (sbuf.st_size + 1);
+  i = (read (fd,s,sbuf.st_size) == sbuf.st_size) ? sbuf.st_size : 0;
+  s[i] = '\0';
+  close (fd);
+  sprintf (tmp,"%s%016lx\n",MHCACHEMAGIC,(unsigned long) mtime);
+  if (strncmp (s,tmp,i = strlen (tmp))) n = -1;
+  else {			/* count entries */
+    for (t = s + i; t = strchr (t,'\n'); t++) n++;
+    *cache = (MHCACHEENTRY *) fs_get ((n ? n : 1) * sizeof (MHCACHEENTRY));
+    for (n = 0, t = s + i; *t; n++) {
+      (*cache)[n].uid = strtoul (t,&t,10);
+      (*cache)[n].size = strtoul (t,&t,10);
+      (*cache)[n].date = (time_t) strtoul (t,&t,10);
+      (*cache)[n].seen = strtoul (t,&t,10) ? 1 : 0;
+				/* must be in ascending order */
+      if ((*t++ != '\n') || !(*cache)[n].uid ||
+	  (n && ((*cache)[n].uid <= (*cache)[n-1].uid))) {
+	fs_give ((void **) cache);
+	n = -1;
+	break;
+      }
+    }
+  }
+  fs_give ((void **) &s);
+  return n;
+}
+
+/* MH write message list cache
+ * Accepts: MAIL stream
+ */
+
+void mh_write_cache (MAILSTREAM *stream)
+{
+  MESSAGECACHE *elt;
+  struct stat sbuf;
+  unsigned long i;
+  off_t size = 0;
+  int fd;
+  char *s,tmp[MAILTMPLEN];
+  time_t now;
+  sprintf (tmp,"%s/%s",LOCAL->dir,MHCACHE);
+  if ((fd = open (tmp,O_WRONLY|O_CREAT,S_IREAD|S_IWRITE)) < 0) return;
+				/* directory time is filled in last */
+  sprintf (s = LOCAL->buf,"%s%016lx\n",MHCACHEMAGIC,(unsigned long) 0);
+  for (i = 1; i <= stream->nmsgs; i++) {
+				/* filled buffer? */
+    if (((s += strlen (s)) - (char *) LOCAL->buf) > (LOCAL->buflen - 100)) {
+      write (fd,LOCAL->buf,s - (char *) LOCAL->buf);
+      size += s - (char *) LOCAL->buf;
+      *(s = LOCAL->buf) = '\0';
+    }
+    elt = mail_elt (stream,i);
+    sprintf (s,"%lu %lu %lu %d\n",elt->private.uid,elt->rfc822_size,
+	     elt->rfc822_size ? mail_longdate (elt) : 0,elt->seen ? 1 : 0);
+  }
+  if ((s += strlen (s)) != (char *) LOCAL->buf) {
+    write (fd,LOCAL->buf,s - (char *) LOCAL->buf);
+    size += s - (char *) LOCAL->buf;
+  }
+  ftruncate (fd,size);
+				/* validate only if a later change to the
+				 * directory is sure to change its time */
+  now = time (0);
+  if (!stat (LOCAL->dir,&sbuf) && (sbuf.st_mtime < now)) {
+    sprintf (tmp,"%016lx",(unsigned long) sbuf.st_mtime);
+    lseek (fd,strlen (MHCACHEMAGIC),L_SET);
+    write (fd,tmp,16);
+  }
+  close (fd);
+}
+
+
+/* MH set internal date from file time
+ * Accepts: MESSAGECACHE element
+ *	    file modification time
+ */
+
+void mh_elt_date (MESSAGECACHE *elt,time_t t)
+{
+  struct tm *tm = gmtime (&t);
+  elt->day = tm->tm_mday; elt->month = tm->tm_mon + 1;
+  elt->year = tm->tm_year + 1900 - BASEYEAR;
+  elt->hours = tm->tm_hour; elt->minutes = tm->tm_min;
+  elt->seconds = tm->tm_sec;
+  elt->zhours = 0; elt->zminutes = 0;
+}
+
 /* MH mail build file name
  * Accepts: destination string
  *          source
@@ -22,4 +22,5 @@
 
 #define MHPROFILE ".mh_profile"
 #define MHSEQUENCE ".mh_sequence"
+#define MHCACHE ".mh_cache"
 #define MHPATH "Mail"
@@ -317,7 +317,7 @@ DRIVER mmdfdriver = {
   NIL,				/* modify flags */
   mmdf_flagmsg,			/* per-message modify flags */
   NIL,				/* search for message based on criteria */
-  NIL,				/* sort messages */
+  sort_cached,			/* sort messages */
   NIL,				/* thread messages */
   mmdf_ping,			/* ping mailbox to see if still alive */
   mmdf_check,			/* check for new messages */
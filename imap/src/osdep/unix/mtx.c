@@ -954,13 +954,13 @@ long mtx_copy (MAILSTREAM *stream,char *sequence,char *mailbox,long options)
 long mtx_append (MAILSTREAM *stream,char *mailbox,append_t af,void *data)
 {
   struct stat sbuf;
-  int fd,ld,c;
+  int fd,ld;
   char *flags,*date,tmp[MAILTMPLEN],file[MAILTMPLEN],lock[MAILTMPLEN];
   time_t tp[2];
   FILE *df;
   MESSAGECACHE elt;
   long f;
-  unsigned long i,uf;
+  unsigned long i,j,uf;
   STRING *message;
   long ret = LONGT;
 				/* default stream to prototype */
@@ -1026,9 +1026,15 @@ long mtx_append (MAILSTREAM *stream,char *mailbox,append_t af,void *data)
 				/* write header */
     if (fprintf (df,"%s,%lu;%010lo%02lo\015\012",tmp,i = SIZE (message),uf,
 		 (unsigned long) f) < 0) ret = NIL;
-    else {			/* write message */
-      if (i) do c = 0xff & SNX (message);
-      while ((putc (c,df) != EOF) && --i);
+    else {			/* write message a chunk at a time */
+      while (i) {
+	if (!message->cursize) SETPOS (message,GETPOS (message));
+	if (!(j = min (i,message->cursize)) ||
+	    (fwrite (message->curpos,1,j,df) != j)) break;
+	message->curpos += j;	/* eat that many bytes */
+	message->cursize -= j;
+	i -= j;
+      }
 				/* get next message */
       if (i || !MM_APPEND (af) (stream,data,&flags,&date,&message)) ret = NIL;
     }
@@ -41,6 +41,7 @@ typedef struct mx_local {
   unsigned long buflen;		/* current size of temporary buffer */
   unsigned long cachedtexts;	/* total size of all cached texts */
   time_t scantime;		/* last time directory scanned */
+  PREFETCH prefetch;		/* message files opened ahead */
 } MXLOCAL;
 
 
@@ -84,6 +85,7 @@ char *mx_file (char *dst,char *name);
 long mx_lockindex (MAILSTREAM *stream);
 void mx_unlockindex (MAILSTREAM *stream);
 void mx_setdate (char *file,MESSAGECACHE *elt);
+void mx_prefetch (MAILSTREAM *stream,unsigned long msgno);
 
 
 /* MX mail routines */
@@ -121,7 +123,7 @@ DRIVER mxdriver = {
   mx_flag,			/* modify flags */
   mx_flagmsg,			/* per-message modify flags */
   NIL,				/* search for message based on criteria */
-  NIL,				/* sort messages */
+  sort_cached,			/* sort messages */
   NIL,				/* thread messages */
   mx_ping,			/* ping mailbox to see if still alive */
   mx_check,			/* check for new messages */
@@ -436,11 +438,15 @@ MAILSTREAM *mx_open (MAILSTREAM *stream)
   stream->inbox = !compare_cstring (stream->mailbox,"INBOX");
   mx_file (tmp,stream->mailbox);/* get directory name */
   LOCAL->dir = cpystr (tmp);	/* copy directory name for later */
+  notify_watch (stream,LOCAL->dir);
+  if (stream->inbox) notify_watch (stream,sysinbox ());
 				/* make temporary buffer */
   LOCAL->buf = (char *) fs_get ((LOCAL->buflen = MAXMESSAGESIZE) + 1);
   LOCAL->scantime = 0;		/* not scanned yet */
   LOCAL->fd = -1;		/* no index yet */
   LOCAL->cachedtexts = 0;	/* no cached texts */
+				/* nothing opened ahead yet */
+  memset (&LOCAL->prefetch,0,sizeof (PREFETCH));
   stream->sequence++;		/* bump sequence number */
 				/* parse mailbox */
   stream->nmsgs = stream->recent = 0;
@@ -465,9 +471,11 @@ void mx_close (MAILSTREAM *stream,long options)
     int silent = stream->silent;
     stream->silent = T;		/* note this stream is dying */
     if (options & CL_EXPUNGE) mx_expunge (stream);
+    prefetch_flush (&LOCAL->prefetch);
     if (LOCAL->dir) fs_give ((void **) &LOCAL->dir);
 				/* free local scratch buffer */
     if (LOCAL->buf) fs_give ((void **) &LOCAL->buf);
+    notify_unwatch (stream);	/* no more change notification */
 				/* nuke the local data */
     fs_give ((void **) &stream->local);
     stream->dtb = NIL;		/* log out the DTB */
@@ -542,7 +550,13 @@ char *mx_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *length,
       mail_gc (stream,GC_TEXTS);/* just can't keep that much */
       LOCAL->cachedtexts = 0;
     }
-    if ((fd = open (mx_fast_work (stream,elt),O_RDONLY,NIL)) < 0) return "";
+				/* sequential reading, open next ones too */
+    if (((fd = prefetch_get (&LOCAL->prefetch,elt->private.uid)) < 0) &&
+	(msgno == LOCAL->prefetch.last + 1)) mx_prefetch (stream,msgno + 1);
+    LOCAL->prefetch.last = msgno;
+    if (fd >= 0) mx_fast_work (stream,elt);
+    else if ((fd = open (mx_fast_work (stream,elt),O_RDONLY,NIL)) < 0)
+      return "";
 				/* is buffer big enough? */
     if (elt->rfc822_size > LOCAL->buflen) {
       fs_give ((void **) &LOCAL->buf);
@@ -570,6 +584,25 @@ char *mx_header (MAILSTREAM *stream,unsigned long msgno,unsigned long *length,
   return (char *) elt->private.msg.header.text.data;
 }
 
+/* MX open a window of message files ahead of use
+ * Accepts: MAIL stream
+ *	    first message number of window
+ */
+
+void mx_prefetch (MAILSTREAM *stream,unsigned long msgno)
+{
+  MESSAGECACHE *elt;
+  char tmp[MAILTMPLEN];
+  long n = (long) mail_parameters (NIL,GET_PREFETCHWINDOW,NIL);
+  prefetch_flush (&LOCAL->prefetch);
+  for (; (n > 0) && (msgno <= stream->nmsgs); msgno++)
+    if (!(elt = mail_elt (stream,msgno))->private.msg.header.text.data) {
+      sprintf (tmp,"%s/%lu",LOCAL->dir,elt->private.uid);
+      prefetch_add (&LOCAL->prefetch,elt->private.uid,tmp);
+      n--;
+    }
+}
+
 /* MX mail fetch message text (body only)
  * Accepts: MAIL stream
  *	    message # to fetch
@@ -640,6 +673,8 @@ long mx_ping (MAILSTREAM *stream)
   long nmsgs = stream->nmsgs;
   long recent = stream->recent;
   int silent = stream->silent;
+				/* nothing to do if nothing changed */
+  if (!notify_changed (stream)) return T;
   if (stat (LOCAL->dir,&sbuf)) return NIL;
   stream->silent = T;		/* don't pass up mm_exists() events yet */
   if (sbuf.st_ctime != LOCAL->scantime) {
@@ -731,6 +766,7 @@ long mx_ping (MAILSTREAM *stream)
     MM_NOCRITICAL (stream);	/* release critical */
   }
   mx_unlockindex (stream);	/* done with index */
+  notify_reset (stream);	/* ignore our own index rewrite */
   stream->silent = silent;	/* can pass up events now */
   mail_exists (stream,nmsgs);	/* notify upper level of mailbox size */
   mail_recent (stream,recent);
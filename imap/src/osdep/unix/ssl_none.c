@@ -107,6 +107,12 @@ int PSOUT (char *s)
 }
 
 
+/* Records at least this big are written directly to the descriptor
+ * instead of being copied through the stdio buffer
+ */
+
+#define PSOUTRDIRECT 8192
+
 /* Put record
  * Accepts: source sized text
  * Returns: 0 or EOF if error
@@ -116,6 +122,15 @@ int PSOUTR (SIZEDTEXT *s)
 {
   unsigned char *t;
   unsigned long i,j;
+  long k;
+  if (s->size >= PSOUTRDIRECT) {/* big record, bypass stdio buffer */
+    if (fflush (stdout)) return EOF;
+    for (t = s->data,i = s->size;
+	 (i && (((k = write (fileno (stdout),t,i)) > 0) ||
+		((k < 0) && (errno == EINTR))));)
+      if (k > 0) t += k,i -= k;
+    return i ? EOF : NIL;
+  }
   for (t = s->data,i = s->size;
        (i && ((j = fwrite (t,1,i,stdout)) || (errno == EINTR)));
        t += j,i -= j);
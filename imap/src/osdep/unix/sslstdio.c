@@ -118,6 +118,12 @@ int PSOUT (char *s)
   return 0;			/* success */
 }
 
+/* Records at least this big are written directly to the descriptor
+ * instead of being copied through the stdio buffer
+ */
+
+#define PSOUTRDIRECT 8192
+
 /* Put record
  * Accepts: source sized text
  * Returns: 0 or EOF if error
@@ -138,6 +144,13 @@ int PSOUTR (SIZEDTEXT *s)
     t += j;
     i -= j;
   }
+  else if (i >= PSOUTRDIRECT) {	/* big record, bypass stdio buffer */
+    long k;
+    if (fflush (stdout)) return EOF;
+    while (i && (((k = write (fileno (stdout),t,i)) > 0) ||
+		 ((k < 0) && (errno == EINTR))))
+      if (k > 0) t += k,i -= k;
+  }
   else while (i && ((j = fwrite (t,1,i,stdout)) || (errno == EINTR)))
     t += j,i -= j;
   return i ? EOF : NIL;
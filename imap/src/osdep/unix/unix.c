@@ -160,7 +160,7 @@ DRIVER unixdriver = {
   NIL,				/* modify flags */
   unix_flagmsg,			/* per-message modify flags */
   NIL,				/* search for message based on criteria */
-  NIL,				/* sort messages */
+  sort_cached,			/* sort messages */
   NIL,				/* thread messages */
   unix_ping,			/* ping mailbox to see if still alive */
   unix_check,			/* check for new messages */
@@ -520,6 +520,7 @@ MAILSTREAM *unix_open (MAILSTREAM *stream)
       stream->kwd_create = stream->user_flags[NUSERFLAGS-1] ? NIL : T;
     }
   }
+  notify_watch (stream,stream->mailbox);
   return stream;		/* return stream alive to caller */
 }
 
@@ -740,7 +741,8 @@ long unix_ping (MAILSTREAM *stream)
       LOCAL->ld = -1;		/* no more readwrite lock fd */
       unlink (LOCAL->lname);	/* delete the readwrite lock file */
     }
-    else {			/* see if need to reparse */
+				/* see if need to reparse */
+    else if (notify_changed (stream)) {
       if (!(reparse = (long) mail_parameters (NIL,GET_NETFSSTATBUG,NIL))) {
 				/* get current mailbox size */
 	if (LOCAL->fd >= 0) fstat (LOCAL->fd,&sbuf);
@@ -1144,6 +1146,7 @@ void unix_abort (MAILSTREAM *stream)
     if (LOCAL->buf) fs_give ((void **) &LOCAL->buf);
     if (LOCAL->text.data) fs_give ((void **) &LOCAL->text.data);
     if (LOCAL->line) fs_give ((void **) &LOCAL->line);
+    notify_unwatch (stream);	/* no more change notification */
 				/* nuke the local data */
     fs_give ((void **) &stream->local);
     stream->dtb = NIL;		/* log out the DTB */
@@ -2194,7 +2197,7 @@ DRIVER mboxdriver = {
   NIL,				/* modify flags */
   unix_flagmsg,			/* per-message modify flags */
   NIL,				/* search for message based on criteria */
-  NIL,				/* sort messages */
+  sort_cached,			/* sort messages */
   NIL,				/* thread messages */
   mbox_ping,			/* ping mailbox to see if still alive */
   mbox_check,			/* check for new messages */
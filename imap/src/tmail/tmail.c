@@ -25,6 +25,7 @@ extern int errno;		/* just in case */
 #include <sysexits.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include "mail.h"
 #include "osdep.h"
 #include "misc.h"
@@ -39,6 +40,17 @@ int trycreate = NIL;		/* flag saying gotta create before appending */
 int critical = NIL;		/* flag saying in critical code */
 char *sender = NIL;		/* message origin */
 char *inbox = NIL;		/* inbox file */
+char *msgtext = NIL;		/* mapped message text */
+unsigned long copies = 1;	/* copies to deliver to each mailbox */
+int userenv = NIL;		/* flag saying user environment initialized */
+
+
+/* Multiple copy append package */
+
+typedef struct copy_package {
+  STRING *message;		/* message to append */
+  unsigned long copies;		/* copies remaining */
+} COPYPACKAGE;
 
 
 /* Function prototypes */
@@ -47,10 +59,15 @@ void file_string_init (STRING *s,void *data,unsigned long size);
 char file_string_next (STRING *s);
 void file_string_setpos (STRING *s,unsigned long i);
 int main (int argc,char *argv[]);
+int rcptcmp (const void *a1,const void *a2);
+int usercmp (char *s1,char *s2);
+int deliver_user (FILE *f,unsigned long msglen,char **rcpt,int n);
 int deliver (FILE *f,unsigned long msglen,char *user);
 long ibxpath (MAILSTREAM *ds,char **mailbox,char *path);
 int deliver_safely (MAILSTREAM *prt,STRING *st,char *mailbox,char *path,
 		    uid_t uid,char *tmp);
+long deliver_copies (MAILSTREAM *stream,void *data,char **flags,char **date,
+		     STRING **message);
 int delivery_unsafe (char *path,uid_t uid,struct stat *sbuf,char *tmp);
 int fail (char *string,int code);
 char *getusername (char *s,char **t);
@@ -122,8 +139,8 @@ void file_string_setpos (STRING *s,unsigned long i)
 int main (int argc,char *argv[])
 {
   FILE *f = NIL;
-  int pid,c,ret = 0;
-  unsigned long msglen,status = 0;
+  int pid,c,n,ret = 0;
+  unsigned long msglen = 0,status = 0;
   char *s,tmp[MAILTMPLEN];
   uid_t ruid = getuid ();
   struct passwd *pwd;
@@ -206,28 +223,85 @@ int main (int argc,char *argv[])
     }
     msglen = ftell (f);		/* size of message */
     fflush (f);			/* make sure all changes written out */
-
+				/* deliver from memory if possible */
+    if (msglen && ((msgtext = (char *) mmap (NIL,msglen,PROT_READ,MAP_PRIVATE,
+					     fileno (f),0)) ==
+		   (char *) MAP_FAILED)) msgtext = NIL;
+
     if (ferror (f)) ret = fail ("error writing temp file",EX_TEMPFAIL);
     else if (!msglen) ret = fail ("empty message",EX_TEMPFAIL);
 				/* single delivery */
     else if (argc == 1) ret = deliver (f,msglen,*argv);
-    else do {			/* multiple delivery uses daughter forks */
-      if ((pid = fork ()) < 0) ret = fail (strerror (errno),EX_OSERR);
-      else if (pid) {		/* mother process */
-	grim_pid_reap_status (pid,NIL,(void *) status);
+    else {			/* multiple delivery, group by user */
+      qsort (argv,argc,sizeof (char *),rcptcmp);
+      do {			/* one daughter fork per user */
+	for (n = 1; (n < argc) && !usercmp (argv[0],argv[n]); n++);
+	if ((pid = fork ()) < 0) ret = fail (strerror (errno),EX_OSERR);
+	else if (pid) {		/* mother process */
+	  grim_pid_reap_status (pid,NIL,(void *) status);
 				/* normal termination? */
-	if (!ret) ret = (status & 0xff) ? EX_SOFTWARE : (status & 0xff00) >> 8;
-      }
+	  if (!ret) ret = (status & 0xff) ? EX_SOFTWARE :
+		      (status & 0xff00) >> 8;
+	}
 				/* daughter process */
-      else _exit (deliver (f,msglen,*argv));
-    } while (--argc && *argv++);
+	else _exit (deliver_user (f,msglen,argv,n));
+	argv += n;		/* next user */
+      } while (argc -= n);
+    }
     mm_dlog (ret ? "error in delivery" : "all recipients delivered");
   }
+  if (msgtext) munmap (msgtext,msglen);
   if (f) fclose (f);		/* all done with temporary file */
   _exit (ret);			/* normal exit */
   return 0;			/* stupid gcc */
 }
 
+/* Compare recipients for sorting
+ * Accepts: first recipient
+ *	    second recipient
+ * Returns: negative if first < second, 0 if equal, positive if first > second
+ */
+
+int rcptcmp (const void *a1,const void *a2)
+{
+  char *s1 = *(char **) a1;
+  char *s2 = *(char **) a2;
+  int i = usercmp (s1,s2);
+  return i ? i : strcmp (s1,s2);
+}
+
+
+/* Compare user names of recipients
+ * Accepts: first recipient
+ *	    second recipient
+ * Returns: negative if first < second, 0 if equal, positive if first > second
+ */
+
+int usercmp (char *s1,char *s2)
+{
+  for (; *s1 && (*s1 != '+') && (*s1 == *s2); s1++,s2++);
+  return ((*s1 == '+') ? '\0' : *s1) - ((*s2 == '+') ? '\0' : *s2);
+}
+
+/* Deliver message to all recipients of a single user
+ * Accepts: file description of message temporary file
+ *	    size of message temporary file in bytes
+ *	    sorted recipient list
+ *	    number of recipients
+ * Returns: NIL if success, else first error code
+ */
+
+int deliver_user (FILE *f,unsigned long msglen,char **rcpt,int n)
+{
+  int i,j,k,ret = NIL;
+  for (i = 0; i < n; i += j) {	/* identical recipients get a single append */
+    for (j = 1; ((i + j) < n) && !strcmp (rcpt[i],rcpt[i + j]); j++);
+    copies = j;
+    if ((k = deliver (f,msglen,rcpt[i])) && !ret) ret = k;
+  }
+  return ret;
+}
+
 /* Deliver message to recipient list
  * Accepts: file description of message temporary file
  *	    size of message temporary file in bytes
@@ -265,11 +339,12 @@ int deliver (FILE *f,unsigned long msglen,char *user)
     }
   }
 				/* can't use pwd after this point */
-  env_init (pwd->pw_name,pwd->pw_dir);
+  if (!userenv) userenv = env_init (pwd->pw_name,pwd->pw_dir);
   sprintf (tmp,"delivering to %.80s+%.80s",user,mailbox ? mailbox : "INBOX");
   mm_dlog (tmp);
 				/* prepare stringstruct */
-  INIT (&st,file_string,(void *) f,msglen);
+  if (msgtext) INIT (&st,mail_string,(void *) msgtext,msglen);
+  else INIT (&st,file_string,(void *) f,msglen);
   if (mailbox) {		/* non-INBOX name */
     switch (mailbox[0]) {	/* make sure a valid name */
     default:			/* other names, try to deliver if not INBOX */
@@ -443,6 +518,7 @@ int deliver_safely (MAILSTREAM *prt,STRING *st,char *mailbox,char *path,
 		    uid_t uid,char *tmp)
 {
   struct stat sbuf;
+  COPYPACKAGE cp;
   int i = delivery_unsafe (path,uid,&sbuf,tmp);
   if (i) return i;		/* give up now if delivery unsafe */
 				/* directory, not file */
@@ -476,7 +552,10 @@ int deliver_safely (MAILSTREAM *prt,STRING *st,char *mailbox,char *path,
 	   ((sbuf.st_mode & S_IFMT) == S_IFDIR) ? "directory" : "file",path);
   mm_dlog (tmp);
 				/* do the append now! */
-  if (!mail_append (prt,mailbox,st)) {
+  if (!((copies > 1) ? (cp.message = st,cp.copies = copies,
+			mail_append_multiple (prt,mailbox,deliver_copies,
+					      (void *) &cp)) :
+	mail_append (prt,mailbox,st))) {
     sprintf (tmp,"message delivery failed to %.80s",path);
     return fail (tmp,EX_CANTCREAT);
   }
@@ -487,6 +566,29 @@ int deliver_safely (MAILSTREAM *prt,STRING *st,char *mailbox,char *path,
   return delivery_unsafe (path,uid,&sbuf,tmp);
 }
 
+/* Return next copy of message to append
+ * Accepts: MAIL stream
+ *	    copy package
+ *	    pointer to return flags
+ *	    pointer to return date
+ *	    pointer to return message stringstruct
+ * Returns: T, always
+ */
+
+long deliver_copies (MAILSTREAM *stream,void *data,char **flags,char **date,
+		     STRING **message)
+{
+  COPYPACKAGE *cp = (COPYPACKAGE *) data;
+  *flags = *date = NIL;		/* no flags or date */
+  if (cp->copies) {		/* another copy wanted? */
+    cp->copies--;
+    SETPOS (cp->message,0);	/* rewind stringstruct */
+    *message = cp->message;
+  }
+  else *message = NIL;		/* all done */
+  return LONGT;
+}
+
 /* Verify that delivery is safe
  * Accepts: path name
  *	    user id
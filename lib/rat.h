@@ -228,6 +228,7 @@ extern Tcl_TimerProc RatFolderUpdateTime;
 /* ratStdFolder.c */
 extern void ClearStdPasswds(int freethem);
 extern Tcl_ObjCmdProc RatCheckEncodingsCmd;
+extern void RatStdNotifyInit(Tcl_Interp *interp);
 
 /* ratCode.c */
 extern char *RatDecodeHeader(Tcl_Interp *interp, const char *string, int adr);
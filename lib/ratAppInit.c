@@ -101,6 +101,7 @@ static Tcl_TimerProc RatTmpdirToucher;
 static Tcl_VarTraceProc RatReject;
 static Tcl_AppInitProc RatAppInit;
 static Tcl_VarTraceProc RatOptionWatcher;
+static void RatSetCacheDir(Tcl_Interp *interp, char *name, long param);
 static Tcl_ObjCmdProc RatGetCurrentCmd;
 static Tcl_ObjCmdProc RatBgExecCmd;
 static Tcl_ObjCmdProc RatGetCTECmd;
@@ -253,6 +254,13 @@ RatAppInit(Tcl_Interp *interp)
     }
     i = 1;
     mail_parameters(NIL, SET_USERHASNOLIFE, (void*)i);
+    mail_parameters(NIL, SET_PREFETCHWINDOW, (void*)16);
+    oPtr = Tcl_GetVar2Ex(interp, "option", "change_notify", TCL_GLOBAL_ONLY);
+    if (oPtr && TCL_OK == Tcl_GetBooleanFromObj(interp, oPtr, &i)) {
+	mail_parameters(NIL, SET_CHANGENOTIFY, (void*)(long)i);
+    }
+    RatSetCacheDir(interp, "overview_cache_dir", SET_NNTPOVERCACHE);
+    RatSetCacheDir(interp, "pop3_state_dir", SET_POP3STATEDIR);
 
     /*
      * Initialize async handlers and setup signal handler
@@ -346,6 +354,7 @@ RatAppInit(Tcl_Interp *interp)
 			 NULL, NULL);
     Tcl_CreateObjCommand(interp, "RatPurgePwChache", RatPasswdCachePurgeCmd,
 			 NULL, NULL);
+    Tcl_CreateObjCommand(interp, "RatBodyCache", RatBodyCacheCmd, NULL, NULL);
     Tcl_CreateObjCommand(interp, "RatPrettyPrintMsg", RatPrettyPrintMsgCmd,
 			 NULL, NULL);
     Tcl_CreateObjCommand(interp, "RatEncodeMutf7", RatEncodeMutf7Cmd,
@@ -1827,6 +1836,16 @@ RatOptionWatcher(ClientData clientData, Tcl_Interp *interp,
 	}
     } else if (!strcmp(name2, "watcher_time")) {
 	RatFolderUpdateTime((ClientData)interp);
+    } else if (!strcmp(name2, "change_notify")) {
+	oPtr = Tcl_GetVar2Ex(interp, "option", "change_notify",TCL_GLOBAL_ONLY);
+	if (oPtr && TCL_OK == Tcl_GetBooleanFromObj(interp, oPtr, &i)) {
+	    mail_parameters(NIL, SET_CHANGENOTIFY, (void*)(long)i);
+	    RatStdNotifyInit(interp);
+	}
+    } else if (!strcmp(name2, "overview_cache_dir")) {
+	RatSetCacheDir(interp, "overview_cache_dir", SET_NNTPOVERCACHE);
+    } else if (!strcmp(name2, "pop3_state_dir")) {
+	RatSetCacheDir(interp, "pop3_state_dir", SET_POP3STATEDIR);
     }
 
     return NULL;
@@ -2142,6 +2161,40 @@ RatDStringApendNoCRLF(Tcl_DString *ds, const char *s, int length)
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatSetCacheDir --
+ *
+ *	Tells c-client in which directory to keep a cache, such as the
+ *	overviews of news groups. The directory is created if needed, an
+ *	empty option disables the cache.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Sets the given parameter of c-client.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+RatSetCacheDir(Tcl_Interp *interp, char *name, long param)
+{
+    CONST84 char *v = RatGetPathOption(interp, name);
+    char dir[1024];
+
+    if (v && *v && strlen(v) < sizeof(dir)) {
+	strlcpy(dir, v, sizeof(dir));
+	if (!RatCreateDir(dir)) {
+	    mail_parameters(NIL, param, (void*)dir);
+	    return;
+	}
+    }
+    mail_parameters(NIL, param, NIL);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -0,0 +1,744 @@
+/*
+ * ratBodyCache.c --
+ *
+ *	This file contains a disk cache of the contents of messages in
+ *	IMAP folders. Each cached message is stored in its own file and
+ *	the files are named after the folder, the UIDVALIDITY and the UID
+ *	of the message. The total size of the cache is kept below
+ *	option(bodycache_size) kilobytes by throwing away the least
+ *	recently used entries.
+ *
+ *	The cache directory contains one subdirectory per folder. The name
+ *	of the subdirectory is a hash of the folder name. In that directory
+ *	each message is stored in a file called UIDVALIDITY.UID which
+ *	contains the following:
+ *		RatBodyCache1 header_length text_length folder_name
+ *		header
+ *		text
+ *
+ * TkRat software and its included text is Copyright 1996-2004 by
+ * Martin Forssn
+ *
+ * The full text of the legal notice is contained in the file called
+ * COPYRIGHT, included with this distribution.
+ */
+
+#include "ratStdFolder.h"
+
+#define MAGIC "RatBodyCache1"
+
+/*
+ * One of these is kept in memory for each file in the cache
+ */
+typedef struct CacheFile {
+    char *path;			/* Full path of file */
+    unsigned long size;		/* Size of file */
+    time_t used;		/* When the entry was last used */
+} CacheFile;
+
+/*
+ * The in memory index of the cache. It is built from the directory
+ * when the cache is first used.
+ */
+static Tcl_HashTable cacheFiles;
+static int initialized = 0;
+static char *cacheDir = NULL;
+static unsigned long cacheSize = 0;
+
+/*
+ * Statistics
+ */
+static unsigned long cacheHits = 0;
+static unsigned long cacheMisses = 0;
+static unsigned long cacheStores = 0;
+
+/*
+ * Local functions
+ */
+static unsigned long GetLimit(Tcl_Interp *interp);
+static int InitCache(Tcl_Interp *interp);
+static void ScanDir(const char *dir);
+static void AddFile(const char *path, unsigned long size, time_t used);
+static void RemoveFile(Tcl_HashEntry *entryPtr);
+static int CompareUsed(const void *a, const void *b);
+static void Shrink(unsigned long limit);
+static void BuildPath(MAILSTREAM *stream, unsigned long uid, char *buf,
+		      int buflen, int dirOnly);
+static RatBodyCacheEntry *ReadEntry(Tcl_Interp *interp, MAILSTREAM *stream,
+				    const char *path);
+static RatBodyCacheEntry *ParseEntry(Tcl_Interp *interp, char *data,
+				     unsigned long headerLength,
+				     unsigned long textLength);
+static void WriteEntry(MAILSTREAM *stream, const char *path,
+		       RatBodyCacheEntry *entryPtr);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetLimit --
+ *
+ *      Get the maximum size of the cache in bytes.
+ *
+ * Results:
+ *	The limit, zero means that the cache is disabled.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+GetLimit(Tcl_Interp *interp)
+{
+    Tcl_Obj *oPtr;
+    int kb;
+
+    oPtr = Tcl_GetVar2Ex(interp, "option", "bodycache_size", TCL_GLOBAL_ONLY);
+    if (!oPtr || TCL_OK != Tcl_GetIntFromObj(interp, oPtr, &kb) || kb <= 0) {
+	return 0;
+    }
+    return (unsigned long)kb*1024;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitCache --
+ *
+ *      Initialize the in memory index of the cache
+ *
+ * Results:
+ *	Non zero if the cache is usable.
+ *
+ * Side effects:
+ *	Reads the cache directory.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InitCache(Tcl_Interp *interp)
+{
+    CONST84 char *dir;
+
+    if (initialized) {
+	return (NULL != cacheDir);
+    }
+    initialized = 1;
+    Tcl_InitHashTable(&cacheFiles, TCL_STRING_KEYS);
+    if (NULL == (dir = RatGetPathOption(interp, "bodycache_dir")) || !*dir) {
+	return 0;
+    }
+    cacheDir = cpystr(dir);
+    if (RatCreateDir(cacheDir)) {
+	ckfree(cacheDir);
+	cacheDir = NULL;
+	return 0;
+    }
+    ScanDir(cacheDir);
+    return 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ScanDir --
+ *
+ *      Add all cache files found in the given directory (and the folder
+ *	directories below it) to the index.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The index is updated.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ScanDir(const char *dir)
+{
+    struct dirent *direntPtr;
+    struct stat sbuf;
+    char buf[1024];
+    DIR *dirPtr;
+
+    if (NULL == (dirPtr = opendir(dir))) {
+	return;
+    }
+    while (0 != (direntPtr = readdir(dirPtr))) {
+	if ('.' == direntPtr->d_name[0]) {
+	    continue;
+	}
+	snprintf(buf, sizeof(buf), "%s/%s", dir, direntPtr->d_name);
+	if (stat(buf, &sbuf)) {
+	    continue;
+	}
+	if (S_ISDIR(sbuf.st_mode)) {
+	    if (dir == cacheDir) {
+		ScanDir(buf);
+	    }
+	} else if (dir != cacheDir) {
+	    AddFile(buf, sbuf.st_size, sbuf.st_mtime);
+	}
+    }
+    closedir(dirPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddFile --
+ *
+ *      Add a file to the index (or update it if it is already known)
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The index is updated.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddFile(const char *path, unsigned long size, time_t used)
+{
+    Tcl_HashEntry *entryPtr;
+    CacheFile *filePtr;
+    int new;
+
+    entryPtr = Tcl_CreateHashEntry(&cacheFiles, path, &new);
+    if (new) {
+	filePtr = (CacheFile*)ckalloc(sizeof(CacheFile));
+	filePtr->path = Tcl_GetHashKey(&cacheFiles, entryPtr);
+	Tcl_SetHashValue(entryPtr, (ClientData)filePtr);
+    } else {
+	filePtr = (CacheFile*)Tcl_GetHashValue(entryPtr);
+	cacheSize -= filePtr->size;
+    }
+    filePtr->size = size;
+    filePtr->used = used;
+    cacheSize += size;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemoveFile --
+ *
+ *      Removes a file from the cache, both from disk and the index.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The file is unlinked.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RemoveFile(Tcl_HashEntry *entryPtr)
+{
+    CacheFile *filePtr = (CacheFile*)Tcl_GetHashValue(entryPtr);
+
+    unlink(filePtr->path);
+    cacheSize -= filePtr->size;
+    ckfree(filePtr);
+    Tcl_DeleteHashEntry(entryPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Shrink --
+ *
+ *      Make sure the cache is no larger than the given limit. When we have
+ *	to throw things away we make some extra room so that we do not
+ *	have to do this on every store.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The least recently used files are removed.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompareUsed(const void *a, const void *b)
+{
+    CacheFile *fa = (CacheFile*)Tcl_GetHashValue(*(Tcl_HashEntry**)a);
+    CacheFile *fb = (CacheFile*)Tcl_GetHashValue(*(Tcl_HashEntry**)b);
+
+    if (fa->used == fb->used) {
+	return 0;
+    }
+    return (fa->used < fb->used ? -1 : 1);
+}
+
+static void
+Shrink(unsigned long limit)
+{
+    Tcl_HashEntry **entries, *entryPtr;
+    Tcl_HashSearch search;
+    int i, n;
+
+    if (cacheSize <= limit) {
+	return;
+    }
+    limit -= limit/10;
+    entries = (Tcl_HashEntry**)ckalloc(
+	    (cacheFiles.numEntries+1)*sizeof(Tcl_HashEntry*));
+    for (n = 0, entryPtr = Tcl_FirstHashEntry(&cacheFiles, &search);
+	 entryPtr; entryPtr = Tcl_NextHashEntry(&search)) {
+	entries[n++] = entryPtr;
+    }
+    qsort(entries, n, sizeof(Tcl_HashEntry*), CompareUsed);
+    for (i=0; i<n && cacheSize > limit; i++) {
+	RemoveFile(entries[i]);
+    }
+    ckfree(entries);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * BuildPath --
+ *
+ *      Build the name of the file (or folder directory) which holds the
+ *	given message.
+ *
+ * Results:
+ *	The path is left in buf.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+BuildPath(MAILSTREAM *stream, unsigned long uid, char *buf, int buflen,
+	  int dirOnly)
+{
+    unsigned long hash = 5381;
+    unsigned char *cPtr;
+
+    for (cPtr = (unsigned char*)stream->mailbox; *cPtr; cPtr++) {
+	hash = ((hash << 5) + hash + *cPtr) & 0xffffffff;
+    }
+    if (dirOnly) {
+	snprintf(buf, buflen, "%s/%08lx", cacheDir, hash);
+    } else {
+	snprintf(buf, buflen, "%s/%08lx/%lu.%lu", cacheDir, hash,
+		 stream->uid_validity, uid);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ParseEntry --
+ *
+ *      Create a cache entry from the given message data. The data must
+ *	have been allocated with ckalloc and becomes owned by the entry.
+ *
+ * Results:
+ *	A new cache entry.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static RatBodyCacheEntry*
+ParseEntry(Tcl_Interp *interp, char *data, unsigned long headerLength,
+	   unsigned long textLength)
+{
+    RatBodyCacheEntry *entryPtr;
+    ENVELOPE *envPtr = NULL;
+    STRING bodyString;
+
+    entryPtr = (RatBodyCacheEntry*)ckalloc(sizeof(RatBodyCacheEntry));
+    entryPtr->data = data;
+    entryPtr->headerLength = headerLength;
+    entryPtr->textLength = textLength;
+    entryPtr->bodyPtr = NULL;
+    INIT(&bodyString, mail_string, (void*)(data+headerLength), textLength);
+    rfc822_parse_msg(&envPtr, &entryPtr->bodyPtr, data, headerLength,
+		     &bodyString, RatGetCurrent(interp, RAT_HOST, ""), NIL);
+    mail_free_envelope(&envPtr);
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadEntry --
+ *
+ *      Read a cache file
+ *
+ * Results:
+ *	A new cache entry or NULL if the file could not be read or
+ *	does not belong to the given stream.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static RatBodyCacheEntry*
+ReadEntry(Tcl_Interp *interp, MAILSTREAM *stream, const char *path)
+{
+    unsigned long headerLength, textLength;
+    char buf[MAILTMPLEN*2], *cPtr, *data;
+    FILE *fp;
+
+    if (NULL == (fp = fopen(path, "r"))) {
+	return NULL;
+    }
+    if (NULL == fgets(buf, sizeof(buf), fp)
+	|| strncmp(buf, MAGIC " ", sizeof(MAGIC))
+	|| 2 != sscanf(buf+sizeof(MAGIC), "%lu %lu",&headerLength,&textLength)
+	|| NULL == (cPtr = strchr(buf+sizeof(MAGIC), ' '))
+	|| NULL == (cPtr = strchr(cPtr+1, ' '))
+	|| strncmp(cPtr+1, stream->mailbox, strlen(stream->mailbox))
+	|| '\n' != cPtr[1+strlen(stream->mailbox)]) {
+	fclose(fp);
+	return NULL;
+    }
+    data = (char*)ckalloc(headerLength+textLength+1);
+    if (headerLength+textLength != fread(data, 1, headerLength+textLength,fp)){
+	ckfree(data);
+	fclose(fp);
+	return NULL;
+    }
+    fclose(fp);
+    data[headerLength+textLength] = '\0';
+    return ParseEntry(interp, data, headerLength, textLength);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteEntry --
+ *
+ *      Write an entry to disk.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Creates a new file in the cache.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+WriteEntry(MAILSTREAM *stream, const char *path, RatBodyCacheEntry *entryPtr)
+{
+    char tmp[1024];
+    struct stat sbuf;
+    FILE *fp;
+    int fd;
+
+    BuildPath(stream, 0, tmp, sizeof(tmp), 1);
+    if (stat(tmp, &sbuf) && mkdir(tmp, 0700)) {
+	return;
+    }
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+	return;
+    }
+    /*
+     * The cached messages are only for the user's eyes
+     */
+    if (0 > (fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600))) {
+	return;
+    }
+    if (NULL == (fp = fdopen(fd, "w"))) {
+	close(fd);
+	unlink(tmp);
+	return;
+    }
+    fprintf(fp, "%s %lu %lu %s\n", MAGIC, entryPtr->headerLength,
+	    entryPtr->textLength, stream->mailbox);
+    fwrite(entryPtr->data, 1, entryPtr->headerLength+entryPtr->textLength,fp);
+    if (fclose(fp) || rename(tmp, path) || stat(path, &sbuf)) {
+	unlink(tmp);
+	return;
+    }
+    AddFile(path, sbuf.st_size, time(NULL));
+    cacheStores++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatBodyCacheGet --
+ *
+ *      Get the cached copy of a message. If fetch is true and the
+ *	message is not in the cache (and not too large) it is fetched
+ *	from the server and stored in the cache.
+ *
+ * Results:
+ *	A cache entry which must be released with RatBodyCacheRelease, or
+ *	NULL if the message is not available in the cache.
+ *
+ * Side effects:
+ *	May fetch data from the server and rewrite the cache.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+RatBodyCacheEntry*
+RatBodyCacheGet(Tcl_Interp *interp, MAILSTREAM *stream, unsigned long msgNo,
+		int fetch)
+{
+    RatBodyCacheEntry *entryPtr;
+    Tcl_HashEntry *hashPtr;
+    unsigned long limit, uid, headerLength, textLength;
+    char path[1024], *header, *text, *data;
+
+    if (!stream || !stream->uid_validity || !stream->dtb
+	|| strcmp(stream->dtb->name, "imap")
+	|| 0 == (limit = GetLimit(interp)) || !InitCache(interp)) {
+	return NULL;
+    }
+    uid = mail_uid(stream, msgNo);
+    BuildPath(stream, uid, path, sizeof(path), 0);
+    if ((hashPtr = Tcl_FindHashEntry(&cacheFiles, path))) {
+	if ((entryPtr = ReadEntry(interp, stream, path))) {
+	    ((CacheFile*)Tcl_GetHashValue(hashPtr))->used = time(NULL);
+	    utime(path, NULL);
+	    cacheHits++;
+	    return entryPtr;
+	}
+	RemoveFile(hashPtr);
+    }
+    if (!fetch) {
+	return NULL;
+    }
+
+    /*
+     * Only cache messages which would use a reasonable part of the cache
+     */
+    if (mail_elt(stream, msgNo)->rfc822_size > limit/4) {
+	return NULL;
+    }
+    cacheMisses++;
+    header = mail_fetchheader_full(stream, msgNo, NIL, &headerLength,FT_PEEK);
+    if (!header) {
+	return NULL;
+    }
+    data = (char*)ckalloc(headerLength+1);
+    memcpy(data, header, headerLength);
+    text = mail_fetchtext_full(stream, msgNo, &textLength, FT_PEEK);
+    if (!text) {
+	ckfree(data);
+	return NULL;
+    }
+    data = (char*)ckrealloc(data, headerLength+textLength+1);
+    memcpy(data+headerLength, text, textLength);
+    data[headerLength+textLength] = '\0';
+    entryPtr = ParseEntry(interp, data, headerLength, textLength);
+    WriteEntry(stream, path, entryPtr);
+    Shrink(limit);
+    return entryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatBodyCacheSection --
+ *
+ *      Find the data of a body part in a cached message. The section
+ *	is specified the same way as to mail_fetchbody.
+ *
+ * Results:
+ *	A pointer to the NULL terminated data or NULL if the section does
+ *	not exist. The length is left in *lengthPtr.
+ *
+ * Side effects:
+ *	The data is copied into the body structure the first time.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+char*
+RatBodyCacheSection(RatBodyCacheEntry *entryPtr, const char *section,
+		    unsigned long *lengthPtr)
+{
+    BODY *bodyPtr = entryPtr->bodyPtr;
+    PART *partPtr;
+    char *cPtr;
+    unsigned long i;
+
+    if (!bodyPtr || !section || !*section) {
+	return NULL;
+    }
+    while (*section) {
+	if (!isdigit((unsigned char)*section)
+	    || 0 == (i = strtoul(section, &cPtr, 10))) {
+	    return NULL;
+	}
+	section = cPtr;
+	if (*section && ('.' != *section++ || !*section)) {
+	    return NULL;
+	}
+	if (TYPEMULTIPART == bodyPtr->type) {
+	    for (partPtr = bodyPtr->nested.part; partPtr && --i;
+		 partPtr = partPtr->next);
+	    if (!partPtr) {
+		return NULL;
+	    }
+	    bodyPtr = &partPtr->body;
+	} else if (1 != i) {
+	    return NULL;
+	}
+	if (*section && TYPEMULTIPART != bodyPtr->type) {
+	    if (TYPEMESSAGE == bodyPtr->type
+		&& !strcmp(bodyPtr->subtype, "RFC822")
+		&& bodyPtr->nested.msg && bodyPtr->nested.msg->body) {
+		bodyPtr = bodyPtr->nested.msg->body;
+	    } else {
+		return NULL;
+	    }
+	}
+    }
+    if (bodyPtr->contents.offset + bodyPtr->contents.text.size
+	> entryPtr->textLength) {
+	return NULL;
+    }
+    if (!bodyPtr->contents.text.data) {
+	bodyPtr->contents.text.data =
+		(unsigned char*)ckalloc(bodyPtr->contents.text.size+1);
+	memcpy(bodyPtr->contents.text.data,
+	       entryPtr->data+entryPtr->headerLength+bodyPtr->contents.offset,
+	       bodyPtr->contents.text.size);
+	bodyPtr->contents.text.data[bodyPtr->contents.text.size] = '\0';
+    }
+    *lengthPtr = bodyPtr->contents.text.size;
+    return (char*)bodyPtr->contents.text.data;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatBodyCacheRelease --
+ *
+ *      Free a cache entry returned by RatBodyCacheGet.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+RatBodyCacheRelease(RatBodyCacheEntry *entryPtr)
+{
+    if (entryPtr->bodyPtr) {
+	mail_free_body(&entryPtr->bodyPtr);
+    }
+    ckfree(entryPtr->data);
+    ckfree(entryPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatBodyCacheCmd --
+ *
+ *      Implements the RatBodyCache command. See ../doc/interface for
+ *	details.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The purge subcommand empties the cache.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+RatBodyCacheCmd(ClientData clientData, Tcl_Interp *interp, int objc,
+		Tcl_Obj *CONST objv[])
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+    struct dirent *direntPtr;
+    char buf[1024];
+    Tcl_Obj *oPtr;
+    DIR *dirPtr;
+
+    if (objc != 2) {
+	goto usage;
+    }
+    InitCache(interp);
+    if (!strcmp(Tcl_GetString(objv[1]), "stats")) {
+	oPtr = Tcl_NewObj();
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewStringObj("entries",-1));
+	Tcl_ListObjAppendElement(interp, oPtr,
+				 Tcl_NewIntObj(cacheFiles.numEntries));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewStringObj("size", -1));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewLongObj(cacheSize));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewStringObj("limit", -1));
+	Tcl_ListObjAppendElement(interp, oPtr,Tcl_NewLongObj(GetLimit(interp)));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewStringObj("hits", -1));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewLongObj(cacheHits));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewStringObj("misses",-1));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewLongObj(cacheMisses));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewStringObj("stores",-1));
+	Tcl_ListObjAppendElement(interp, oPtr, Tcl_NewLongObj(cacheStores));
+	Tcl_SetObjResult(interp, oPtr);
+	return TCL_OK;
+
+    } else if (!strcmp(Tcl_GetString(objv[1]), "purge")) {
+	while ((entryPtr = Tcl_FirstHashEntry(&cacheFiles, &search))) {
+	    RemoveFile(entryPtr);
+	}
+	if (cacheDir && (dirPtr = opendir(cacheDir))) {
+	    while (0 != (direntPtr = readdir(dirPtr))) {
+		if ('.' != direntPtr->d_name[0]) {
+		    snprintf(buf, sizeof(buf), "%s/%s", cacheDir,
+			     direntPtr->d_name);
+		    rmdir(buf);
+		}
+	    }
+	    closedir(dirPtr);
+	}
+	cacheHits = cacheMisses = cacheStores = 0;
+	return TCL_OK;
+    }
+
+usage:
+    Tcl_AppendResult(interp, "Usage: ", Tcl_GetString(objv[0]),
+		     " stats|purge", (char*) NULL);
+    return TCL_ERROR;
+}
@@ -155,6 +155,7 @@ RatDbFolderCreate(Tcl_Interp *interp, int append_only, Tcl_Obj *defPtr)
     infoPtr->setInfoProc = Db_SetInfoProc;
     infoPtr->createProc = Db_CreateProc;
     infoPtr->syncProc = NULL;
+    infoPtr->sortProc = NULL;
     infoPtr->dbinfoGetProc = Db_DbinfoGetProc;
     infoPtr->dbinfoSetProc = Db_DbinfoSetProc;
     infoPtr->private = (ClientData) dbPtr;
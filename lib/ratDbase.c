@@ -2394,7 +2394,6 @@ RatDbCheck(Tcl_Interp *interp, int fix)
     struct stat sbuf;
     MESSAGECACHE elt;
     ssize_t l;
-    struct tm tm;
     FILE *fp;
 
     /*
@@ -2688,16 +2687,7 @@ RatDbCheck(Tcl_Interp *interp, int fix)
 		} else if (!strcasecmp(elemArgv[0], "date")) {
 		    if (T == mail_parse_date(&elt,
                                              (unsigned char*)elemArgv[1])) {
-			tm.tm_sec = elt.seconds;
-			tm.tm_min = elt.minutes;
-			tm.tm_hour = elt.hours;
-			tm.tm_mday = elt.day;
-			tm.tm_mon = elt.month - 1;
-			tm.tm_year = elt.year+70;
-			tm.tm_wday = 0;
-			tm.tm_yday = 0;
-			tm.tm_isdst = -1;
-			date = (int)mktime(&tm);
+			date = (int)RatMkTime(&elt);
 		    } else {
 			date = 0;
 		    }
@@ -21,7 +21,7 @@
  *		  Contains the following entries one on each line:
  *			uidvalidity
  *			last known UID in master
- *    mappings	- File with mappings local_uid <> master_uid
+ *    uidmap	- Mappings local_uid <> master_uid, see ratDisMap.c
  *    folder	- The local copy of the folder
  *    changes   - Changes which should be applied to the master once
  *		  we synchronize. This file should contain:
@@ -33,6 +33,7 @@
 #include "ratFolder.h"
 #include "ratStdFolder.h"
 #include "mbx.h"
+#include <imap4r1.h>
 
 /*
  * The uid map
@@ -49,8 +50,7 @@ typedef struct {
 
 typedef struct DisFolderInfo {
     char *dir;			/* Directory where local data is stored */
-    Tcl_HashTable map;		/* Mappings local_uid > remote_uid */
-    int mapChanged;		/* non null if mappings needs to be rewritten*/
+    RatDisMap *map;		/* Mappings local_uid > remote_uid */
     MAILSTREAM *master;		/* Mailstream, used only in online mode */
     int error;	                /* Error indicator variable */
     int diskfull;               /* Disk full indicator */
@@ -74,6 +74,29 @@ typedef struct DisFolderInfo {
     RatCreateProc *createProc;
 } DisFolderInfo;
 
+/*
+ * Number of messages downloaded and appended to the local folder in one
+ * go. The state is checkpointed after each batch.
+ */
+#define DIS_DOWNLOAD_BATCH 50
+
+/*
+ * A batch of downloaded messages waiting to be appended
+ */
+typedef struct {
+    unsigned long uid;		/* Uid in master folder */
+    Tcl_DString ds;		/* The message text */
+    STRING string;		/* Handed to the append driver */
+    char date[128];		/* Internal date */
+    char *flags;		/* Flags to set */
+} DisDownloadMsg;
+
+typedef struct {
+    DisDownloadMsg *msgs;	/* Messages in batch */
+    int num;			/* Number of messages in batch */
+    int next;			/* Next message to append */
+} DisDownloadBatch;
+
 /*
  * Used to collect changes
  */
@@ -83,6 +106,33 @@ typedef struct {
     int value;
 } changes_t;
 
+/*
+ * A run of RatSyncDisconnected. The folders are collected first and then
+ * synchronized one at a time from timer events, so the user interface
+ * stays alive between folders. The folders are ordered by server so the
+ * cached connection to a server is reused for all its folders.
+ */
+typedef struct {
+    char *dir;			/* Directory of folder */
+    off_t size;			/* Size of master file */
+    char *server;		/* Server part of master folder spec */
+} DisSyncJob;
+
+typedef struct {
+    Tcl_Interp *interp;		/* Interpreter to sync in */
+    DisSyncJob *jobs;		/* Folders to synchronize */
+    int num;			/* Number of folders */
+    int allocated;		/* Allocated size of jobs */
+    int next;			/* Next folder to synchronize */
+    Tcl_Obj *cmdPtr;		/* List of scripts to run when done */
+    int busy;			/* True if the interface was made busy */
+} DisSyncRun;
+
+/*
+ * The currently active background synchronization (if any)
+ */
+static DisSyncRun *activeSyncPtr = NULL;
+
 /*
  * Hashtable containing open disfolders
  * The dirname is the key and the infoPtr is the value
@@ -103,27 +153,31 @@ static RatGetFlagProc Dis_GetFlagProc;
 static RatCreateProc Dis_CreateProc;
 static RatSetInfoProc Dis_SetInfoProc;
 static RatSyncProc Dis_SyncProc;
-static int CreateDir(char *dir);
 static Tcl_ObjCmdProc RatSyncDisconnectedCmd;
 static Tcl_ObjCmdProc RatDeleteDisconnectedCmd;
-static void Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir);
+static void Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir,
+				   DisSyncRun *runPtr);
+static int DisCompareJobs(const void *p1, const void *p2);
+static void DisSyncNext(DisSyncRun *runPtr);
+static void DisSyncFinish(DisSyncRun *runPtr);
+static Tcl_TimerProc DisSyncTimerProc;
 static int Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size,
-			  int force, MAILSTREAM **master);
+			  int force, MAILSTREAM **master, DisSyncRun *runPtr);
 static unsigned long DisDownloadMsgs(Tcl_Interp *interp,
 				     MAILSTREAM *masterStream,
 				     MAILSTREAM *localStream,
 				     int *masterErrorPtr, int *diskFullPtr,
                                      CONST84 char *dir,
-				     Tcl_HashTable *mapPtr,
-				     FILE *mapFp, unsigned long startAfterUid,
+				     RatDisMap *mapPtr,
+				     unsigned long startAfterUid,
 				     unsigned long stopBeforeUid);
-static unsigned long GetMasterUID(MAILSTREAM *s, Tcl_HashTable *mapPtr,
+static long DisAppendNext(MAILSTREAM *stream, void *data, char **flags,
+			  char **date, STRING **message);
+static void DisFreeBatch(DisDownloadBatch *batchPtr);
+static unsigned long GetMasterUID(MAILSTREAM *s, RatDisMap *mapPtr,
 	int index);
 static void UpdateFolderFlag(Tcl_Interp *interp, DisFolderInfo *disPtr,
 	int index, RatFlag flag, int value);
-static void ReadMappings(MAILSTREAM *s, const char *dir,Tcl_HashTable *mapPtr);
-static void ReadOldMappings(MAILSTREAM *s, Tcl_HashTable *mapPtr, char *buf,
-	int buflen, FILE *fp);
 static RatUidMap *InitUidMap(MAILSTREAM *s);
 static void FreeUidMap(RatUidMap *uidMap);
 static unsigned long MsgNo(RatUidMap *uidMap, unsigned long uid);
@@ -135,11 +189,9 @@ static unsigned long DisUploadMsg(MAILSTREAM *masterStream,
 				  const char *message_id, char *envdate,
 				  unsigned long local_uid,
 				  Tcl_DString *message, char *date,
-				  char *flags, FILE *mapFP,
-				  Tcl_HashTable *mapPtr);
+				  char *flags, RatDisMap *mapPtr);
 static HandleExists Dis_HandleExists;
 static HandleExpunged Dis_HandleExpunged;
-static void WriteMappings(DisFolderInfo *disPtr);
 static void WriteState(DisFolderInfo *disPtr);
 
 
@@ -235,10 +287,8 @@ RatDisFolderCreate(Tcl_Interp *interp, int append_only, Tcl_Obj *defPtr)
     /*
      * Read mappings
      */
-    Tcl_InitHashTable(&disPtr->map, TCL_ONE_WORD_KEYS);
-    disPtr->mapChanged = 0;
-    ReadMappings(((StdFolderInfo*)infoPtr->private)->stream, 
-	    disPtr->dir, &disPtr->map);
+    disPtr->map = RatDisMapOpen(disPtr->dir,
+				((StdFolderInfo*)infoPtr->private)->stream);
 
     infoPtr->name = Tcl_GetString(objv[3]);
     if (!*infoPtr->name) {
@@ -279,6 +329,7 @@ RatDisFolderCreate(Tcl_Interp *interp, int append_only, Tcl_Obj *defPtr)
     infoPtr->setInfoProc = Dis_SetInfoProc;
     infoPtr->createProc = Dis_CreateProc;
     infoPtr->syncProc = Dis_SyncProc;
+    infoPtr->sortProc = NULL;
     infoPtr->dbinfoGetProc = NULL;
 
     /*
@@ -326,7 +377,8 @@ Dis_FinalProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
 
     snprintf(buf, sizeof(buf), "%s/master", disPtr->dir);
     stat(buf, &sbuf);
-    Dis_SyncFolder(interp, disPtr->dir, sbuf.st_size, 1, &disPtr->master);
+    Dis_SyncFolder(interp, disPtr->dir, sbuf.st_size, 1, &disPtr->master,
+		   NULL);
 }
 
 /*
@@ -466,8 +518,7 @@ Dis_CloseProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int expunge)
     result = (*disPtr->closeProc)(infoPtr, interp, expunge);
     entryPtr = Tcl_FindHashEntry(&openDisFolders, disPtr->dir);
     Tcl_DeleteHashEntry(entryPtr);
-    WriteMappings(disPtr);
-    Tcl_DeleteHashTable(&disPtr->map);
+    RatDisMapClose(disPtr->map);
     ckfree(disPtr->dir);
     if (disPtr->master) {
 	Std_StreamClose(interp, disPtr->master);
@@ -514,23 +565,15 @@ Dis_UpdateProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp,RatUpdateType mode)
             && 0 == disPtr->error) {
 	    MAILSTREAM *local =
 		((StdFolderInfo*)disPtr->infoPtr->private)->stream;
-	    char buf[1024];
-	    FILE *fp;
 
 	    /*
 	     * Append new messages to local folder and uidmap
 	     */
-	    snprintf(buf, sizeof(buf), "%s/mappings", disPtr->dir);
-	    fp = fopen(buf, "a");
-	    if (NULL == fp) {
-		return 0;
-	    }
 	    disPtr->lastUid = DisDownloadMsgs(disPtr->interp, disPtr->master,
 					      local, &disPtr->error,
                                               &disPtr->diskfull,
-					      disPtr->dir, &disPtr->map, fp,
+					      disPtr->dir, disPtr->map,
 					      disPtr->lastUid, 0);
-	    fclose(fp);
 	    WriteState(disPtr);
 	}
 
@@ -542,7 +585,7 @@ Dis_UpdateProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp,RatUpdateType mode)
     }
     if (RAT_SYNC == mode && 0 == disPtr->error) {
         CheckDeletion(infoPtr, interp);
-	WriteMappings(disPtr);
+	RatDisMapSync(disPtr->map);
     }
 
     result = (*disPtr->updateProc)(infoPtr, interp, mode);
@@ -581,22 +624,19 @@ Dis_InsertProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int argc,
 {
     MAILSTREAM *local = ((StdFolderInfo*)infoPtr->private)->stream;
     DisFolderInfo *disPtr = (DisFolderInfo*)infoPtr->private2;
-    char flags[128], date[128], buf[1024];
+    char flags[128], date[128];
     Tcl_Obj *subject, *msgid;
     unsigned long localUid, us, ue;
     MessageInfo *msgPtr;
     Tcl_CmdInfo cmdInfo;
     Tcl_DString ds;
     int i, ret;
-    FILE *fp;
 
     localUid = local->uid_last;
     ret = (*disPtr->insertProc)(infoPtr, interp, argc, argv);
 
     if (disPtr->master && argc) {
 	Tcl_DStringInit(&ds);
-	snprintf(buf, sizeof(buf), "%s/mappings", disPtr->dir);
-	fp = fopen(buf, "a");
 	for (i=us=ue=0; i<argc; i++) {
 	    Tcl_GetCommandInfo(interp, argv[i], &cmdInfo);
 	    msgPtr = (MessageInfo*)cmdInfo.objClientData;
@@ -607,7 +647,7 @@ Dis_InsertProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int argc,
 	    msgid = RatMsgInfo(interp, msgPtr, RAT_FOLDER_MSGID);
 	    ue = DisUploadMsg(disPtr->master, local, Tcl_GetString(subject),
 			      NULL, Tcl_GetString(msgid), NULL,
-			      ++localUid, &ds, date, flags, fp, &disPtr->map);
+			      ++localUid, &ds, date, flags, disPtr->map);
 	    if (0 == i) {
 		us = ue;
 	    }
@@ -619,7 +659,6 @@ Dis_InsertProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int argc,
             if (0 == ue) {
                 ue = us;
             }
-	    disPtr->mapChanged = 1;
 	    if (T != mail_ping(disPtr->master)) {
 		disPtr->master = NULL;
 		break;
@@ -630,9 +669,8 @@ Dis_InsertProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int argc,
 	if (disPtr->lastUid+1 < us) {
             DisDownloadMsgs(interp, disPtr->master, local,
 			    &disPtr->error, NULL, disPtr->dir,
-			    &disPtr->map, fp, disPtr->lastUid+1, us);
+			    disPtr->map, disPtr->lastUid+1, us);
         }
-	fclose(fp);
 	disPtr->lastUid = ue;
 	WriteState(disPtr);
     }
@@ -668,7 +706,7 @@ Dis_SetFlagProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int *ilist,
 
     for (i=0; i<count; i++) {
 	uid = GetMasterUID(((StdFolderInfo*)infoPtr->private)->stream,
-			   &disPtr->map, ilist[i]);
+			   disPtr->map, ilist[i]);
 	if (uid && disPtr->master) {
 	    snprintf(buf, sizeof(buf), "%ld", uid);
 	    if (value) {
@@ -793,7 +831,7 @@ Dis_SetInfoProc(Tcl_Interp *interp, ClientData clientData,
 /*
  *----------------------------------------------------------------------
  *
- * CreateDir --
+ * RatCreateDir --
  *
  *      Checks that a given directory exists and creates it and any
  *	parent directories if they do not exist. This routine expects
@@ -808,8 +846,8 @@ Dis_SetInfoProc(Tcl_Interp *interp, ClientData clientData,
  *
  *----------------------------------------------------------------------
  */
-static int
-CreateDir(char *dir)
+int
+RatCreateDir(char *dir)
 {
     struct stat sbuf;
     char *cPtr;
@@ -853,10 +891,13 @@ CreateDir(char *dir)
  *
  * RatSyncDisconnectedCmd --
  *
- *	Synchronizes all disconnected folders
+ *	Synchronizes all disconnected folders. If -command is given the
+ *	synchronization is done from the event loop, one folder per
+ *	event, and the script is evaluated when all folders are done.
+ *	The interface is kept busy until then.
  *
  * Results:
- *	None
+ *	A standard tcl result.
  *
  * Side effects:
  *	All disconnected folders are updated
@@ -869,11 +910,60 @@ RatSyncDisconnectedCmd(ClientData op, Tcl_Interp *interp, int objc,
 		       Tcl_Obj *const objv[])
 {
     CONST84 char *dirname;
+    DisSyncRun *runPtr;
+
+    if ((1 != objc && 3 != objc)
+	|| (3 == objc && strcmp(Tcl_GetString(objv[1]), "-command"))) {
+	Tcl_AppendResult(interp, "Usage: ", Tcl_GetString(objv[0]),
+		" ?-command script?", (char*) NULL);
+	return TCL_ERROR;
+    }
+
+    /*
+     * If a background synchronization is running we just wait for it
+     */
+    if (activeSyncPtr) {
+	if (3 == objc) {
+	    Tcl_ListObjAppendElement(interp, activeSyncPtr->cmdPtr, objv[2]);
+	} else {
+	    while (activeSyncPtr->next < activeSyncPtr->num) {
+		DisSyncNext(activeSyncPtr);
+	    }
+	}
+	return TCL_OK;
+    }
 
     if (NULL == (dirname = RatGetPathOption(interp, "disconnected_dir"))) {
 	return TCL_ERROR;
     }
-    Dis_FindAndSyncFolders(interp, dirname);
+    runPtr = (DisSyncRun*)ckalloc(sizeof(DisSyncRun));
+    runPtr->interp = interp;
+    runPtr->jobs = NULL;
+    runPtr->num = runPtr->allocated = runPtr->next = 0;
+    runPtr->cmdPtr = Tcl_NewObj();
+    Tcl_IncrRefCount(runPtr->cmdPtr);
+    runPtr->busy = 0;
+    Dis_FindAndSyncFolders(interp, dirname, runPtr);
+    if (runPtr->num) {
+	qsort(runPtr->jobs, runPtr->num, sizeof(DisSyncJob), DisCompareJobs);
+    }
+
+    if (3 == objc) {
+	Tcl_ListObjAppendElement(interp, runPtr->cmdPtr, objv[2]);
+	activeSyncPtr = runPtr;
+	/*
+	 * The folders may not be used while they are synchronized, so the
+	 * interface stays busy until the done scripts have run.
+	 */
+	RatSetBusy(interp);
+	runPtr->busy = 1;
+	Tcl_CreateTimerHandler(0, DisSyncTimerProc, (ClientData)runPtr);
+    } else {
+	while (runPtr->next < runPtr->num) {
+	    DisSyncNext(runPtr);
+	}
+	DisSyncFinish(runPtr);
+    }
     return TCL_OK;
 }
 
@@ -924,25 +1014,28 @@ RatDeleteDisconnectedCmd(ClientData op, Tcl_Interp *interp, int objc,
  *
  * Dis_FindAndSyncFolders --
  *
- *	Recurses over a directory tree and calls Dis_SyncFolder for each
- *	found folder.
+ *	Recurses over a directory tree and adds each found folder to the
+ *	given synchronization run.
  *
  * Results:
  *	None
  *
  * Side effects:
- *	All disconnected folders are updated
+ *	The folders are added to runPtr
  *
  *
  *----------------------------------------------------------------------
  */
 static void
-Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir)
+Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir,
+		       DisSyncRun *runPtr)
 {
     struct stat sbuf;
-    char buf[1024];
+    char buf[1024], *cPtr;
     DIR *dirPtr;
     struct dirent *direntPtr;
+    DisSyncJob *jobPtr;
+    FILE *fp;
 
     /*
      * Check if this is a folder directory (contains a master-file)
@@ -950,7 +1043,32 @@ Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir)
     strlcpy(buf, dir, sizeof(buf)-7);
     strlcat(buf, "/master", sizeof(buf));
     if (0 == stat(buf, &sbuf) && S_ISREG(sbuf.st_mode)) {
-	Dis_SyncFolder(interp, dir, sbuf.st_size, 0, NULL);
+	if (runPtr->num == runPtr->allocated) {
+	    runPtr->allocated += 32;
+	    runPtr->jobs = (DisSyncJob*)ckrealloc((char*)runPtr->jobs,
+		    runPtr->allocated*sizeof(DisSyncJob));
+	}
+	jobPtr = &runPtr->jobs[runPtr->num++];
+	jobPtr->dir = cpystr(dir);
+	jobPtr->size = sbuf.st_size;
+
+	/*
+	 * The second line of the master file is the folder spec, we
+	 * group on the {server} part of it.
+	 */
+	if (NULL != (fp = fopen(buf, "r"))
+	    && fgets(buf, sizeof(buf), fp)
+	    && fgets(buf, sizeof(buf), fp)
+	    && '{' == buf[0]
+	    && NULL != (cPtr = strchr(buf, '}'))) {
+	    cPtr[1] = '\0';
+	} else {
+	    buf[0] = '\0';
+	}
+	if (fp) {
+	    fclose(fp);
+	}
+	jobPtr->server = cpystr(buf);
 	return;
     }
 
@@ -969,18 +1087,154 @@ Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir)
 		|| !strcmp("..", direntPtr->d_name)) {
 	    continue;
 	}
-	Dis_FindAndSyncFolders(interp, buf);
+	Dis_FindAndSyncFolders(interp, buf, runPtr);
     }
     closedir(dirPtr);
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * DisCompareJobs --
+ *
+ *	qsort compare function which orders folders by server and then
+ *	by directory.
+ *
+ * Results:
+ *	Negative, zero or positive.
+ *
+ * Side effects:
+ *	None
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+DisCompareJobs(const void *p1, const void *p2)
+{
+    const DisSyncJob *j1 = (const DisSyncJob*)p1;
+    const DisSyncJob *j2 = (const DisSyncJob*)p2;
+    int r;
+
+    if ((r = strcasecmp(j1->server, j2->server))) {
+	return r;
+    }
+    return strcmp(j1->dir, j2->dir);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DisSyncNext --
+ *
+ *	Synchronizes the next folder of a run.
+ *
+ * Results:
+ *	None
+ *
+ * Side effects:
+ *	The folder is synchronized.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+DisSyncNext(DisSyncRun *runPtr)
+{
+    DisSyncJob *jobPtr = &runPtr->jobs[runPtr->next++];
+
+    Dis_SyncFolder(runPtr->interp, jobPtr->dir, jobPtr->size, 0, NULL,
+		   runPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DisSyncTimerProc --
+ *
+ *	Timer callback which synchronizes one folder of a background run
+ *	and then reschedules itself.
+ *
+ * Results:
+ *	None
+ *
+ * Side effects:
+ *	The folder is synchronized.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+DisSyncTimerProc(ClientData clientData)
+{
+    DisSyncRun *runPtr = (DisSyncRun*)clientData;
+
+    if (runPtr->next < runPtr->num) {
+	DisSyncNext(runPtr);
+    }
+    if (runPtr->next < runPtr->num) {
+	Tcl_CreateTimerHandler(0, DisSyncTimerProc, clientData);
+    } else {
+	DisSyncFinish(runPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DisSyncFinish --
+ *
+ *	Called when all folders of a run are done. Evaluates the done
+ *	scripts, releases the busy interface and frees the run.
+ *
+ * Results:
+ *	None
+ *
+ * Side effects:
+ *	Frees runPtr.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+DisSyncFinish(DisSyncRun *runPtr)
+{
+    Tcl_Obj **objv;
+    int i, objc;
+
+    if (activeSyncPtr == runPtr) {
+	activeSyncPtr = NULL;
+    }
+    for (i = 0; i < runPtr->num; i++) {
+	ckfree(runPtr->jobs[i].dir);
+	ckfree(runPtr->jobs[i].server);
+    }
+    if (runPtr->jobs) {
+	ckfree(runPtr->jobs);
+    }
+    Tcl_ListObjGetElements(runPtr->interp, runPtr->cmdPtr, &objc, &objv);
+    for (i = 0; i < objc; i++) {
+	if (TCL_OK != Tcl_EvalObjEx(runPtr->interp, objv[i],
+				    TCL_EVAL_GLOBAL)) {
+	    Tcl_BackgroundError(runPtr->interp);
+	}
+    }
+    Tcl_DecrRefCount(runPtr->cmdPtr);
+    if (runPtr->busy) {
+	RatClearBusy(runPtr->interp);
+    }
+    ckfree(runPtr);
+}
+
 
 /*
  *----------------------------------------------------------------------
  *
  * Dis_SyncFolder --
  *
- *	Synchronizes a specified folder.
+ *	Synchronizes a specified folder. If runPtr is given the folder
+ *	is part of that run and the progress message says how far the
+ *	run has come.
  *
  * Results:
  *	A standard tcl result.
@@ -993,18 +1247,17 @@ Dis_FindAndSyncFolders(Tcl_Interp *interp, CONST84 char *dir)
  */
 static int
 Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
-	       MAILSTREAM **master)
+	       MAILSTREAM **master, DisSyncRun *runPtr)
 {
     char buf[1024], *name, *spec, *data, 
 	    *header, *body, localMailbox[1024], datebuf[128], *cPtr;
     MESSAGECACHE *elt;
     unsigned long uid, msgno, lastUid, uidvalidity, len, nmsgs;
     MAILSTREAM *masterStream, *localStream;
-    Tcl_HashTable *mapPtr;
+    RatDisMap *mapPtr;
     RatFolderInfoPtr infoPtr = NULL;
     DisFolderInfo *disPtr = NULL;
     Tcl_HashEntry *entryPtr;
-    Tcl_HashSearch search;
     Tcl_CmdInfo cmdInfo;
     ENVELOPE *envPtr;
     int fd, i, *masterErrorPtr, error;
@@ -1076,7 +1329,12 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
 	Tcl_DecrRefCount(oPtr);
     }
 
-    RatLogF(interp, RAT_INFO, "synchronizing", RATLOG_EXPLICIT, name);
+    if (runPtr && 1 < runPtr->num) {
+	RatLogF(interp, RAT_INFO, "synchronizing_n", RATLOG_EXPLICIT, name,
+		runPtr->next, runPtr->num);
+    } else {
+	RatLogF(interp, RAT_INFO, "synchronizing", RATLOG_EXPLICIT, name);
+    }
 
     /*
      * Open connection
@@ -1104,7 +1362,7 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
 	localStream = disPtr->local;
 	masterStream = disPtr->master;
 	masterErrorPtr = &disPtr->error;
-	mapPtr = &disPtr->map;
+	mapPtr = disPtr->map;
 	if (disPtr->lastUid) {
 	    lastUid = disPtr->lastUid;
 	}
@@ -1112,9 +1370,7 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
 	snprintf(localMailbox, sizeof(localMailbox), "%s/folder", dir);
 	masterStream = NIL;
 	localStream = mail_open(NIL, localMailbox, NIL);
-	mapPtr = (Tcl_HashTable*)ckalloc(sizeof(*mapPtr));
-	Tcl_InitHashTable(mapPtr, TCL_ONE_WORD_KEYS);
-	ReadMappings(localStream, dir, mapPtr);
+	mapPtr = RatDisMapOpen(dir, localStream);
 	masterErrorPtr = &error;
     }
     if (!masterStream) {
@@ -1247,12 +1503,10 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
      * Download new messages
      */
     nmsgs = localStream->nmsgs;
-    snprintf(buf, sizeof(buf), "%s/mappings", dir);
-    fp = fopen(buf, "a");
     lastUid = DisDownloadMsgs(interp, masterStream, localStream,
 			      masterErrorPtr,
                               (disPtr ? &disPtr->diskfull : NULL),
-                              dir, mapPtr, fp, lastUid, 0);
+                              dir, mapPtr, lastUid, 0);
 
     /*
      * Loop over messages and update
@@ -1350,13 +1604,9 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
 				   envPtr->in_reply_to, envPtr->message_id,
 				   (char*)envPtr->date,
                                    mail_uid(localStream, i), &ds,
-				   datebuf, MsgFlags(elt), fp, mapPtr);
-	    if (disPtr) {
-		disPtr->mapChanged = 1;
-	    }
+				   datebuf, MsgFlags(elt), mapPtr);
 	}
     }
-    fclose(fp);
 
     /*
      * Update state file
@@ -1370,13 +1620,8 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
      * Cleanup
      */
     if (!disPtr) {
+	RatDisMapClose(mapPtr);
 	mail_close(localStream);
-	for (entryPtr = Tcl_FirstHashEntry(mapPtr, &search); entryPtr;
-		entryPtr = Tcl_NextHashEntry(&search)) {
-	    ckfree(Tcl_GetHashValue(entryPtr));
-	}
-	Tcl_DeleteHashTable(mapPtr);
-	ckfree(mapPtr);
 	Std_StreamClose(interp, masterStream);
 	masterStream = NULL;
     } else {
@@ -1414,13 +1659,8 @@ Dis_SyncFolder(Tcl_Interp *interp, CONST84 char *dir, off_t size, int force,
 error:
     RatLog(interp, RAT_INFO, "", RATLOG_EXPLICIT);
     if (!disPtr) {
+	RatDisMapClose(mapPtr);
 	mail_close(localStream);
-	for (entryPtr = Tcl_FirstHashEntry(mapPtr, &search); entryPtr;
-		entryPtr = Tcl_NextHashEntry(&search)) {
-	    ckfree(Tcl_GetHashValue(entryPtr));
-	}
-	Tcl_DeleteHashTable(mapPtr);
-	ckfree(mapPtr);
     }
     if (masterStream) {
 	Std_StreamClose(interp, masterStream);
@@ -1437,19 +1677,62 @@ error:
     return TCL_ERROR;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * DisAppendNext
+ *
+ *	Append callback which feeds the messages of a download batch to
+ *	mail_append_multiple().
+ *
+ * Results:
+ *	Always T, *message is set to NIL when there are no more messages.
+ *
+ * Side effects:
+ *	Advances the batch position.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static long
+DisAppendNext(MAILSTREAM *stream, void *data, char **flags, char **date,
+	      STRING **message)
+{
+    DisDownloadBatch *batchPtr = (DisDownloadBatch*)data;
+    DisDownloadMsg *msgPtr;
+
+    if (batchPtr->next >= batchPtr->num) {
+	*message = NIL;
+	return T;
+    }
+    msgPtr = &batchPtr->msgs[batchPtr->next++];
+    INIT(&msgPtr->string, mail_string, Tcl_DStringValue(&msgPtr->ds),
+	 Tcl_DStringLength(&msgPtr->ds));
+    *flags = msgPtr->flags;
+    *date = msgPtr->date;
+    *message = &msgPtr->string;
+    return T;
+}
+
 /*
  *----------------------------------------------------------------------
  *
  * DisDownloadMsgs
  *
- *	Downloads a new message from the master folder to the local
- *	folder.
+ *	Downloads new messages from the master folder to the local
+ *	folder. The messages are handled in batches of DIS_DOWNLOAD_BATCH;
+ *	each batch is prefetched from the server with one command (if the
+ *	master is an IMAP4rev1 server) and appended to the local folder
+ *	in one operation. The mappings and state files are checkpointed
+ *	after each batch, so an interrupted download is resumed from the
+ *	last complete batch.
  *
  * Results:
  *	Last uid
  *
  * Side effects:
- *	The uidmap is updated (if one exists)
+ *	The uidmap is updated
  *
  *
  *----------------------------------------------------------------------
@@ -1458,25 +1741,26 @@ error:
 static unsigned long
 DisDownloadMsgs(Tcl_Interp *interp, MAILSTREAM *masterStream,
 		MAILSTREAM *localStream, int *masterErrorPtr, int *diskFullPtr,
-		CONST84 char *dir, Tcl_HashTable *mapPtr, FILE *mapFp,
+		CONST84 char *dir, RatDisMap *mapPtr,
 		unsigned long startAfterUid, unsigned long stopBeforeUid)
 {
-
-    ENVELOPE *envPtr;
+    DisDownloadBatch batch;
+    DisDownloadMsg *msgPtr;
     MESSAGECACHE *elt;
-    unsigned long len, uid;
-    char *body, *header, datebuf[128], statebuf[1024], statetmp[1024];
-    Tcl_DString ds;
-    STRING string;
+    unsigned long len, msgno, first, localUid, lastUid = startAfterUid;
+    char *body, *header, statebuf[1024], statetmp[1024];
+    Tcl_DString seq;
     SEARCHPGM *pgm;
-    int i, unused;
+    int i, j, n, num, ok, prefetch;
     FILE *stateFp;
-    long mapPos;
+    unsigned long mark;
+    long *msgnos;
 
     if (0 == masterStream->nmsgs) {
 	return masterStream->uid_last;
     }
     snprintf(statebuf, sizeof(statebuf), "%s/state", dir);
+    snprintf(statetmp, sizeof(statetmp), "%s.tmp", statebuf);
 
     pgm = mail_newsearchpgm();
     if (0 == stopBeforeUid) {
@@ -1487,161 +1771,193 @@ DisDownloadMsgs(Tcl_Interp *interp, MAILSTREAM *masterStream,
     pgm->uid->last = stopBeforeUid;
     searchResultNum = 0;
     mail_search_full(masterStream, NULL, pgm, SE_FREE);
-    for (i = 0; i < searchResultNum; i++) {
-	RatLogF(interp, RAT_INFO, "downloading", RATLOG_EXPLICIT, i+1,
-		searchResultNum);
-	envPtr = mail_fetchenvelope(masterStream, searchResultPtr[i]);
-	if (*masterErrorPtr) goto done;
-	elt = mail_elt(masterStream, searchResultPtr[i]);
-	if (*masterErrorPtr) goto done;
-	body = mail_fetchtext_full(masterStream, searchResultPtr[i], &len,
-				   FT_PEEK);
-	if (*masterErrorPtr) goto done;
-	header = mail_fetchheader(masterStream, searchResultPtr[i]);
-	if (*masterErrorPtr) goto done;
-	if (!body || !header) continue;
+
+    /*
+     * Take a copy of the result since searchResultPtr may be reused
+     * while we talk to the server.
+     */
+    if (0 == (num = searchResultNum)) {
+	return masterStream->uid_last;
+    }
+    msgnos = (long*)ckalloc(num*sizeof(long));
+    memcpy(msgnos, searchResultPtr, num*sizeof(long));
+    prefetch = !strcmp(masterStream->dtb->name, "imap");
+    batch.msgs = (DisDownloadMsg*)
+	ckalloc(DIS_DOWNLOAD_BATCH*sizeof(DisDownloadMsg));
+    Tcl_DStringInit(&seq);
+
+    for (i = 0; i < num; i += n) {
+	n = (num-i < DIS_DOWNLOAD_BATCH) ? num-i : DIS_DOWNLOAD_BATCH;
+
+	/*
+	 * Ask for the whole batch at once. Consecutive message numbers
+	 * are collapsed into ranges.
+	 */
+	if (prefetch) {
+	    Tcl_DStringSetLength(&seq, 0);
+	    for (j = 0; j < n; j++) {
+		char buf[64];
+
+		first = msgnos[i+j];
+		while (j+1 < n && msgnos[i+j+1] == msgnos[i+j]+1) {
+		    j++;
+		}
+		if (first == msgnos[i+j]) {
+		    snprintf(buf, sizeof(buf), "%s%lu",
+			     Tcl_DStringLength(&seq) ? "," : "", first);
+		} else {
+		    snprintf(buf, sizeof(buf), "%s%lu:%lu",
+			     Tcl_DStringLength(&seq) ? "," : "", first,
+			     (unsigned long)msgnos[i+j]);
+		}
+		Tcl_DStringAppend(&seq, buf, -1);
+	    }
+	    imap_prefetch_text(masterStream, Tcl_DStringValue(&seq), 0);
+	    if (*masterErrorPtr) goto done;
+	}
+
+	/*
+	 * Collect the messages of this batch
+	 */
+	batch.num = batch.next = 0;
+	for (j = 0; j < n; j++) {
+	    msgno = msgnos[i+j];
+	    RatLogF(interp, RAT_INFO, "downloading", RATLOG_EXPLICIT, i+j+1,
+		    num);
+	    elt = mail_elt(masterStream, msgno);
+	    body = mail_fetchtext_full(masterStream, msgno, &len, FT_PEEK);
+	    if (*masterErrorPtr) break;
+	    header = mail_fetchheader_full(masterStream, msgno, NIL, NIL,
+					   FT_PEEK);
+	    if (*masterErrorPtr) break;
+	    if (!body || !header) continue;
+
+	    msgPtr = &batch.msgs[batch.num++];
+	    msgPtr->uid = mail_uid(masterStream, msgno);
+	    Tcl_DStringInit(&msgPtr->ds);
+	    Tcl_DStringAppend(&msgPtr->ds, header, -1);
+	    Tcl_DStringAppend(&msgPtr->ds, body, len);
+	    mail_date(msgPtr->date, elt);
+	    msgPtr->flags = cpystr(RatPurgeFlags(MsgFlags(elt), 0));
+	}
+	if (0 == batch.num) {
+	    if (*masterErrorPtr) goto done;
+	    continue;
+	}
 
         /*
          * We must be careful here so we can undo what we do if any of
          * the later steps fails.
          */
-	uid = mail_uid(masterStream, searchResultPtr[i]);
-        mapPos = ftell(mapFp);
-	if (0 > fprintf(mapFp, "%ld %ld\n", uid, ++localStream->uid_last)
-            || 0 != fflush(mapFp)) {
-            goto disk_full;
-        }
-        snprintf(statetmp, sizeof(statetmp), "%s.tmp", statebuf);
+	ok = 1;
+	mark = RatDisMapMark(mapPtr);
+	localUid = localStream->uid_last;
+	for (j = 0; j < batch.num && ok; j++) {
+	    if (TCL_OK != RatDisMapAdd(mapPtr, ++localUid, batch.msgs[j].uid)) {
+		ok = 0;
+	    }
+	}
+	if (!ok) {
+	    RatDisMapRollback(mapPtr, mark);
+	    DisFreeBatch(&batch);
+	    goto disk_full;
+	}
 	stateFp = fopen(statetmp, "w");
-	if (0>fprintf(stateFp, "%ld\n%ld\n", masterStream->uid_validity,uid)){
-            fclose(stateFp);
-            unused = ftruncate(fileno(mapFp), mapPos);
+	if (NULL == stateFp
+	    || 0 > fprintf(stateFp, "%ld\n%ld\n", masterStream->uid_validity,
+			   batch.msgs[batch.num-1].uid)) {
+	    if (stateFp) {
+		fclose(stateFp);
+	    }
+	    RatDisMapRollback(mapPtr, mark);
+	    DisFreeBatch(&batch);
             goto disk_full;
         }
 	if (0 != fclose(stateFp)) {
-            unused = ftruncate(fileno(mapFp), mapPos);
+	    RatDisMapRollback(mapPtr, mark);
             unlink(statetmp);
+	    DisFreeBatch(&batch);
             goto disk_full;
         }
-        
-	Tcl_DStringInit(&ds);
-	Tcl_DStringAppend(&ds, header, -1);
-	Tcl_DStringAppend(&ds, body, len);
-	INIT(&string, mail_string, Tcl_DStringValue(&ds),
-	     Tcl_DStringLength(&ds));
-	mail_date(datebuf, elt);
-	if (T != mail_append_full(localStream, localStream->mailbox,
-                                  RatPurgeFlags(MsgFlags(elt), 0),
-                                  datebuf, &string)) {
-            Tcl_DStringFree(&ds);
-            unused = ftruncate(fileno(mapFp), mapPos);
+	if (T != mail_append_multiple(localStream, localStream->mailbox,
+				      DisAppendNext, &batch)) {
+	    RatDisMapRollback(mapPtr, mark);
             unlink(statetmp);
+	    DisFreeBatch(&batch);
             goto disk_full;
         }
-	Tcl_DStringFree(&ds);
 
-	masterStream->uid_last = uid;
+	/*
+	 * The batch is safely stored, commit the checkpoint.
+	 */
         rename(statetmp, statebuf);
+	lastUid = batch.msgs[batch.num-1].uid;
+	masterStream->uid_last = lastUid;
         if (diskFullPtr) {
             *diskFullPtr = 0;
         }
-        
-        /* Move upwards */
-	if (mapPtr) {
-	    unsigned long *lPtr = (unsigned long*)ckalloc(sizeof(*lPtr));
-	    Tcl_HashEntry *entryPtr;
-	    int unused;
-
-	    *lPtr = uid;
-	    entryPtr = Tcl_CreateHashEntry(mapPtr,
-					   (char*)(localStream->uid_last),
-					   &unused);
-	    Tcl_SetHashValue(entryPtr, lPtr);
-	}
+	localStream->uid_last = localUid;
+	DisFreeBatch(&batch);
+	if (*masterErrorPtr) goto done;
     }
  done:
+    ckfree(batch.msgs);
+    ckfree(msgnos);
+    Tcl_DStringFree(&seq);
     RatLog(interp, RAT_INFO, "", RATLOG_EXPLICIT);    
     return masterStream->uid_last;
 
  disk_full:
+    ckfree(batch.msgs);
+    ckfree(msgnos);
+    Tcl_DStringFree(&seq);
     if (diskFullPtr && !*diskFullPtr) {
         *diskFullPtr = 1;
         RatLogF(interp, RAT_ERROR, "sync_failed_disk_full", RATLOG_TIME);
     }
     RatLog(interp, RAT_INFO, "", RATLOG_EXPLICIT);
-    return startAfterUid;
+    return lastUid;
 }
 
-
 /*
  *----------------------------------------------------------------------
  *
- * GetMasterUID
+ * DisFreeBatch
  *
- *	Returns the UID in the master folder of the specified message
+ *	Frees the messages collected in a download batch.
  *
  * Results:
- *	The UID is returned or zero if the message is not present
+ *	None.
  *
  * Side effects:
- *	None
+ *	The batch is emptied.
  *
  *
  *----------------------------------------------------------------------
  */
-static unsigned long
-GetMasterUID(MAILSTREAM *s, Tcl_HashTable *mapPtr, int index)
-{
-    Tcl_HashEntry *entryPtr;
-
-    if ((entryPtr = Tcl_FindHashEntry(mapPtr, (char*)mail_uid(s, index+1)))) {
-	return *((unsigned long*)Tcl_GetHashValue(entryPtr));
-    } else {
-	return 0;
-    }
-}
 
-
-/*
- *----------------------------------------------------------------------
- *
- * UpdateFolderFlag --
- *
- *	Synchronizes a flag with master
- *
- * Results:
- *	None
- *
- * Side effects:
- *	None
- *
- *
- *----------------------------------------------------------------------
- */
 static void
-UpdateFolderFlag(Tcl_Interp *interp, DisFolderInfo *disPtr,
-	int index, RatFlag flag, int value)
+DisFreeBatch(DisDownloadBatch *batchPtr)
 {
-    int local, no;
-    
-    local = (*disPtr->getFlagProc)(disPtr->infoPtr, interp, index-1, flag);
-    if (value == local) {
-	return;
+    int i;
+
+    for (i = 0; i < batchPtr->num; i++) {
+	Tcl_DStringFree(&batchPtr->msgs[i].ds);
+	ckfree(batchPtr->msgs[i].flags);
     }
-    no = index-1;
-    (*disPtr->setFlagProc)(disPtr->infoPtr, interp, &no, 1, flag, value);
+    batchPtr->num = batchPtr->next = 0;
 }
 
-
+
 /*
  *----------------------------------------------------------------------
  *
- * ReadMappings --
+ * GetMasterUID
  *
- *	Reads the mappings-file into the given hash-table
+ *	Returns the UID in the master folder of the specified message
  *
  * Results:
- *	None
+ *	The UID is returned or zero if the message is not present
  *
  * Side effects:
  *	None
@@ -1649,41 +1965,19 @@ UpdateFolderFlag(Tcl_Interp *interp, DisFolderInfo *disPtr,
  *
  *----------------------------------------------------------------------
  */
-static void
-ReadMappings(MAILSTREAM *s, const char *dir, Tcl_HashTable *mapPtr)
+static unsigned long
+GetMasterUID(MAILSTREAM *s, RatDisMap *mapPtr, int index)
 {
-    Tcl_HashEntry *entryPtr;
-    char buf[1024];
-    int unused;
-    unsigned long *lPtr, uid;
-    FILE *fp;
-
-    snprintf(buf, sizeof(buf), "%s/mappings", dir);
-    if (NULL != (fp = fopen(buf, "r"))) {
-	buf[sizeof(buf)-1] = '\0';
-	while(fgets(buf, sizeof(buf)-1, fp) && !feof(fp)) {
-	    if (strchr(buf, '<')) {
-		ReadOldMappings(s, mapPtr, buf, sizeof(buf)-1, fp);
-		break;
-	    }
-	    buf[strlen(buf)-1] = '\0';
-	    uid = atol(strchr(buf, ' '));
-	    entryPtr = Tcl_CreateHashEntry(mapPtr, (char*)uid, &unused);
-	    lPtr = (unsigned long*)ckalloc(sizeof(unsigned long));
-	    *lPtr = atol(buf);
-	    Tcl_SetHashValue(entryPtr, lPtr);
-	}
-	fclose(fp);
-    }
+    return RatDisMapGet(mapPtr, mail_uid(s, index+1));
 }
 
 
 /*
  *----------------------------------------------------------------------
  *
- * ReadOldMappings --
+ * UpdateFolderFlag --
  *
- *	Reads the old style mappings-file into the given hash-table
+ *	Synchronizes a flag with master
  *
  * Results:
  *	None
@@ -1695,52 +1989,17 @@ ReadMappings(MAILSTREAM *s, const char *dir, Tcl_HashTable *mapPtr)
  *----------------------------------------------------------------------
  */
 static void
-ReadOldMappings(MAILSTREAM *s, Tcl_HashTable *mapPtr, char *buf, int buflen,
-	FILE *fp)
+UpdateFolderFlag(Tcl_Interp *interp, DisFolderInfo *disPtr,
+	int index, RatFlag flag, int value)
 {
-    Tcl_HashTable tmap;
-    Tcl_HashEntry *entryPtr;
-    Tcl_HashSearch search;
-    unsigned long *lPtr, l, uid;
-    ENVELOPE *envPtr;
-    int unused;
-
-    /*
-     * Read file into local hash-table tmap
-     */
-    Tcl_InitHashTable(&tmap, TCL_STRING_KEYS);
-    do {
-	buf[strlen(buf)-1] = '\0';
-	entryPtr = Tcl_CreateHashEntry(&tmap, strchr(buf, '<'), &unused);
-	lPtr = (unsigned long*)ckalloc(sizeof(unsigned long));
-	*lPtr = atol(buf);
-	Tcl_SetHashValue(entryPtr, lPtr);
-    } while (fgets(buf, buflen, fp) && !feof(fp));
-
-    /*
-     * Loop through folder and add the new mappings to the real map
-     */
-    for (l=1; l <= s->nmsgs; l++) {
-	envPtr = mail_fetch_structure(s, l, NIL, 0);
-	entryPtr = Tcl_FindHashEntry(&tmap, envPtr->message_id);
-	if (entryPtr) {
-	    uid = *(unsigned long*)Tcl_GetHashValue(entryPtr);
-	    entryPtr = Tcl_CreateHashEntry(mapPtr, (char*)mail_uid(s, l),
-		    &unused);
-	    lPtr = (unsigned long*)ckalloc(sizeof(unsigned long));
-	    *lPtr = uid;
-	    Tcl_SetHashValue(entryPtr, lPtr);
-	}
-    }
-
-    /*
-     * Free the temporary hashtable from memory
-     */
-    for (entryPtr = Tcl_FirstHashEntry(&tmap, &search); entryPtr;
-	    entryPtr = Tcl_NextHashEntry(&search)) {
-	ckfree(Tcl_GetHashValue(entryPtr));
+    int local, no;
+    
+    local = (*disPtr->getFlagProc)(disPtr->infoPtr, interp, index-1, flag);
+    if (value == local) {
+	return;
     }
-    Tcl_DeleteHashTable(&tmap);
+    no = index-1;
+    (*disPtr->setFlagProc)(disPtr->infoPtr, interp, &no, 1, flag, value);
 }
 
 
@@ -1806,7 +2065,7 @@ RatDisFolderDir(Tcl_Interp *interp, Tcl_Obj *defPtr)
     Tcl_DStringAppend(&ds, "+", 1);
     Tcl_DStringAppend(&ds,Tcl_GetString(mobjv[3]),Tcl_GetCharLength(mobjv[3]));
     Tcl_DStringAppend(&ds, "+imap", 5);
-    if (CreateDir(Tcl_DStringValue(&ds))) {
+    if (RatCreateDir(Tcl_DStringValue(&ds))) {
 	return NULL;
     }
     return Tcl_DStringValue(&ds);
@@ -1838,7 +2097,7 @@ Dis_SyncProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
 
     snprintf(buf, sizeof(buf), "%s/master", disPtr->dir);
     stat(buf, &sbuf);
-    return Dis_SyncFolder(interp, disPtr->dir, sbuf.st_size, 1, NULL);
+    return Dis_SyncFolder(interp, disPtr->dir, sbuf.st_size, 1, NULL, NULL);
 }
 
 
@@ -1916,11 +2175,19 @@ FreeUidMap(RatUidMap *uidMap)
 static unsigned long
 MsgNo(RatUidMap *uidMap, unsigned long uid)
 {
-    unsigned long i;
+    unsigned long lo = 0, hi = uidMap->size, mid;
 
-    for (i=0; i<uidMap->size; i++) {
-	if (uidMap->map[i] == uid) {
-	    return i+1;
+    /*
+     * The uids are strictly ascending so we can do a binary search
+     */
+    while (lo < hi) {
+	mid = lo + (hi-lo)/2;
+	if (uidMap->map[mid] == uid) {
+	    return mid+1;
+	} else if (uidMap->map[mid] < uid) {
+	    lo = mid+1;
+	} else {
+	    hi = mid;
 	}
     }
     return 0;
@@ -1946,7 +2213,6 @@ CheckDeletion(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
 {
     MAILSTREAM *stream = ((StdFolderInfo*)infoPtr->private)->stream;
     DisFolderInfo *disPtr = (DisFolderInfo*)infoPtr->private2;
-    Tcl_HashEntry *entryPtr;
     FILE *fp = NULL;
     char buf[1024];
     unsigned long uid;
@@ -1958,18 +2224,11 @@ CheckDeletion(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
 		snprintf(buf, sizeof(buf), "%s/changes", disPtr->dir);
 		fp = fopen(buf, "a");
 	    }
-	    uid = GetMasterUID(stream, &disPtr->map, i);
+	    uid = GetMasterUID(stream, disPtr->map, i);
 	    if (uid && NULL != fp) {
 		fprintf(fp, "delete %ld\n", uid);
 	    }
-	    entryPtr = Tcl_FindHashEntry(&disPtr->map, (char*)
-		    mail_uid(((StdFolderInfo*)infoPtr->private)->stream,
-			     i+1));
-	    if (entryPtr) {
-		disPtr->mapChanged = 1;
-		ckfree(Tcl_GetHashValue(entryPtr));
-		Tcl_DeleteHashEntry(entryPtr);
-	    }
+	    RatDisMapRemove(disPtr->map, mail_uid(stream, i+1));
 	}
     }
     if (NULL != fp) {
@@ -2000,13 +2259,11 @@ DisUploadMsg(MAILSTREAM *masterStream, MAILSTREAM *localStream,
 	     const char *message_id, char *envdate,
 	     unsigned long local_uid,
 	     Tcl_DString *message, char *date,
-	     char *flags, FILE *mapFP, Tcl_HashTable *mapPtr)
+	     char *flags, RatDisMap *mapPtr)
 {
-    Tcl_HashEntry *entryPtr;
     SEARCHPGM *pgm;
     STRING string;
-    unsigned long *lPtr, uid;
-    int unused;
+    unsigned long uid;
 
     uid = masterStream->uid_last;
     
@@ -2040,13 +2297,7 @@ DisUploadMsg(MAILSTREAM *masterStream, MAILSTREAM *localStream,
     searchResultNum = 0;
     mail_search_full(masterStream, NULL, pgm, SE_FREE|SE_UID);
     if (searchResultNum == 1) {
-	fprintf(mapFP, "%ld %ld\n", searchResultPtr[0], local_uid);
-	if (mapPtr) {
-	    lPtr = (unsigned long*)ckalloc(sizeof(*lPtr));
-	    *lPtr = searchResultPtr[0];
-	    entryPtr = Tcl_CreateHashEntry(mapPtr, (char*)local_uid, &unused);
-	    Tcl_SetHashValue(entryPtr, lPtr);
-	}
+	RatDisMapAdd(mapPtr, local_uid, searchResultPtr[0]);
 	masterStream->uid_last = searchResultPtr[0];
 	return searchResultPtr[0];
     } else {
@@ -2086,46 +2337,6 @@ Dis_HandleExpunged(void *state, unsigned long index)
     disPtr->expunged++;
 }
 
-/*
- *----------------------------------------------------------------------
- *
- * WriteMappings --
- *
- *      Writes the mappings-file
- *
- * Results:
- *	None
- *
- * Side effects:
- *	None
- *
- *
- *----------------------------------------------------------------------
- */
-static void
-WriteMappings(DisFolderInfo *disPtr)
-{
-    Tcl_HashEntry *entryPtr;
-    Tcl_HashSearch search;
-    unsigned long *lPtr;
-    char buf[1024];
-    FILE *fp;
-    
-    if (!disPtr->mapChanged) {
-	return;
-    }
-    snprintf(buf, sizeof(buf), "%s/mappings", disPtr->dir);
-    fp = fopen(buf, "w");
-    for (entryPtr = Tcl_FirstHashEntry(&disPtr->map, &search); entryPtr;
-	    entryPtr = Tcl_NextHashEntry(&search)) {
-	lPtr = (unsigned long*)Tcl_GetHashValue(entryPtr);
-	fprintf(fp, "%ld %ld\n", *lPtr,
-		    (unsigned long)Tcl_GetHashKey(&disPtr->map, entryPtr));
-    }
-    fclose(fp);
-    disPtr->mapChanged = 0;
-}
-
 /*
  *----------------------------------------------------------------------
  *
@@ -2192,7 +2403,7 @@ RatDisOnOffTrans(Tcl_Interp *interp, int newState)
 	    snprintf(buf, sizeof(buf), "%s/master", disPtr->dir);
 	    stat(buf, &sbuf);
 	    if (TCL_OK == Dis_SyncFolder(interp,disPtr->dir, sbuf.st_size,
-					 1, &disPtr->master)) {
+					 1, &disPtr->master, NULL)) {
 		allfail = 0;
 	    }
 	    
@@ -0,0 +1,772 @@
+/*
+ * ratDisMap.c --
+ *
+ *	This file contains the store which maps the uids of the messages
+ *	in the local copy of a disconnected folder to the uids in the
+ *	master folder.
+ *
+ *	The map is kept in the file uidmap in the folder directory. The
+ *	file starts with a sorted part, which is mapped into memory and
+ *	searched in place, followed by a log of changes which is appended
+ *	to as the map is modified. When the log grows too large the file
+ *	is rewritten with the log merged into the sorted part. All numbers
+ *	are stored as 32 bit big endian values:
+ *		"RatMap1\n"	- magic
+ *		count		- number of entries in sorted part
+ *		0		- reserved
+ *		local[count]	- local uids in ascending order
+ *		master[count]	- corresponding master uids
+ *		local master	- log entries, master is 0 if the local
+ *				  message has been removed
+ *
+ *	Older versions used a text file called mappings. That file is
+ *	converted automatically the first time the folder is opened.
+ *
+ * TkRat software and its included text is Copyright 1996-2004 by
+ * Martin Forssn
+ *
+ * The full text of the legal notice is contained in the file called
+ * COPYRIGHT, included with this distribution.
+ */
+
+#include "ratFolder.h"
+#include <sys/mman.h>
+
+#define MAGIC "RatMap1\n"
+#define HEADER_SIZE 16
+
+/*
+ * The log is merged into the sorted part once it contains more than
+ * this many entries and more than 1/8 of the number of sorted entries.
+ */
+#define MIN_LOG 1024
+
+/*
+ * One mapping
+ */
+typedef struct {
+    unsigned long local;	/* Uid in local folder */
+    unsigned long master;	/* Uid in master folder (0 if removed) */
+} DisMapEntry;
+
+/*
+ * The map
+ */
+struct RatDisMap {
+    char *file;			/* Name of map file */
+    int fd;			/* Open file or -1 */
+    unsigned char *base;	/* Mapped sorted part (or NULL) */
+    size_t mapped;		/* Length of mapped region */
+    unsigned long count;	/* Number of entries in sorted part */
+    DisMapEntry *log;		/* Entries in log */
+    unsigned long logNum;	/* Number of entries in log */
+    unsigned long logAlloc;	/* Allocated size of log */
+    Tcl_HashTable logIndex;	/* Local uid -> index+1 in log */
+};
+
+/*
+ * Procedures private to this module.
+ */
+static unsigned long GetU32(const unsigned char *p);
+static void PutU32(unsigned char *p, unsigned long v);
+static int LoadMap(RatDisMap *mapPtr);
+static void UnloadMap(RatDisMap *mapPtr);
+static int WriteMapFile(const char *file, DisMapEntry *entries,
+			unsigned long num);
+static unsigned long ReadTextMappings(MAILSTREAM *s, FILE *fp,
+				      DisMapEntry **entriesPtr);
+static int CompareEntries(const void *p1, const void *p2);
+static int AppendLog(RatDisMap *mapPtr, unsigned long local,
+		     unsigned long master);
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetU32, PutU32 --
+ *
+ *	Read and write big endian 32 bit numbers.
+ *
+ * Results:
+ *	GetU32 returns the number.
+ *
+ * Side effects:
+ *	PutU32 writes four bytes at p.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+GetU32(const unsigned char *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+	| ((unsigned long)p[2] << 8) | (unsigned long)p[3];
+}
+
+static void
+PutU32(unsigned char *p, unsigned long v)
+{
+    p[0] = (v >> 24) & 0xff;
+    p[1] = (v >> 16) & 0xff;
+    p[2] = (v >> 8) & 0xff;
+    p[3] = v & 0xff;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapOpen --
+ *
+ *	Opens the uid map of the disconnected folder in dir. If only an
+ *	old style mappings file exists it is converted. The stream is the
+ *	local folder and is only needed when converting very old files
+ *	which map message-ids.
+ *
+ * Results:
+ *	A pointer to the map. This is never NULL, if the map can not be
+ *	read an empty map is returned.
+ *
+ * Side effects:
+ *	May create the uidmap file and remove the mappings file.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+RatDisMap*
+RatDisMapOpen(const char *dir, MAILSTREAM *s)
+{
+    RatDisMap *mapPtr = (RatDisMap*)ckalloc(sizeof(RatDisMap));
+    DisMapEntry *entries;
+    unsigned long num;
+    struct stat sbuf;
+    char buf[1024];
+    FILE *fp;
+
+    snprintf(buf, sizeof(buf), "%s/uidmap", dir);
+    mapPtr->file = cpystr(buf);
+    mapPtr->fd = -1;
+    mapPtr->base = NULL;
+    mapPtr->mapped = 0;
+    mapPtr->count = 0;
+    mapPtr->log = NULL;
+    mapPtr->logNum = mapPtr->logAlloc = 0;
+    Tcl_InitHashTable(&mapPtr->logIndex, TCL_ONE_WORD_KEYS);
+
+    if (stat(mapPtr->file, &sbuf)) {
+	/*
+	 * Convert old mappings file (or create an empty map)
+	 */
+	snprintf(buf, sizeof(buf), "%s/mappings", dir);
+	if (NULL != (fp = fopen(buf, "r"))) {
+	    num = ReadTextMappings(s, fp, &entries);
+	    fclose(fp);
+	} else {
+	    num = 0;
+	    entries = NULL;
+	}
+	if (TCL_OK == WriteMapFile(mapPtr->file, entries, num)) {
+	    unlink(buf);
+	}
+	if (entries) {
+	    ckfree(entries);
+	}
+    }
+    LoadMap(mapPtr);
+    return mapPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapClose --
+ *
+ *	Closes a map, merging the log first if it has grown large.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The map is freed.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+RatDisMapClose(RatDisMap *mapPtr)
+{
+    RatDisMapSync(mapPtr);
+    UnloadMap(mapPtr);
+    Tcl_DeleteHashTable(&mapPtr->logIndex);
+    ckfree(mapPtr->file);
+    ckfree(mapPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapGet --
+ *
+ *	Looks up the master uid of a local message.
+ *
+ * Results:
+ *	The master uid or zero if the message is not mapped.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+unsigned long
+RatDisMapGet(RatDisMap *mapPtr, unsigned long local)
+{
+    Tcl_HashEntry *entryPtr;
+    unsigned long lo, hi, mid, l;
+
+    if ((entryPtr = Tcl_FindHashEntry(&mapPtr->logIndex, (char*)local))) {
+	return mapPtr->log[(unsigned long)Tcl_GetHashValue(entryPtr)-1].master;
+    }
+    lo = 0;
+    hi = mapPtr->count;
+    while (lo < hi) {
+	mid = lo + (hi-lo)/2;
+	l = GetU32(mapPtr->base + HEADER_SIZE + 4*mid);
+	if (l == local) {
+	    return GetU32(mapPtr->base + HEADER_SIZE + 4*(mapPtr->count+mid));
+	} else if (l < local) {
+	    lo = mid+1;
+	} else {
+	    hi = mid;
+	}
+    }
+    return 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapAdd --
+ *
+ *	Adds a mapping from a local to a master uid.
+ *
+ * Results:
+ *	A standard Tcl result, TCL_ERROR means the mapping could not be
+ *	written to disk (it is still known in memory).
+ *
+ * Side effects:
+ *	Appends to the log.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+RatDisMapAdd(RatDisMap *mapPtr, unsigned long local, unsigned long master)
+{
+    return AppendLog(mapPtr, local, master);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapRemove --
+ *
+ *	Removes the mapping of a local message.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Appends to the log if the message was mapped.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+RatDisMapRemove(RatDisMap *mapPtr, unsigned long local)
+{
+    if (RatDisMapGet(mapPtr, local)) {
+	AppendLog(mapPtr, local, 0);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapMark, RatDisMapRollback --
+ *
+ *	RatDisMapMark returns a position in the log which later may be
+ *	passed to RatDisMapRollback to undo all changes done since.
+ *
+ * Results:
+ *	RatDisMapMark returns the mark.
+ *
+ * Side effects:
+ *	RatDisMapRollback truncates the log.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+unsigned long
+RatDisMapMark(RatDisMap *mapPtr)
+{
+    return mapPtr->logNum;
+}
+
+void
+RatDisMapRollback(RatDisMap *mapPtr, unsigned long mark)
+{
+    Tcl_HashEntry *entryPtr;
+    unsigned long i, j;
+    int isNew;
+
+    for (i = mapPtr->logNum; i > mark; i--) {
+	entryPtr = Tcl_FindHashEntry(&mapPtr->logIndex,
+				     (char*)mapPtr->log[i-1].local);
+	if (entryPtr) {
+	    Tcl_DeleteHashEntry(entryPtr);
+	}
+	for (j = mark; j > 0; j--) {
+	    if (mapPtr->log[j-1].local == mapPtr->log[i-1].local) {
+		entryPtr = Tcl_CreateHashEntry(&mapPtr->logIndex,
+					       (char*)mapPtr->log[j-1].local,
+					       &isNew);
+		Tcl_SetHashValue(entryPtr, (ClientData)j);
+		break;
+	    }
+	}
+    }
+    mapPtr->logNum = mark;
+    if (-1 != mapPtr->fd) {
+	isNew = ftruncate(mapPtr->fd,
+			  HEADER_SIZE + 8*mapPtr->count + 8*mark);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatDisMapSync --
+ *
+ *	Merges the log into the sorted part of the file if the log has
+ *	grown large.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	May rewrite the map file.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+RatDisMapSync(RatDisMap *mapPtr)
+{
+    DisMapEntry *entries, *logged;
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+    unsigned long i, j, n, nl, local;
+
+    if (mapPtr->logNum < MIN_LOG || mapPtr->logNum < mapPtr->count/8) {
+	return;
+    }
+
+    /*
+     * Collect the live log entries in order
+     */
+    logged = (DisMapEntry*)ckalloc((mapPtr->logIndex.numEntries+1)
+				   * sizeof(DisMapEntry));
+    for (nl = 0, entryPtr = Tcl_FirstHashEntry(&mapPtr->logIndex, &search);
+	 entryPtr; entryPtr = Tcl_NextHashEntry(&search)) {
+	i = (unsigned long)Tcl_GetHashValue(entryPtr)-1;
+	if (mapPtr->log[i].master) {
+	    logged[nl++] = mapPtr->log[i];
+	}
+    }
+    qsort(logged, nl, sizeof(DisMapEntry), CompareEntries);
+
+    /*
+     * Merge with the sorted entries not overridden by the log
+     */
+    entries = (DisMapEntry*)ckalloc((mapPtr->count+nl+1)*sizeof(DisMapEntry));
+    for (i = j = n = 0; i < mapPtr->count || j < nl; ) {
+	if (i < mapPtr->count) {
+	    local = GetU32(mapPtr->base + HEADER_SIZE + 4*i);
+	    if (Tcl_FindHashEntry(&mapPtr->logIndex, (char*)local)) {
+		i++;
+		continue;
+	    }
+	    if (j >= nl || local < logged[j].local) {
+		entries[n].local = local;
+		entries[n++].master =
+		    GetU32(mapPtr->base + HEADER_SIZE + 4*(mapPtr->count+i));
+		i++;
+		continue;
+	    }
+	}
+	entries[n++] = logged[j++];
+    }
+    ckfree(logged);
+
+    if (TCL_OK == WriteMapFile(mapPtr->file, entries, n)) {
+	UnloadMap(mapPtr);
+	LoadMap(mapPtr);
+    }
+    ckfree(entries);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadMap --
+ *
+ *	Opens and maps the map file and reads the log.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	Initializes the map structure.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LoadMap(RatDisMap *mapPtr)
+{
+    unsigned char header[HEADER_SIZE], *buf;
+    Tcl_HashEntry *entryPtr;
+    unsigned long i, n;
+    struct stat sbuf;
+    int isNew;
+
+    if (-1 == (mapPtr->fd = open(mapPtr->file, O_RDWR))) {
+	return TCL_ERROR;
+    }
+    if (fstat(mapPtr->fd, &sbuf)
+	|| HEADER_SIZE != SafeRead(mapPtr->fd, (char*)header, HEADER_SIZE)
+	|| memcmp(header, MAGIC, 8)
+	|| sbuf.st_size < HEADER_SIZE + 8*(off_t)GetU32(header+8)) {
+	close(mapPtr->fd);
+	mapPtr->fd = -1;
+	return TCL_ERROR;
+    }
+    mapPtr->count = GetU32(header+8);
+    if (mapPtr->count) {
+	mapPtr->mapped = HEADER_SIZE + 8*mapPtr->count;
+	mapPtr->base = (unsigned char*)mmap(NULL, mapPtr->mapped, PROT_READ,
+					    MAP_SHARED, mapPtr->fd, 0);
+	if (MAP_FAILED == (void*)mapPtr->base) {
+	    mapPtr->base = NULL;
+	    mapPtr->count = 0;
+	    close(mapPtr->fd);
+	    mapPtr->fd = -1;
+	    return TCL_ERROR;
+	}
+    }
+
+    /*
+     * Read the log, a partially written last entry is ignored.
+     */
+    n = (sbuf.st_size - HEADER_SIZE - 8*mapPtr->count) / 8;
+    if (n) {
+	buf = (unsigned char*)ckalloc(8*n);
+	lseek(mapPtr->fd, HEADER_SIZE + 8*mapPtr->count, SEEK_SET);
+	n = SafeRead(mapPtr->fd, (char*)buf, 8*n) / 8;
+	mapPtr->logAlloc = n+64;
+	mapPtr->log = (DisMapEntry*)
+	    ckalloc(mapPtr->logAlloc*sizeof(DisMapEntry));
+	for (i = 0; i < n; i++) {
+	    mapPtr->log[i].local = GetU32(buf+8*i);
+	    mapPtr->log[i].master = GetU32(buf+8*i+4);
+	    entryPtr = Tcl_CreateHashEntry(&mapPtr->logIndex,
+					   (char*)mapPtr->log[i].local,
+					   &isNew);
+	    Tcl_SetHashValue(entryPtr, (ClientData)(i+1));
+	}
+	mapPtr->logNum = n;
+	ckfree(buf);
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UnloadMap --
+ *
+ *	Unmaps and closes the map file and forgets the log.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UnloadMap(RatDisMap *mapPtr)
+{
+    Tcl_HashEntry *entryPtr;
+    Tcl_HashSearch search;
+
+    if (mapPtr->base) {
+	munmap((void*)mapPtr->base, mapPtr->mapped);
+	mapPtr->base = NULL;
+    }
+    if (-1 != mapPtr->fd) {
+	close(mapPtr->fd);
+	mapPtr->fd = -1;
+    }
+    for (entryPtr = Tcl_FirstHashEntry(&mapPtr->logIndex, &search); entryPtr;
+	 entryPtr = Tcl_NextHashEntry(&search)) {
+	Tcl_DeleteHashEntry(entryPtr);
+    }
+    if (mapPtr->log) {
+	ckfree(mapPtr->log);
+	mapPtr->log = NULL;
+    }
+    mapPtr->count = mapPtr->logNum = mapPtr->logAlloc = 0;
+    mapPtr->mapped = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendLog --
+ *
+ *	Adds an entry to the log, both in memory and on disk.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+AppendLog(RatDisMap *mapPtr, unsigned long local, unsigned long master)
+{
+    Tcl_HashEntry *entryPtr;
+    unsigned char buf[8];
+    int isNew, result = TCL_OK;
+
+    if (-1 == mapPtr->fd
+	|| -1 == lseek(mapPtr->fd,
+		       HEADER_SIZE + 8*mapPtr->count + 8*mapPtr->logNum,
+		       SEEK_SET)) {
+	result = TCL_ERROR;
+    } else {
+	PutU32(buf, local);
+	PutU32(buf+4, master);
+	if (8 != write(mapPtr->fd, (char*)buf, 8)) {
+	    isNew = ftruncate(mapPtr->fd,
+			      HEADER_SIZE + 8*mapPtr->count + 8*mapPtr->logNum);
+	    result = TCL_ERROR;
+	}
+    }
+    if (mapPtr->logNum == mapPtr->logAlloc) {
+	mapPtr->logAlloc += 1024;
+	mapPtr->log = (DisMapEntry*)ckrealloc((char*)mapPtr->log,
+		mapPtr->logAlloc*sizeof(DisMapEntry));
+    }
+    mapPtr->log[mapPtr->logNum].local = local;
+    mapPtr->log[mapPtr->logNum++].master = master;
+    entryPtr = Tcl_CreateHashEntry(&mapPtr->logIndex, (char*)local, &isNew);
+    Tcl_SetHashValue(entryPtr, (ClientData)mapPtr->logNum);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WriteMapFile --
+ *
+ *	Writes a new map file containing the given sorted entries.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	The file is replaced atomically.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WriteMapFile(const char *file, DisMapEntry *entries, unsigned long num)
+{
+    unsigned char buf[HEADER_SIZE];
+    char tmp[1024];
+    unsigned long i;
+    FILE *fp;
+    int ok;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", file);
+    if (NULL == (fp = fopen(tmp, "w"))) {
+	return TCL_ERROR;
+    }
+    memcpy(buf, MAGIC, 8);
+    PutU32(buf+8, num);
+    PutU32(buf+12, 0);
+    ok = (1 == fwrite(buf, HEADER_SIZE, 1, fp));
+    for (i = 0; ok && i < num; i++) {
+	PutU32(buf, entries[i].local);
+	ok = (1 == fwrite(buf, 4, 1, fp));
+    }
+    for (i = 0; ok && i < num; i++) {
+	PutU32(buf, entries[i].master);
+	ok = (1 == fwrite(buf, 4, 1, fp));
+    }
+    if (0 != fclose(fp) || !ok || rename(tmp, file)) {
+	unlink(tmp);
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadTextMappings --
+ *
+ *	Reads an old style mappings-file. Each line contains a master uid
+ *	followed by a local uid. In even older files the lines contained a
+ *	master uid and a message-id, these are mapped via the messages in
+ *	the local folder.
+ *
+ * Results:
+ *	The number of entries, a sorted array of them is left in
+ *	*entriesPtr (it should be freed with ckfree).
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+ReadTextMappings(MAILSTREAM *s, FILE *fp, DisMapEntry **entriesPtr)
+{
+    DisMapEntry *entries = NULL;
+    unsigned long num = 0, alloc = 0, l, master;
+    Tcl_HashTable tmap;
+    Tcl_HashEntry *entryPtr;
+    ENVELOPE *envPtr;
+    char buf[1024], *cPtr;
+    int isNew, old = 0;
+
+    Tcl_InitHashTable(&tmap, TCL_STRING_KEYS);
+    buf[sizeof(buf)-1] = '\0';
+    while (fgets(buf, sizeof(buf)-1, fp)) {
+	if ((cPtr = strchr(buf, '\n'))) {
+	    *cPtr = '\0';
+	}
+	master = atol(buf);
+	if ((cPtr = strchr(buf, '<'))) {
+	    old = 1;
+	    entryPtr = Tcl_CreateHashEntry(&tmap, cPtr, &isNew);
+	    Tcl_SetHashValue(entryPtr, (ClientData)master);
+	    continue;
+	}
+	if (NULL == (cPtr = strchr(buf, ' '))) {
+	    continue;
+	}
+	if (num == alloc) {
+	    alloc += 1024;
+	    entries = (DisMapEntry*)ckrealloc((char*)entries,
+					      alloc*sizeof(DisMapEntry));
+	}
+	entries[num].local = atol(cPtr);
+	entries[num++].master = master;
+    }
+
+    /*
+     * Resolve message-ids through the folder
+     */
+    if (old && s) {
+	for (l=1; l <= s->nmsgs; l++) {
+	    envPtr = mail_fetch_structure(s, l, NIL, 0);
+	    if (!envPtr->message_id
+		|| !(entryPtr = Tcl_FindHashEntry(&tmap, envPtr->message_id))) {
+		continue;
+	    }
+	    if (num == alloc) {
+		alloc += 1024;
+		entries = (DisMapEntry*)ckrealloc((char*)entries,
+						  alloc*sizeof(DisMapEntry));
+	    }
+	    entries[num].local = mail_uid(s, l);
+	    entries[num++].master = (unsigned long)Tcl_GetHashValue(entryPtr);
+	}
+    }
+    Tcl_DeleteHashTable(&tmap);
+
+    /*
+     * Remove duplicates, the last mapping of a uid wins, and sort
+     */
+    Tcl_InitHashTable(&tmap, TCL_ONE_WORD_KEYS);
+    for (l = 0; l < num; l++) {
+	entryPtr = Tcl_CreateHashEntry(&tmap, (char*)entries[l].local,&isNew);
+	Tcl_SetHashValue(entryPtr, (ClientData)l);
+    }
+    for (l = master = 0; l < num; l++) {
+	entryPtr = Tcl_FindHashEntry(&tmap, (char*)entries[l].local);
+	if ((unsigned long)Tcl_GetHashValue(entryPtr) == l) {
+	    entries[master++] = entries[l];
+	}
+    }
+    num = master;
+    Tcl_DeleteHashTable(&tmap);
+    qsort(entries, num, sizeof(DisMapEntry), CompareEntries);
+    *entriesPtr = entries;
+    return num;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompareEntries --
+ *
+ *	qsort compare function for map entries.
+ *
+ * Results:
+ *	-1, 0 or 1 depending on the order of the local uids.
+ *
+ * Side effects:
+ *	None.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompareEntries(const void *p1, const void *p2)
+{
+    const DisMapEntry *e1 = (const DisMapEntry*)p1;
+    const DisMapEntry *e2 = (const DisMapEntry*)p2;
+
+    if (e1->local < e2->local) {
+	return -1;
+    } else if (e1->local > e2->local) {
+	return 1;
+    }
+    return 0;
+}
@@ -802,6 +802,9 @@ RatFolderCmdSetFlag(Tcl_Interp *interp, RatFolderInfo *infoPtr, int *ilist,
  *				  and sort the groups by the earliest date
  *				  in each group.
  *
+ *	If the folder provides a sortProc it is given the first chance
+ *	to do the sorting, the code below is only used as a fallback.
+ *
  * Results:
  *	None.
  *
@@ -829,6 +832,21 @@ RatFolderSort(Tcl_Interp *interp, RatFolderInfo *infoPtr)
     if (0 == infoPtr->number) {
 	return;
     }
+
+    /*
+     * Let the folder sort itself if it can (e.g. server side sorting)
+     */
+    if (SORT_NONE != infoPtr->sortOrder && infoPtr->sortProc
+	&& TCL_OK == (*infoPtr->sortProc)(infoPtr, interp)) {
+	if (infoPtr->reverse) {
+	    for (i=0, j=infoPtr->number-1; i < j; i++, j--) {
+		k = p[i];
+		p[i] = p[j];
+		p[j] = k;
+	    }
+	}
+	return;
+    }
     
     switch(infoPtr->sortOrder) {
         case SORT_NONE:
@@ -1570,22 +1588,23 @@ RatGetMsgInfo(Tcl_Interp *interp, RatFolderInfoType type, MessageInfo *msgPtr,
 	    } else {
 		dateEltPtr = eltPtr;
 	    }
-	    tm.tm_sec = dateEltPtr->seconds;
-	    tm.tm_min = dateEltPtr->minutes;
-	    tm.tm_hour = dateEltPtr->hours;
-	    tm.tm_mday = dateEltPtr->day;
-	    tm.tm_mon = dateEltPtr->month - 1;
-	    tm.tm_year = dateEltPtr->year+70;
-	    tm.tm_wday = 0;
-	    tm.tm_yday = 0;
-	    tm.tm_isdst = -1;
-            /* time represents the time the message was sent, without
-             * the time zone factor. So when rendered in gmt it gives
-             * correct date/time. */
-            time = mktime(&tm);
             if (RAT_FOLDER_DATE_F == type) {
+                tm.tm_sec = dateEltPtr->seconds;
+                tm.tm_min = dateEltPtr->minutes;
+                tm.tm_hour = dateEltPtr->hours;
+                tm.tm_mday = dateEltPtr->day;
+                tm.tm_mon = dateEltPtr->month - 1;
+                tm.tm_year = dateEltPtr->year+70;
+                tm.tm_wday = 0;
+                tm.tm_yday = 0;
+                tm.tm_isdst = -1;
+                mktime(&tm);
                 oPtr = RatFormatDate(interp, &tm);
             } else {
+                /* time represents the time the message was sent, without
+                 * the time zone factor. So when rendered in gmt it gives
+                 * correct date/time. */
+                time = RatMkTime(dateEltPtr);
                 /* To get the real time of sending we must add the
                  * time zone offset. */
                 zonediff = (dateEltPtr->zhours*60+dateEltPtr->zminutes)*60;
@@ -1836,6 +1855,83 @@ RatParseFrom(const char *from)
     return &elt;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatMkTime --
+ *
+ *	Convert the date in an elt, taken as local time, to a time_t
+ *	just like mktime() would. The result of mktime() for the start
+ *	of each day is remembered, since the messages in a folder tend
+ *	to come in bunches and mktime() has to consult the time zone
+ *	rules every time. Days which are not exactly 24 hours long, that
+ *	is days with a daylight saving time change, are never remembered.
+ *
+ * Results:
+ *	The time, or -1 if it can not be represented.
+ *
+ * Side effects:
+ *	None
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+#define RAT_MKTIME_CACHE 64
+
+time_t
+RatMkTime(MESSAGECACHE *eltPtr)
+{
+    static struct {
+	unsigned long day;	/* Day this entry is for (0 = unused) */
+	time_t time;		/* mktime() of the start of that day */
+    } cache[RAT_MKTIME_CACHE];
+    unsigned long day;
+    time_t start, end;
+    struct tm tm;
+    int i, ok;
+
+    day = (((unsigned long)eltPtr->year << 9) + (eltPtr->month << 5)
+	    + eltPtr->day) + 1;
+    i = day % RAT_MKTIME_CACHE;
+    if (cache[i].day != day) {
+	tm.tm_sec = 0;
+	tm.tm_min = 0;
+	tm.tm_hour = 0;
+	tm.tm_mday = eltPtr->day;
+	tm.tm_mon = eltPtr->month - 1;
+	tm.tm_year = eltPtr->year+70;
+	tm.tm_wday = 0;
+	tm.tm_yday = 0;
+	tm.tm_isdst = -1;
+	start = mktime(&tm);
+	ok = ((time_t)-1 != start && 0 == tm.tm_hour && 0 == tm.tm_min
+		&& eltPtr->day == tm.tm_mday);
+	tm.tm_sec = 59;
+	tm.tm_min = 59;
+	tm.tm_hour = 23;
+	tm.tm_mday = eltPtr->day;
+	tm.tm_mon = eltPtr->month - 1;
+	tm.tm_year = eltPtr->year+70;
+	tm.tm_isdst = -1;
+	end = mktime(&tm);
+	if (!ok || end - start != 24*60*60-1 || eltPtr->day != tm.tm_mday) {
+	    tm.tm_sec = eltPtr->seconds;
+	    tm.tm_min = eltPtr->minutes;
+	    tm.tm_hour = eltPtr->hours;
+	    tm.tm_mday = eltPtr->day;
+	    tm.tm_mon = eltPtr->month - 1;
+	    tm.tm_year = eltPtr->year+70;
+	    tm.tm_isdst = -1;
+	    return mktime(&tm);
+	}
+	cache[i].day = day;
+	cache[i].time = start;
+    }
+    return cache[i].time
+	    + (eltPtr->hours*60 + eltPtr->minutes)*60 + eltPtr->seconds;
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -161,6 +161,14 @@ typedef enum {SORT_NONE, SORT_SUBJECT, SORT_SUBJDATE, SORT_THREADED,
  *
  * int syncProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
  *	Does a network synchronization for the given folder
+ *
+ * int sortProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
+ *	Optional. Lets the folder sort itself (typically by asking the
+ *	server to do it) according to infoPtr->sortOrder. On success it
+ *	should fill in presentationOrder (without honouring the reverse
+ *	flag), the RAT_FOLDER_THREADING info if threading and the size
+ *	member, and return TCL_OK. If it returns TCL_ERROR the generic
+ *	client side sort is used instead.
  */
 
 
@@ -185,6 +193,7 @@ typedef void (RatSetInfoProc) (Tcl_Interp *interp, ClientData clientData,
 typedef char* (RatCreateProc) (RatFolderInfoPtr infoPtr,
 	Tcl_Interp *interp, int index);
 typedef int (RatSyncProc) (RatFolderInfoPtr infoPtr, Tcl_Interp *interp);
+typedef int (RatSortProc) (RatFolderInfoPtr infoPtr, Tcl_Interp *interp);
 typedef Tcl_Obj* (RatDbInfoGetProc) (RatFolderInfoPtr infoPtr);
 typedef int (RatDbInfoSetProc) (Tcl_Interp *interp, RatFolderInfoPtr infoPtr,
                                 Tcl_Obj *indexes, Tcl_Obj *keywords,
@@ -235,6 +244,7 @@ typedef struct RatFolderInfo {
     RatSetInfoProc *setInfoProc;
     RatCreateProc *createProc;
     RatSyncProc *syncProc;
+    RatSortProc *sortProc;
     RatDbInfoGetProc *dbinfoGetProc;
     RatDbInfoSetProc *dbinfoSetProc;
     ClientData private, private2;  /* Data private for each folder type */
@@ -381,6 +391,7 @@ extern Tcl_Obj *RatGetMsgInfo(Tcl_Interp *interp, RatFolderInfoType type,
 	MESSAGECACHE *eltPtr, int size);
 extern char* MsgFlags(MESSAGECACHE *eltPtr);
 extern MESSAGECACHE *RatParseFrom(const char *from);
+extern time_t RatMkTime(MESSAGECACHE *eltPtr);
 extern int RatFolderClose(Tcl_Interp *interp, RatFolderInfo *infoPtr,
 			  int force);
 extern int RatFolderInsert(Tcl_Interp *interp, RatFolderInfo *infoPtr,
@@ -417,6 +428,19 @@ extern char* RatDisFolderDir(Tcl_Interp *interp, Tcl_Obj *defPtr);
 extern int RatDisOnOffTrans(Tcl_Interp *interp, int newState);
 extern void RatDisManageFolder(Tcl_Interp *interp, RatManagementAction op,
 			       Tcl_Obj *fptr);
+extern int RatCreateDir(char *dir);
+
+/* ratDisMap.c */
+typedef struct RatDisMap RatDisMap;
+extern RatDisMap *RatDisMapOpen(const char *dir, MAILSTREAM *s);
+extern void RatDisMapClose(RatDisMap *mapPtr);
+extern unsigned long RatDisMapGet(RatDisMap *mapPtr, unsigned long local);
+extern int RatDisMapAdd(RatDisMap *mapPtr, unsigned long local,
+			unsigned long master);
+extern void RatDisMapRemove(RatDisMap *mapPtr, unsigned long local);
+extern unsigned long RatDisMapMark(RatDisMap *mapPtr);
+extern void RatDisMapRollback(RatDisMap *mapPtr, unsigned long mark);
+extern void RatDisMapSync(RatDisMap *mapPtr);
 
 /* ratMessage.c */
 extern void RatInitMessages (void);
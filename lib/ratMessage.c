@@ -1458,7 +1458,6 @@ RatInsertMsg (Tcl_Interp *interp, MessageInfo *msgPtr, char *keywords,
     char *eFrom, *header, *body, *s, *e, *d;
     Tcl_DString dString;
     int result, i;
-    struct tm tm;
     time_t date = 0, exTime;
     Tcl_Obj *oPtr, **listObjv, **elemObjv;
 
@@ -1507,16 +1506,7 @@ RatInsertMsg (Tcl_Interp *interp, MessageInfo *msgPtr, char *keywords,
 	    }
 	} else if (!strcasecmp(key, "date")) {
 	    if (T == mail_parse_date(&elt, (unsigned char*)value)) {
-		tm.tm_sec = elt.seconds;
-		tm.tm_min = elt.minutes;
-		tm.tm_hour = elt.hours;
-		tm.tm_mday = elt.day;
-		tm.tm_mon = elt.month - 1;
-		tm.tm_year = elt.year+70;
-		tm.tm_wday = 0;
-		tm.tm_yday = 0;
-		tm.tm_isdst = -1;
-		date = (int)mktime(&tm);
+		date = (int)RatMkTime(&elt);
 	    } else {
 		date = 0;
 	    }
@@ -13,6 +13,7 @@
 
 #include "ratStdFolder.h"
 #include <mbx.h>
+#include <imap4r1.h>
 
 /*
  * We use this structure to keep a list of open connections
@@ -112,6 +113,9 @@ static RatUpdateProc Std_UpdateProc;
 static RatInsertProc Std_InsertProc;
 static RatSetFlagProc Std_SetFlagProc;
 static RatGetFlagProc Std_GetFlagProc;
+static RatSortProc Std_SortProc;
+static void Std_SortThread(THREADNODE *thr, int number, int *p, int *jPtr,
+			   Tcl_Obj **tPtr, int *seen, int depth, int more);
 static Tcl_TimerProc CloseConnection;
 static Tcl_ObjCmdProc RatImportCmd;
 static Tcl_ObjCmdProc RatTestImportCmd;
@@ -123,6 +127,7 @@ static HandleExists Std_HandleExists;
 static HandleExpunged Std_HandleExpunged;
 static RatStdFolderType Std_GetType(const char *spec);
 static void RatDeleteVFolderStruct(Tcl_Interp *interp, int id);
+static Tcl_FileProc Std_NotifyProc;
 
 
 /*
@@ -159,9 +164,96 @@ RatStdFolderInit(Tcl_Interp *interp)
 
     Tcl_CreateObjCommand(interp, "RatImport", RatImportCmd, NULL, NULL);
     Tcl_CreateObjCommand(interp, "RatTestImport", RatTestImportCmd, NULL,NULL);
+    RatStdNotifyInit(interp);
     return TCL_OK;
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RatStdNotifyInit --
+ *
+ *      Installs or removes the file handler which listens for change
+ *	notifications on local mailboxes. Should be called whenever the
+ *	change_notify option is modified.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A file handler may be created or deleted.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+RatStdNotifyInit(Tcl_Interp *interp)
+{
+    static int notifyFd = -1;
+    int fd;
+
+    if (!mail_parameters(NIL, GET_NOTIFYFD, (void*)&fd)) {
+	fd = -1;
+    }
+    if (fd == notifyFd) {
+	return;
+    }
+    if (notifyFd >= 0) {
+	Tcl_DeleteFileHandler(notifyFd);
+    }
+    if (fd >= 0) {
+	Tcl_CreateFileHandler(fd, TCL_READABLE, Std_NotifyProc,
+			      (ClientData)interp);
+    }
+    notifyFd = fd;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Std_NotifyProc --
+ *
+ *      Called when c-client has change notifications pending. Updates
+ *	the open local folders so new messages show up at once instead
+ *	of at the next watcher tick. Pinging an unchanged local mailbox
+ *	is a no-op, so only the changed folders do any work.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Folders may be updated.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Std_NotifyProc(ClientData clientData, int mask)
+{
+    Tcl_Interp *interp = (Tcl_Interp*)clientData;
+    RatFolderInfo *infoPtr, *nextPtr;
+    StdFolderInfo *stdPtr;
+
+    if (!mail_parameters(NIL, GET_NOTIFYCHECK, NIL)) {
+	return;
+    }
+    for (infoPtr = ratFolderList; infoPtr; infoPtr = nextPtr) {
+	nextPtr = infoPtr->nextPtr;
+	if (strcmp(infoPtr->type, "std")) {
+	    continue;
+	}
+	stdPtr = (StdFolderInfo*)infoPtr->private;
+	if (RAT_UNIX == stdPtr->type || RAT_MH == stdPtr->type
+		|| RAT_MBX == stdPtr->type) {
+	    RatUpdateFolder(interp, infoPtr, RAT_UPDATE);
+	}
+    }
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -504,6 +596,7 @@ RatStdFolderCreate(Tcl_Interp *interp, int append_only, Tcl_Obj *defPtr)
     infoPtr->setInfoProc = Std_SetInfoProc;
     infoPtr->createProc = Std_CreateProc;
     infoPtr->syncProc = NULL;
+    infoPtr->sortProc = Std_SortProc;
     infoPtr->dbinfoGetProc = NULL;
     infoPtr->dbinfoSetProc = NULL;
     infoPtr->private = (ClientData) stdPtr;
@@ -1021,6 +1114,196 @@ Std_CreateProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int index)
     return RatStdMessageCreate(interp, infoPtr, stdPtr->stream, index);
 }
 
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Std_SortProc --
+ *
+ *      See the documentation for sortProc in ratFolder.h. This asks
+ *	IMAP servers which advertise SORT or THREAD=REFERENCES to do the
+ *	work so that we do not have to fetch the envelope of every message.
+ *
+ * Results:
+ *	TCL_OK if the folder was sorted, TCL_ERROR if the caller should
+ *	sort it locally.
+ *
+ * Side effects:
+ *	See the documentation for sortProc in ratFolder.h
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static int
+Std_SortProc(RatFolderInfoPtr infoPtr, Tcl_Interp *interp)
+{
+    StdFolderInfo *stdPtr = (StdFolderInfo *) infoPtr->private;
+    MAILSTREAM *stream = stdPtr->stream;
+    SORTPGM *pgm;
+    THREADNODE *thr;
+    Tcl_Obj **tPtr;
+    unsigned long *sorted;
+    int i, j, *p = infoPtr->presentationOrder, *seen;
+
+    if (!stream || RAT_IMAP != stdPtr->type || infoPtr->append_only
+	|| stream->nmsgs != (unsigned long)infoPtr->number
+	|| strcmp(stream->dtb->name, "imap")) {
+	return TCL_ERROR;
+    }
+
+    if (SORT_THREADED == infoPtr->sortOrder) {
+	THREADER *thrPtr;
+
+	for (thrPtr = imap_cap(stream)->threader;
+	     thrPtr && compare_cstring((unsigned char *)thrPtr->name,
+					(unsigned char *)"REFERENCES");
+	     thrPtr = thrPtr->next);
+	if (!thrPtr) {
+	    return TCL_ERROR;
+	}
+	thr = mail_thread(stream, "REFERENCES", NIL, mail_newsearchpgm(),
+			  SE_FREE | SE_NOLOCAL);
+	if (!thr) {
+	    return TCL_ERROR;
+	}
+	tPtr = (Tcl_Obj**)ckalloc(infoPtr->number*sizeof(Tcl_Obj*));
+	for (i=0; i<infoPtr->number; i++) {
+	    tPtr[i] = NULL;
+	}
+	seen = (int*)ckalloc(infoPtr->number*sizeof(int));
+	memset(seen, 0, infoPtr->number*sizeof(int));
+	j = 0;
+	Std_SortThread(thr, infoPtr->number, p, &j, tPtr, seen, 0, 0);
+	mail_free_threadnode(&thr);
+    } else {
+	if (!LEVELSORT(stream)) {
+	    return TCL_ERROR;
+	}
+	/*
+	 * SORT FROM compares the mailboxes of the senders while we order
+	 * them by name, so sender order is always done locally.
+	 */
+	pgm = mail_newsortpgm();
+	switch (infoPtr->sortOrder) {
+	case SORT_SUBJECT:	pgm->function = SORTSUBJECT; break;
+	case SORT_DATE:		pgm->function = SORTDATE; break;
+	case SORT_SIZE:		pgm->function = SORTSIZE; break;
+	default:
+	    mail_free_sortpgm(&pgm);
+	    return TCL_ERROR;
+	}
+	sorted = mail_sort(stream, NIL, mail_newsearchpgm(), pgm,
+			   SE_FREE | SO_FREE | SE_NOLOCAL);
+	if (!sorted) {
+	    return TCL_ERROR;
+	}
+	for (j=0; sorted[j] && j<infoPtr->number; j++) {
+	    if (sorted[j] > (unsigned long)infoPtr->number) {
+		break;
+	    }
+	    p[j] = sorted[j]-1;
+	}
+	ckfree(sorted);
+	tPtr = NULL;
+
+	/*
+	 * The server may return garbage. Check that we got a permutation.
+	 */
+	seen = (int*)ckalloc(infoPtr->number*sizeof(int));
+	memset(seen, 0, infoPtr->number*sizeof(int));
+	for (i=0; i<j; i++) {
+	    if (seen[p[i]]++) {
+		ckfree(seen);
+		return TCL_ERROR;
+	    }
+	}
+    }
+
+    /*
+     * The server may not know about every message we have. Append
+     * anything it did not mention in folder order.
+     */
+    for (i=0; i<infoPtr->number; i++) {
+	if (!seen[i]) {
+	    p[j++] = i;
+	}
+    }
+    ckfree(seen);
+
+    if (tPtr) {
+	for (i=0; i<infoPtr->number; i++) {
+	    (*infoPtr->setInfoProc)(interp, (ClientData)infoPtr,
+				    RAT_FOLDER_THREADING, i, tPtr[i]);
+	}
+	ckfree(tPtr);
+    }
+
+    infoPtr->size = 0;
+    for (i=1; i<=infoPtr->number; i++) {
+	infoPtr->size += mail_elt(stream, i)->rfc822_size;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Std_SortThread --
+ *
+ *      Linearizes a thread tree returned by the server into the
+ *	presentation order. The threading strings are built the same way
+ *	as RatFolderSortLinearize() in ratFolder.c does it. Dummy nodes
+ *	(num == 0) are not shown, their children are moved up one level.
+ *	A message the server lists more than once is only shown the first
+ *	time, which also keeps p from growing past number entries.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Fills in p (starting at *jPtr), tPtr and seen, and advances *jPtr.
+ *
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+Std_SortThread(THREADNODE *thr, int number, int *p, int *jPtr,
+	       Tcl_Obj **tPtr, int *seen, int depth, int more)
+{
+    THREADNODE *t;
+    int i, k, o;
+    char *c;
+
+    for (t = thr; t && *jPtr < number; t = t->branch) {
+	if (0 == t->num || t->num > (unsigned long)number
+		|| seen[t->num-1]) {
+	    Std_SortThread(t->next, number, p, jPtr, tPtr, seen, depth,
+			   (t->branch || more));
+	    continue;
+	}
+	i = t->num-1;
+	seen[i] = 1;
+	if (depth) {
+	    tPtr[i] = Tcl_NewObj();
+	    for (k=0; k<depth-1; k++) {
+		Tcl_AppendToObj(tPtr[i], " ", 1);
+	    }
+	    Tcl_AppendToObj(tPtr[i], "+", 1);
+	}
+	p[(*jPtr)++] = i;
+	if (t->next) {
+	    o = *jPtr;
+	    Std_SortThread(t->next, number, p, jPtr, tPtr, seen, depth+1, 0);
+	    if ((t->branch || more) && depth) {
+		while (o < *jPtr) {
+		    c = Tcl_GetStringFromObj(tPtr[p[o++]], NULL);
+		    c[depth-1] = '|';
+		}
+	    }
+	}
+    }
+}
+
 
 /*
  *----------------------------------------------------------------------
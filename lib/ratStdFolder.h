@@ -91,6 +91,16 @@ typedef struct StdFolderInfo {
     char *mailbox;              /* Mailbox specifier */
 } StdFolderInfo;
 
+/*
+ * A message read from the body cache (see ratBodyCache.c)
+ */
+typedef struct RatBodyCacheEntry {
+    char *data;			/* Header followed by text, NULL terminated */
+    unsigned long headerLength;	/* Length of header part of data */
+    unsigned long textLength;	/* Length of text part of data */
+    BODY *bodyPtr;		/* Body structure parsed from data */
+} RatBodyCacheEntry;
+
 /*
  * The ClientData for each message entity
  */
@@ -101,6 +111,7 @@ typedef struct StdMessageInfo {
     BODY *bodyPtr;
     RatStdFolderType type;
     char *spec;
+    RatBodyCacheEntry *cachePtr; /* Cached copy of message (or NULL) */
 } StdMessageInfo;
 
 /* ratStdMessage.c */
@@ -110,4 +121,13 @@ extern void RatStdMsgStructInit(RatFolderInfoPtr infoPtr, Tcl_Interp *interp,
 extern char *RatStdMessageCreate (Tcl_Interp *interp, RatFolderInfoPtr infoPtr,
 				  MAILSTREAM *stream, int msgNo);
 
+/* ratBodyCache.c */
+extern RatBodyCacheEntry *RatBodyCacheGet(Tcl_Interp *interp,
+					  MAILSTREAM *stream,
+					  unsigned long msgNo, int fetch);
+extern char *RatBodyCacheSection(RatBodyCacheEntry *entryPtr,
+				 const char *section, unsigned long *lengthPtr);
+extern void RatBodyCacheRelease(RatBodyCacheEntry *entryPtr);
+extern Tcl_ObjCmdProc RatBodyCacheCmd;
+
 #endif /* _RATSTDFOLDER */
@@ -90,8 +90,22 @@ RatStdMessageCreate(Tcl_Interp *interp, RatFolderInfoPtr folderInfoPtr,
     MessageInfo *msgPtr = (MessageInfo*)folderInfoPtr->privatePtr[msgNo];
     StdMessageInfo *stdMsgPtr = (StdMessageInfo*)msgPtr->clientData;
 
-    stdMsgPtr->envPtr =
-	mail_fetchstructure_full(stream, msgNo+1, &stdMsgPtr->bodyPtr, NIL);
+    /*
+     * Use the body structure of the cached copy if we have one, this
+     * saves us a round trip to the server.
+     */
+    if (RAT_IMAP == stdMsgPtr->type && !stdMsgPtr->cachePtr) {
+	stdMsgPtr->cachePtr = RatBodyCacheGet(interp, stream, msgNo+1, 0);
+    }
+    if (stdMsgPtr->cachePtr) {
+	if (!stdMsgPtr->envPtr) {
+	    stdMsgPtr->envPtr = mail_fetchenvelope(stream, msgNo+1);
+	}
+	stdMsgPtr->bodyPtr = stdMsgPtr->cachePtr->bodyPtr;
+    } else {
+	stdMsgPtr->envPtr = mail_fetchstructure_full(stream, msgNo+1,
+						     &stdMsgPtr->bodyPtr, NIL);
+    }
     stdMsgPtr->eltPtr = mail_elt(stream, msgNo+1);
     stdMsgPtr->eltPtr->lockcount++;
     stdMsgPtr->spec = cpystr(stream->mailbox);
@@ -227,8 +241,16 @@ Std_GetHeadersProc(Tcl_Interp *interp, MessageInfo *msgPtr)
     static char *header = NULL;
     static int headerSize = 0;
     unsigned long length;
-    char *fetchedHeader = mail_fetchheader_full(stdMsgPtr->stream,
-	    msgPtr->msgNo+1, NIL, &length, NIL);
+    char *fetchedHeader;
+
+    if (stdMsgPtr->cachePtr) {
+	fetchedHeader = stdMsgPtr->cachePtr->data;
+	length = stdMsgPtr->cachePtr->headerLength;
+    } else {
+	fetchedHeader = mail_fetchheader_full(stdMsgPtr->stream,
+					      msgPtr->msgNo+1, NIL, &length,
+					      NIL);
+    }
 
     if (length > 2 && fetchedHeader[length-3] == '\n') {
 	length -= 2;
@@ -347,6 +369,14 @@ char*
 Std_FetchTextProc(Tcl_Interp *interp, MessageInfo *msgPtr)
 {
     StdMessageInfo *stdMsgPtr = (StdMessageInfo*)msgPtr->clientData;
+
+    if (RAT_IMAP == stdMsgPtr->type && !stdMsgPtr->cachePtr) {
+	stdMsgPtr->cachePtr = RatBodyCacheGet(interp, stdMsgPtr->stream,
+					      msgPtr->msgNo+1, 1);
+    }
+    if (stdMsgPtr->cachePtr) {
+	return stdMsgPtr->cachePtr->data + stdMsgPtr->cachePtr->headerLength;
+    }
     return mail_fetchtext_full(stdMsgPtr->stream, msgPtr->msgNo+1, NIL, NIL);
 }
 
@@ -385,6 +415,9 @@ Std_MsgDeleteProc(MessageInfo *msgPtr)
 
     infoPtr->privatePtr[msgPtr->msgNo] = NULL;
     stdMsgPtr->eltPtr->lockcount--;
+    if (stdMsgPtr->cachePtr) {
+	RatBodyCacheRelease(stdMsgPtr->cachePtr);
+    }
     ckfree(stdMsgPtr->spec);
     ckfree(stdMsgPtr);
 }
@@ -450,13 +483,24 @@ char*
 Std_FetchBodyProc(BodyInfo *bodyInfoPtr, unsigned long *lengthPtr)
 {
     StdMessageInfo *stdMsgPtr=(StdMessageInfo*)bodyInfoPtr->msgPtr->clientData;
+    char *section = ((StdBodyInfo*)(bodyInfoPtr->clientData))->section;
+    char *data;
 
     if (bodyInfoPtr->decodedTextPtr) {
 	*lengthPtr = Tcl_DStringLength(bodyInfoPtr->decodedTextPtr);
 	return Tcl_DStringValue(bodyInfoPtr->decodedTextPtr);
     }
+    if (RAT_IMAP == stdMsgPtr->type && !stdMsgPtr->cachePtr) {
+	stdMsgPtr->cachePtr = RatBodyCacheGet(timerInterp, stdMsgPtr->stream,
+					      bodyInfoPtr->msgPtr->msgNo+1, 1);
+    }
+    if (stdMsgPtr->cachePtr
+	&& (data = RatBodyCacheSection(stdMsgPtr->cachePtr, section,
+				       lengthPtr))) {
+	return data;
+    }
     return mail_fetchbody_full(stdMsgPtr->stream, bodyInfoPtr->msgPtr->msgNo+1,
-	    ((StdBodyInfo*)(bodyInfoPtr->clientData))->section, lengthPtr,NIL);
+	    section, lengthPtr, NIL);
 }
 
 
@@ -684,6 +728,7 @@ RatStdMsgStructInit(RatFolderInfoPtr infoPtr, Tcl_Interp *interp, int index,
 	stdMsgPtr->bodyPtr = NULL;
 	stdMsgPtr->type = type;
         stdMsgPtr->spec = NULL;
+	stdMsgPtr->cachePtr = NULL;
 	((MessageInfo*)infoPtr->privatePtr[i])->clientData =
 		(ClientData)stdMsgPtr;
     }
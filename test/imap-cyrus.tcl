@@ -13,7 +13,7 @@ set imap_def2 [list Test imap {} localhost ${imap_n}2]
 set imap_fn1 ${imap_n}1
 set imap_fn2 ${imap_n}2
 set dis_def [list Test dis {} localhost $imap_n]
-set imap_map $dir/disconnected/localhost:143/$imap_n+maf+imap/mappings
+set imap_map $dir/disconnected/localhost:143/$imap_n+maf+imap/uidmap
 set start_uid 1
 
 proc init_imap_folder {def} {
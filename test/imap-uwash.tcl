@@ -13,7 +13,7 @@ set imap_def2 [list Test imap {} localhost ${imap_fn}-2]
 set imap_fn1 ${imap_fn}-1
 set imap_fn2 ${imap_fn}-2
 set dis_def [list Test dis {} localhost $imap_fn]
-set imap_map $dir/disconnected/localhost:143$imap_fn+$env(USER)+imap/mappings
+set imap_map $dir/disconnected/localhost:143$imap_fn+$env(USER)+imap/uidmap
 set start_uid 11
 
 proc init_imap_folder {def} {
@@ -14,16 +14,13 @@ proc test_disoffline::verify_map {mf map} {
     foreach e $map {
 	set expected($e) 1
     }
-    if {![catch "open $mf r" f]} {
-	set f [open $mf r]
+    if {[file exists $mf]} {
 	file copy -force $mf $tmp/map
-	while {-1 != [gets $f line]} {
+	foreach line [read_map $mf] {
 	    if {[catch {unset expected($line)}]} {
-		close $f
 		return "Did not expect [list $line]"
 	    }
 	}
-	close $f
     }
     if {0 != [array size expected]} {
 	return "Did not find [list [array names expected]]"
@@ -31,6 +28,36 @@ proc test_disoffline::verify_map {mf map} {
     return ""
 }
 
+# Returns the "master local" pairs stored in a uidmap file. The sorted
+# part is followed by a log where a master uid of 0 removes the entry.
+proc test_disoffline::read_map {mf} {
+    set f [open $mf r]
+    fconfigure $f -translation binary
+    set data [read $f]
+    close $f
+    if {"RatMap1\n" != [string range $data 0 7]} {
+	return {}
+    }
+    binary scan $data @8I count
+    for {set i 0} {$i < $count} {incr i} {
+	binary scan $data @[expr {16+4*$i}]I local
+	binary scan $data @[expr {16+4*($count+$i)}]I master
+	set m($local) $master
+    }
+    for {set o [expr {16+8*$count}]} {$o+8 <= [string length $data]} \
+	    {incr o 8} {
+	binary scan $data @${o}II local master
+	set m($local) $master
+    }
+    set pairs {}
+    foreach local [array names m] {
+	if {0 != $m($local)} {
+	    lappend pairs "$m($local) $local"
+	}
+    }
+    return $pairs
+}
+
 proc test_disoffline::dis_verify {f map name {diff 0}} {
     variable uidmap
 
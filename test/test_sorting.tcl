@@ -4,7 +4,7 @@ namespace eval test_sorting {
 }
 
 proc test_sorting::test_sorting {} {
-    global option dir hdr mailServer \
+    global option dir hdr mailServer imap_def \
 	    msg1 msg2 msg3 msg4 msg5 msg6 msg7 msg8 msg9 msg10 \
 	    msg11 msg12 msg13 msg14 msg15 msg16 msg17 msg18 msg19
     variable tsmsg
@@ -52,7 +52,8 @@ proc test_sorting::test_sorting {} {
     file delete $fn
 
     foreach func {get_simple_thread get_back_thread
-	          get_real_thread get_strange_msgid get_mlist_subject} {
+	          get_real_thread get_strange_msgid get_mlist_subject
+	          get_missing_parent} {
 	set gts [eval $func]
 	StartTest "Sort order 'threaded' [lindex $gts 0] ..."
 
@@ -91,6 +92,87 @@ proc test_sorting::test_sorting {} {
             }
 	}
     }
+
+    # Let the server thread a folder with missing parents as well
+    set gts [get_missing_parent]
+    StartTest "Server threading [lindex $gts 0] ..."
+    init_imap_folder $imap_def
+    foreach msg [lindex $gts 1] {
+	insert_imap $imap_def $msg
+    }
+    set real [server_thread $imap_def]
+    cleanup_imap_folder $imap_def
+    if {"(1 2)(3 4)" != $real} {
+	ReportError "Server threading failed: <$real>"
+    }
+
+    # Sender order must not change when the server can sort
+    StartTest "Sort order 'senderonly' on server ..."
+    init_imap_folder $imap_def
+    foreach msg [get_senders] {
+	insert_imap $imap_def $msg
+    }
+    set f1 [RatOpenFolder $imap_def]
+    $f1 setSortOrder senderonly
+    $f1 update update
+    set current [$f1 list %s]
+    $f1 close
+    cleanup_imap_folder $imap_def
+    set expected {{sender 2} {sender 3} {sender 1}}
+    if {$expected != $current} {
+	ReportError "Server sender sort failed: <$current>"
+    }
+}
+
+# Messages whose personal names sort differently from their mailboxes
+proc test_sorting::get_senders {} {
+    lappend ml {
+From aaron@foo.bar Thu Sep  6 14:25:09 2001 -0400
+From: Zed Zimmer <aaron@foo.bar>
+Message-Id: <s1@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:00
+Subject: sender 1
+
+THIS: msg1
+}
+    lappend ml {
+From zoe@foo.bar Thu Sep  6 14:25:09 2001 -0400
+From: Adam Young <zoe@foo.bar>
+Message-Id: <s2@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:01
+Subject: sender 2
+
+THIS: msg2
+}
+    lappend ml {
+From mike@foo.bar Thu Sep  6 14:25:09 2001 -0400
+From: mike@foo.bar
+Message-Id: <s3@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:02
+Subject: sender 3
+
+THIS: msg3
+}
+    return $ml
+}
+
+# Returns the REFERENCES thread tree the server sends for a folder
+proc test_sorting::server_thread {def} {
+    global env
+
+    set fh [open "|$env(SSH) [lindex $def 3] exec /usr/sbin/imapd" r+]
+    fconfigure $fh -translation crlf -buffering line
+    gets $fh
+    puts $fh "a SELECT [lindex $def 4]"
+    while {0 <= [gets $fh line] && ![string match "a *" $line]} {}
+    puts $fh "b THREAD REFERENCES US-ASCII ALL"
+    set thread {}
+    while {0 <= [gets $fh line] && ![string match "b *" $line]} {
+	regexp {^\* THREAD (.*)$} $line unused thread
+    }
+    puts $fh "c LOGOUT"
+    catch {close $fh}
+    return $thread
 }
 
 proc test_sorting::get_simple_thread {} {
@@ -410,4 +492,50 @@ THIS: msg5
     return [list "mlist_subject" $ml $expected]
 }
 
-test_sorting::test_sorting
+proc test_sorting::get_missing_parent {} {
+    lappend ml {
+From maf@kilauea Thu Sep  6 14:25:09 2001 -0400
+Message-Id: <m2@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:00
+Subject: foo
+References: <m1@foo.bar>
+
+THIS: msg1
+}
+    lappend ml {
+From maf@kilauea Thu Sep  6 14:25:09 2001 -0400
+Message-Id: <m4@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:01
+Subject: Re: foo
+References: <m1@foo.bar> <m2@foo.bar> <m3@foo.bar>
+
+THIS: msg2
+}
+    lappend ml {
+From maf@kilauea Thu Sep  6 14:25:09 2001 -0400
+Message-Id: <m5@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:02
+Subject: other
+References: <m9@foo.bar> <m8@foo.bar>
+
+THIS: msg3
+}
+    lappend ml {
+From maf@kilauea Thu Sep  6 14:25:09 2001 -0400
+Message-Id: <m6@foo.bar>
+Date: Thu, 06 Sep 2001 14:25:03
+Subject: Re: other
+References: <m9@foo.bar> <m8@foo.bar> <m5@foo.bar> <m7@foo.bar>
+
+THIS: msg4
+}
+    set expected {
+	{m2@foo.bar}
+	{+m4@foo.bar}
+	{m5@foo.bar}
+	{+m6@foo.bar}
+    }
+    return [list "missing-parent" $ml $expected]
+}
+
+test_sorting::test_sorting
\ No newline at end of file
@@ -2388,7 +2388,7 @@ proc FolderFlagRange {handler index} {
 # Arguments:
 
 proc NetworkSync {} {
-    global option t numDeferred folderWindowList
+    global option t numDeferred
 
     if {[lindex $option(network_sync) 2]} {
 	RatLog 2 $t(running_cmd) explicit
@@ -2403,14 +2403,26 @@ proc NetworkSync {} {
     }
 
     if {[lindex $option(network_sync) 1]} {
-	RatSyncDisconnected
-	foreach f [array names folderWindowList] {
-	    upvar \#0 $f fh
-	    if {[info exists fh(folder_handler)] 
-		    && "" != $fh(folder_handler)
-		    && "dis" == [$fh(folder_handler) type]} {
-		Sync $f update
-	    }
+	RatSyncDisconnected -command NetworkSyncDone
+    }
+}
+
+# NetworkSyncDone --
+#
+# Called when the disconnected folders have been synchronized in the
+# background. Updates the open disconnected folders.
+#
+# Arguments:
+
+proc NetworkSyncDone {} {
+    global folderWindowList
+
+    foreach f [array names folderWindowList] {
+	upvar \#0 $f fh
+	if {[info exists fh(folder_handler)] 
+		&& "" != $fh(folder_handler)
+		&& "dis" == [$fh(folder_handler) type]} {
+	    Sync $f update
 	}
     }
 }
@@ -163,6 +163,11 @@ proc OptionsInit {} {
     # Time between checking for new mail in different folders
     set option(watcher_time) {30}
 
+    # True (1) if local folders should be updated as soon as the kernel
+    # reports a change. Mailboxes on network filesystems are still
+    # checked every watcher_time seconds.
+    set option(change_notify) 1
+
     # Geometry of watcher
     set option(watcher_geometry) -140+0
 
@@ -482,6 +487,19 @@ proc OptionsInit {} {
     # Directory to store local copies of disconnected folders
     set option(disconnected_dir) $option(ratatosk_dir)/disconnected
 
+    # Where to cache IMAP message bodies and how large (in KB) the cache
+    # may grow, a size of zero disables the cache
+    set option(bodycache_dir) $option(ratatosk_dir)/bodycache
+    set option(bodycache_size) 20480
+
+    # Where to cache the overviews of news groups, an empty value
+    # disables the cache
+    set option(overview_cache_dir) $option(ratatosk_dir)/overview
+
+    # Where to remember which messages of POP3 folders have been seen
+    # before, an empty value disables this
+    set option(pop3_state_dir) $option(ratatosk_dir)/pop3
+
     # What to synchronize when doing a network synchronization
     # deferred_messages disconnected_mailboxes run_cmd cmd_to_run
     set option(network_sync) {1 1 0 {}}